@@ -25,14 +25,36 @@ Send: MoveFullCW   This will instruct the stepper controller to move a full rota
 Send: MoveFullCCW  This will instruct the stepper controller to move a full rotation CCW or until it hits limits
 Send: MoveHalfCW   This will instruct the stepper controller to move a half rotation CW or until it hits limits
 Send: MoveHalfCCW  This will instruct the stepper controller to move a half rotation CCW or until it hits limits
+Send: MoveTo:<position>   This will instruct the stepper controller to move to an absolute position. ex: MoveTo:2012 It is clamped to the limits.
 Send: GetMotorStats  This will return the current motor stats ex: Settings: currentPosition,maxPosition,minDelay,maxDelay
 Send: SpeedTest   This will move to the half way position and then move the motor back and forth quickly.  
+Send: ScriptTest  The same as SpeedTest but sent to the stepper controller once as a script, so it runs with no more commands and exact timing.
 Send: Stop      This will stop the motor. Test it by commenting one of the Move statements wait for done and sendMessageToIDE function. Then stop it mid move.
 
+-Binary protocol
+The stepper controller also accepts compact binary frames described in LightningStepperProtocol.h. A move is 9 bytes instead of the 21 characters of Message(2,90,4023,1).
+This sketch sends the moves, stop, and settings request as binary frames. Set useBinaryProtocol to false to send the text commands instead. Forward always sends text.
+
+-Sequenced commands
+Set useSequencedCommands to true to send every command with a sequence number instead of the pin_CmdReady/pin_Processing handshake. The stepper controller ACKs each one in-band and this sketch sends it again on a NAK or when no ACK arrives in time.
+Commands go out whenever they are ready and pin_Done is replaced by asking for the status (Cmd 13), so the three pins do not need to be wired. Construct the stepper controller with -1 for them.
+
+-Shared bus
+Several stepper controllers can share Serial1 over RS-485 transceivers. Give each one its own node with setBusNode and set stepperControllerNode to the one this sketch drives.
+Commands then go out as node/command in text and with the node in the high nibble of a binary address. pin_BusDriverEnable drives this transceiver's DE/RE pins while sending.
+Run the setup of each stepper controller on its own (or restore it with setPersistence) since the setup messages are not addressed.
+
 -command format for the stepper controller
   Cmd 1-get the motor's settings.       Send: 1                           Replies: Strike(Settings: currentPosition,maxPosition,minDelay,maxDelay)
   Cmd 2-move to position.               Send: 2,speed,steps,direction     Replies:              
   Cmd 3 stop.                           Send: 3                           Replies:
+  Cmd 10-move to an absolute position.  Send: 10,speed,position           Replies:
+  Cmd 15-baud rate.                     Send: 15,baud                     Replies: Strike(Baud: baud) at the old rate, then switches
+  Cmd 16-sequence reset.                Send: seq#16                      Replies: Strike(ACK seq)
+  Cmd 17-hold.                          Send: 17                          Replies:
+  Cmd 18-sync start.                    Send: 18                          Replies:
+  Cmd 19-write the script.              Send: 19,offset,byte,byte,...     Replies: Strike(SC Error: script too long) only if it does not fit
+  Cmd 20-run the script.                Send: 20                          Replies: pin_Done goes high when it finishes
     
   Notes:
   Speed is [1-100]   1 the slowest. 100 the fastest. Calculated from the minDelay and maxDelay.
@@ -44,7 +66,8 @@ The maxPosition is counted from 0 so that means the number of steps to go around
 Therefore 360 degrees / 4024 steps = 0.08946322 degrees per step
 
 -Serial Communications
-Ensure baud rate is 9600
+Ensure baud rate is 9600 for the IDE.
+The link to the stepper controller starts at 9600 for the setup. Then Cmd 15 switches both ends to stepperControllerBaud. Use the same starting rate the stepper controller was constructed with.
 Ensure message is sent with the Message() block. This is default in the new IDE.
 Ensure a newline character is sent at the end
 
@@ -52,6 +75,9 @@ Ensure a newline character is sent at the end
 Please read the disclamer on the README file in the repository.
 */
 
+#include <LightningStepperProtocol.h>
+#include <LightningStepperScript.h>
+
 #pragma region Variables
 
 //--Serial Reading
@@ -80,9 +106,11 @@ String cmdMoveFullCW = "MoveFullCW";
 String cmdMoveFullCCW = "MoveFullCCW";
 String cmdMoveHalfCW = "MoveHalfCW";
 String cmdMoveHalfCCW = "MoveHalfCCW";
+String cmdMoveTo = "MoveTo:";
 String cmdGetMotorStats = "GetMotorStats";
 String cmdSpeedTest = "SpeedTest";
 String cmdStop = "Stop";
+String cmdScriptTest = "ScriptTest";
 
 //--LightningStepper responses
 //This makes it easy to filter what message comes from the serial port.
@@ -93,6 +121,10 @@ String msgAutoStarup = "Auto setup initiated.";
 String msgAutoSuccess = "Recieved minDelay:";
 String msgExitingSetup = "Exiting the runSetup";
 String msgSettings = "Settings:";
+String msgBaud = "Baud:";
+String msgStatus = "Status:";
+String msgAck = "ACK ";
+String msgNak = "NAK ";
 
 //--Settings/Trackers
 String minDelayString = "";
@@ -117,6 +149,34 @@ int maxPositionInt = 0;
 const int pin_Done = 45;
 int pin_Done_Val = 0;
 
+//--Serial link to the stepper controller
+//The rate the stepper controller starts at. The setup runs at this rate.
+const unsigned long stepperControllerStartBaud = 9600;
+//The rate both ends switch to once the setup is done. Up to 1000000 on hardware serial ports.
+const unsigned long stepperControllerBaud = 115200;
+
+//--Binary protocol
+//Send moves, stop, and the settings request as binary frames. False sends the Message() text commands.
+bool useBinaryProtocol = true;
+//Decodes the settings reply frame
+LightningStepperFrameDecoder frameDecoder;
+
+//--Sequenced commands
+//Send every command with a sequence number and wait for the ACK instead of using the handshake pins
+bool useSequencedCommands = false;
+//Sequence number of the next command. Cmd 16 starts the stepper controller counting from it.
+uint8_t nextSequence = 0;
+//Send a command again when its ACK has not arrived in this many milliseconds
+const unsigned long ackTimeoutMillis = 100;
+//How often to ask for the status while waiting for a move to finish
+const unsigned long statusPollMillis = 10;
+
+//--Shared bus
+//Node of the stepper controller this sketch drives. 0 unless it was set with setBusNode.
+const uint8_t stepperControllerNode = 0;
+//Drives the RS-485 transceiver's DE/RE pins while sending. -1 when Serial1 is wired straight to one stepper controller.
+const int pin_BusDriverEnable = -1;
+
 #pragma endregion Variables
 
 
@@ -130,13 +190,18 @@ void setup() {
   }
   //Setup the serial port with the stepper controller through TX1 RX1 pins
   Serial1.setTimeout(1000);
-  Serial1.begin(9600);
+  Serial1.begin(stepperControllerStartBaud);
   
 
   //Set the pins
   pinMode(pin_CmdReady,OUTPUT);
   pinMode(pin_Done,INPUT);
   pinMode(pin_Processing,INPUT);
+  if(pin_BusDriverEnable >= 0){
+    //Listen until there is something to send
+    pinMode(pin_BusDriverEnable,OUTPUT);
+    digitalWrite(pin_BusDriverEnable, LOW);
+  }
 
   //The stepper controller CmdReady pin is an INPUT_PULLUP
   //Set the command controller's CmdReady pin to High which means no commands ready.
@@ -155,6 +220,19 @@ void setup() {
   sendMessageToIDE("Setup complete. Try out some of the IDE commands mentioned in the comments at the top of the sketch.");
 
   sendMessageToSC("Go");
+
+  //Start the sequence numbers where this sketch starts them
+  if(useSequencedCommands){
+    if(useBinaryProtocol){
+      sendSequencedFrameToStepperController(LightningStepperProtocol::opSequenceReset, 0, 0);
+    }
+    else{
+      sendSequencedCommandToStepperController("16");
+    }
+  }
+
+  //Speed up the link now that the setup is done
+  changeStepperControllerBaud(stepperControllerBaud);
 }
 
 void loop() { 
@@ -181,12 +259,18 @@ void loop() {
     else if(msg.startsWith(cmdMoveHalfCCW)){
       moveHalfCCW();
     }   
+    else if(msg.startsWith(cmdMoveTo)){
+      moveTo();
+    }
     else if(msg.startsWith(cmdGetMotorStats)){
       getMotorStats();
     } 
     else if(msg.startsWith(cmdStop)){
       stopTheMotor();
     }  
+    else if(msg.startsWith(cmdScriptTest)){
+      scriptTest();
+    }
     else if(msg.startsWith(cmdSpeedTest)){
       speedTest();
     }  
@@ -348,8 +432,31 @@ void sendMessageToIDE(String p_msg){
 
 void sendMessageToSC(String p_msg){
   p_msg = "Message(" + p_msg + ")";
+  beginBusTransmit();
   Serial1.println(p_msg);
   Serial1.flush();
+  endBusTransmit();
+}
+
+String addressCommand(String p_cmd){
+  //Commands for any node but 0 start with the node and a slash
+  if(stepperControllerNode != 0){
+    return String(stepperControllerNode) + "/" + p_cmd;
+  }
+  return p_cmd;
+}
+
+void beginBusTransmit(){
+  if(pin_BusDriverEnable >= 0){
+    digitalWrite(pin_BusDriverEnable, HIGH);
+  }
+}
+
+void endBusTransmit(){
+  //Called after the flush so the last byte is all the way out before the line is let go for the reply
+  if(pin_BusDriverEnable >= 0){
+    digitalWrite(pin_BusDriverEnable, LOW);
+  }
 }
 
 #pragma endregion Utilities
@@ -371,128 +478,158 @@ void forward(){
   sendCommandToStepperController_NoInterrupts(msg);
 }
 void moveFullCW(){
-  sendCommandToStepperController_NoInterrupts("2,90,4023,1");
+  sendMoveToStepperController(90, 4023, 1, false);
   //Wait for the done pin to go high. Then send IDE a message the motor stopped.
   //The stepper controller keeps the done pin state high unless it is busy.  
-  keepWaiting = true;
-  while(keepWaiting == true){
-    pin_Done_Val = digitalRead(pin_Done);
-    if(pin_Done_Val == 1){
-      //Done
-      keepWaiting = false;
-    }
-  }  
+  waitForStepperControllerDone();
   sendMessageToIDE("Done moving.");
 }
 void moveFullCCW(){
-  sendCommandToStepperController_NoInterrupts("2,90,4023,2");
+  sendMoveToStepperController(90, 4023, 2, false);
   //Wait for the done pin to go high. Then send IDE a message the motor stopped.
   //The stepper controller keeps the done pin state high unless it is busy.  
-  keepWaiting = true;
-  while(keepWaiting == true){
-    pin_Done_Val = digitalRead(pin_Done);
-    if(pin_Done_Val == 1){
-      //Done
-      keepWaiting = false;
-    }
-  }  
+  waitForStepperControllerDone();
   sendMessageToIDE("Done moving.");
 }
 void moveHalfCW(){
-  sendCommandToStepperController_NoInterrupts("2,90,2012,1");
+  sendMoveToStepperController(90, 2012, 1, false);
   //Wait for the done pin to go high. Then send IDE a message the motor stopped.
   //The stepper controller keeps the done pin state high unless it is busy.  
-  keepWaiting = true;
-  while(keepWaiting == true){
-    pin_Done_Val = digitalRead(pin_Done);
-    if(pin_Done_Val == 1){
-      //Done
-      keepWaiting = false;
-    }
-  }  
+  waitForStepperControllerDone();
   sendMessageToIDE("Done moving.");
 }
 void moveHalfCCW(){
-  sendCommandToStepperController_NoInterrupts("2,90,2012,2");
+  sendMoveToStepperController(90, 2012, 2, false);
   //Wait for the done pin to go high. Then send IDE a message the motor stopped.
   //The stepper controller keeps the done pin state high unless it is busy.  
-  keepWaiting = true;
-  while(keepWaiting == true){
-    pin_Done_Val = digitalRead(pin_Done);
-    if(pin_Done_Val == 1){
-      //Done
-      keepWaiting = false;
-    }
-  }  
+  waitForStepperControllerDone();
+  sendMessageToIDE("Done moving.");
+}
+
+void moveTo(){
+  //Remove 'MoveTo:'
+  msg.remove(0,7);
+  //The stepper controller works out the direction and steps from where the motor is so there is no need to ask for its position first
+  sendMoveToPositionToStepperController(90, msg.toInt(), false);
+  //Wait for the done pin to go high. Then send IDE a message the motor stopped.
+  //The stepper controller keeps the done pin state high unless it is busy.  
+  waitForStepperControllerDone();
   sendMessageToIDE("Done moving.");
 }
 
 void getMotorStats(){
-  sendCommandToStepperController_NoInterrupts("1");
+  if(useBinaryProtocol){
+    sendFrameToStepperController(LightningStepperProtocol::opGetSettings, 0, 0, false);
+  }
+  else{
+    sendCommandToStepperController_NoInterrupts("1");
+  }
   //Wait for the done pin to go high. Then send IDE a message the motor stopped.
   //The stepper controller keeps the done pin state high unless it is busy.  
-  keepWaiting = true;
-  while(keepWaiting == true){
-    pin_Done_Val = digitalRead(pin_Done);
-    if(pin_Done_Val == 1){
-      //Done
-      keepWaiting = false;
-    }
-  }    
+  waitForStepperControllerDone();
   sendMessageToIDE("currentPosition: " + currentPositionString + " maxPosition: " + maxPositionString + " minDelay: " + minDelayString + " maxDelay: " + maxDelayString);
 }
 
 void speedTest(){
 
-  //Move to the half way position from power up. This waits for done. Just setting up the speed test.
-  moveHalfCCW();
+  //Move to the half way position. This waits for done. Just setting up the speed test.
+  sendMoveToPositionToStepperController(90, 2012, false);
+  waitForStepperControllerDone();
     
   //Use Iterrupts for max speed. 
   //Rotate back and forth
-  sendCommandToStepperController_InterruptsOk("2,100,1000,1");
+  sendMoveToStepperController(100, 1000, 1, true);
   delay(1000);
-  sendCommandToStepperController_InterruptsOk("2,100,1000,2");
+  sendMoveToStepperController(100, 1000, 2, true);
   delay(1000);
-  sendCommandToStepperController_InterruptsOk("2,100,1000,1");
+  sendMoveToStepperController(100, 1000, 1, true);
   delay(1000);
-  sendCommandToStepperController_InterruptsOk("2,100,1000,2");
+  sendMoveToStepperController(100, 1000, 2, true);
   delay(1000);
-  sendCommandToStepperController_InterruptsOk("2,100,1000,1");
+  sendMoveToStepperController(100, 1000, 1, true);
   delay(1000);
-  sendCommandToStepperController_InterruptsOk("2,100,1000,2");
+  sendMoveToStepperController(100, 1000, 2, true);
   delay(1000);
-  sendCommandToStepperController_InterruptsOk("2,100,1000,1");
+  sendMoveToStepperController(100, 1000, 1, true);
   delay(1000);
-  sendCommandToStepperController_InterruptsOk("2,100,1000,2");
+  sendMoveToStepperController(100, 1000, 2, true);
 
 }
 
+//The speed test as a script. See LightningStepperScript.h
+//Move to the half way position, then go back and forth 4 times pausing a second after each move
+const uint8_t speedTestScript[] = {
+  LightningStepperScript::opMoveTo, 0, 90, 0xDC, 0x07,
+  LightningStepperScript::opWaitDone,
+  LightningStepperScript::opLoop, 4,
+  LightningStepperScript::opMove, 0, 100, 0xE8, 0x03, 1,
+  LightningStepperScript::opDwell, 0xE8, 0x03,
+  LightningStepperScript::opMove, 0, 100, 0xE8, 0x03, 2,
+  LightningStepperScript::opDwell, 0xE8, 0x03,
+  LightningStepperScript::opEndLoop,
+  LightningStepperScript::opWaitDone,
+  LightningStepperScript::opEnd
+};
+
+void scriptTest(){
+  uploadScript(speedTestScript, sizeof(speedTestScript));
+  if(useBinaryProtocol){
+    sendFrameToStepperController(LightningStepperProtocol::opScriptRun, 0, 0, false);
+  }
+  else{
+    sendCommandToStepperController_NoInterrupts("20");
+  }
+  //The stepper controller holds the done pin low until the script ends
+  waitForStepperControllerDone();
+  sendMessageToIDE("Script finished.");
+}
+
+void uploadScript(const uint8_t* script, uint8_t length){
+  //Send the script a piece at a time. Each piece starts with its offset.
+  uint8_t pieceSize = useBinaryProtocol ? (LIGHTNINGSTEPPER_MAX_PAYLOAD - 1) : 6;
+  for(uint8_t offset = 0; offset < length; offset += pieceSize){
+    uint8_t count = length - offset;
+    if(count > pieceSize){
+      count = pieceSize;
+    }
+    if(useBinaryProtocol){
+      uint8_t payload[LIGHTNINGSTEPPER_MAX_PAYLOAD];
+      payload[0] = offset;
+      memcpy(&payload[1], &script[offset], count);
+      sendFrameToStepperController(LightningStepperProtocol::opScriptWrite, payload, count + 1, false);
+    }
+    else{
+      String cmd = "19," + String(offset);
+      for(uint8_t i = 0; i < count; i++){
+        cmd = cmd + "," + String(script[offset + i]);
+      }
+      sendCommandToStepperController_NoInterrupts(cmd);
+    }
+  }
+}
+
 void stopTheMotor(){
-  sendCommandToStepperController_InterruptsOk("3");
+  if(useBinaryProtocol){
+    sendFrameToStepperController(LightningStepperProtocol::opStop, 0, 0, true);
+  }
+  else{
+    sendCommandToStepperController_InterruptsOk("3");
+  }
   //Wait for the done pin to go high. Then send IDE a message the motor stopped.
   //The stepper controller keeps the done pin state high unless it is busy.  
-  keepWaiting = true;
-  while(keepWaiting == true){
-    pin_Done_Val = digitalRead(pin_Done);
-    if(pin_Done_Val == 1){
-      //Done
-      keepWaiting = false;
-    }
-  }  
+  waitForStepperControllerDone();
   sendMessageToIDE("Motor Stopped");  
 }
 
 void sendCommandToStepperController_NoInterrupts(String p_cmd){
   //Wait for the done pin to go high. Then send the message.
   //The stepper controller keeps the done pin state high unless it is busy.  
-  keepWaiting = true;
-  while(keepWaiting == true){
-    pin_Done_Val = digitalRead(pin_Done);
-    if(pin_Done_Val == 1){
-      //Done
-      keepWaiting = false;
-    }
-  }  
+  waitForStepperControllerDone();
+
+  if(useSequencedCommands){
+    sendSequencedCommandToStepperController(p_cmd);
+    return;
+  }
 
   //Pull the pin_CmdReady pin low to indicate a message.
   digitalWrite(pin_CmdReady, LOW);
@@ -510,7 +647,7 @@ void sendCommandToStepperController_NoInterrupts(String p_cmd){
   //Go ahead and remove the CmdReady pin signal to prevent an double cmd read
   digitalWrite(pin_CmdReady, HIGH);
   //Stepper controller ready for message, send it over
-  sendMessageToSC(p_cmd);
+  sendMessageToSC(addressCommand(p_cmd));
   //If using the get settings command, wait for the settings
   if(p_cmd == "1"){
     waitForMessage_SC(msgSettings);
@@ -532,6 +669,10 @@ void sendCommandToStepperController_NoInterrupts(String p_cmd){
 
 void sendCommandToStepperController_InterruptsOk(String p_cmd){
   //Send the message regardless of the done pin. This is great for a stop command or live movement. 
+  if(useSequencedCommands){
+    sendSequencedCommandToStepperController(p_cmd);
+    return;
+  }
 
   //Pull the pin_CmdReady pin low to indicate a message.
   digitalWrite(pin_CmdReady, LOW);
@@ -549,7 +690,7 @@ void sendCommandToStepperController_InterruptsOk(String p_cmd){
   //Go ahead and remove the CmdReady pin signal to prevent an double cmd read
   digitalWrite(pin_CmdReady, HIGH);
   //Stepper controller ready for message, send it over
-  sendMessageToSC(p_cmd);
+  sendMessageToSC(addressCommand(p_cmd));
   //If using the get settings command, wait for the settings
   if(p_cmd == "1"){
     waitForMessage_SC(msgSettings);
@@ -570,6 +711,258 @@ void sendCommandToStepperController_InterruptsOk(String p_cmd){
 }
 
 
+void sendMoveToStepperController(int speed, int steps, int direction, bool interruptsOk){
+  if(useBinaryProtocol){
+    //speed(u8),steps(u16),direction(u8)
+    uint8_t payload[4];
+    payload[0] = speed;
+    LightningStepperProtocol::putUInt16(&payload[1], steps);
+    payload[3] = direction;
+    sendFrameToStepperController(LightningStepperProtocol::opMove, payload, sizeof(payload), interruptsOk);
+  }
+  else{
+    String cmd = "2," + String(speed) + "," + String(steps) + "," + String(direction);
+    if(interruptsOk){
+      sendCommandToStepperController_InterruptsOk(cmd);
+    }
+    else{
+      sendCommandToStepperController_NoInterrupts(cmd);
+    }
+  }
+}
+
+void sendMoveToPositionToStepperController(int speed, int position, bool interruptsOk){
+  if(useBinaryProtocol){
+    //speed(u8),position(i16)
+    uint8_t payload[3];
+    payload[0] = speed;
+    LightningStepperProtocol::putUInt16(&payload[1], position);
+    sendFrameToStepperController(LightningStepperProtocol::opMoveTo, payload, sizeof(payload), interruptsOk);
+  }
+  else{
+    String cmd = "10," + String(speed) + "," + String(position);
+    if(interruptsOk){
+      sendCommandToStepperController_InterruptsOk(cmd);
+    }
+    else{
+      sendCommandToStepperController_NoInterrupts(cmd);
+    }
+  }
+}
+
+void sendFrameToStepperController(uint8_t opcode, const uint8_t* payload, uint8_t length, bool interruptsOk){
+  if(interruptsOk == false){
+    //Wait for the done pin to go high. Then send the message.
+    //The stepper controller keeps the done pin state high unless it is busy.  
+    waitForStepperControllerDone();
+  }
+
+  if(useSequencedCommands){
+    sendSequencedFrameToStepperController(opcode, payload, length);
+    //If using the get settings command, wait for the settings reply frame
+    if(opcode == LightningStepperProtocol::opGetSettings){
+      waitForSettingsFrame_SC();
+    }
+    return;
+  }
+
+  //Pull the pin_CmdReady pin low to indicate a message.
+  digitalWrite(pin_CmdReady, LOW);
+
+  //Wait for the stepper controller to reply it has started processing. Low to High transition
+  keepWaiting = true;
+  while(keepWaiting == true){
+    pin_Processing_Val = digitalRead(pin_Processing);
+    if(pin_Processing_Val == 1){
+      //Done
+      keepWaiting = false;
+    }
+  }  
+
+  //Go ahead and remove the CmdReady pin signal to prevent an double cmd read
+  digitalWrite(pin_CmdReady, HIGH);
+  //Stepper controller ready for the frame, send it over
+  beginBusTransmit();
+  LightningStepperProtocol::writeFrame(Serial1, stepperControllerNode << 4, opcode, payload, length);
+  Serial1.flush();
+  endBusTransmit();
+  //If using the get settings command, wait for the settings reply frame
+  if(opcode == LightningStepperProtocol::opGetSettings){
+    waitForSettingsFrame_SC();
+  }
+
+  //Wait for the stepper controller to reply it has finished processing. High to low transition
+  keepWaiting = true;
+  while(keepWaiting == true){
+    pin_Processing_Val = digitalRead(pin_Processing);
+    if(pin_Processing_Val == 0){
+      //Done
+      keepWaiting = false;
+    }
+  }   
+  //The stepper controller can now be interrupted with CMDReady
+}
+
+void waitForSettingsFrame_SC(){
+  //Decode bytes until the settings reply arrives
+  frameDecoder.reset();
+  keepWaiting = true;
+  while(keepWaiting == true){
+    if(Serial1.available() > 0){
+      if(frameDecoder.feed(Serial1.read()) == LightningStepperFrameDecoder::Complete && frameDecoder.opcode == (LightningStepperProtocol::opGetSettings | LightningStepperProtocol::replyFlag)){
+        //currentPosition(i16),maxPosition(i16),minDelay(u16),maxDelay(u16)
+        currentPositionInt = (int16_t)LightningStepperProtocol::getUInt16(&frameDecoder.payload[0]);
+        maxPositionInt = (int16_t)LightningStepperProtocol::getUInt16(&frameDecoder.payload[2]);
+        minDelayInt = LightningStepperProtocol::getUInt16(&frameDecoder.payload[4]);
+        maxDelayInt = LightningStepperProtocol::getUInt16(&frameDecoder.payload[6]);
+        //Keep the strings in step for getMotorStats
+        currentPositionString = String(currentPositionInt);
+        maxPositionString = String(maxPositionInt);
+        minDelayString = String(minDelayInt);
+        maxDelayString = String(maxDelayInt);
+        keepWaiting = false;
+      }
+    }
+  }
+}
+
+void waitForStepperControllerDone(){
+  //The stepper controller keeps the done pin state high unless it is busy.
+  if(useSequencedCommands == false){
+    keepWaiting = true;
+    while(keepWaiting == true){
+      pin_Done_Val = digitalRead(pin_Done);
+      if(pin_Done_Val == 1){
+        //Done
+        keepWaiting = false;
+      }
+    }
+    return;
+  }
+  //Without the pin ask for the status until the state is 0, done. The motor keeps moving while it answers.
+  //The send and wait functions use keepWaiting themselves
+  bool moving = true;
+  while(moving == true){
+    if(useBinaryProtocol){
+      sendSequencedFrameToStepperController(LightningStepperProtocol::opStatus, 0, 0);
+      //position(i16),velocity(i16),state(u8),queueDepth(u8)
+      waitForFrame_SC(LightningStepperProtocol::opStatus | LightningStepperProtocol::replyFlag);
+      moving = (frameDecoder.payload[4] != 0);
+    }
+    else{
+      sendSequencedCommandToStepperController("13");
+      //Status: axis,currentPosition,velocity,state,queueDepth
+      waitForMessage_SC(msgStatus);
+      msg.remove(0, msgStatus.length());
+      for(int i = 0; i < 3; i++){
+        msg.remove(0, msg.indexOf(",") + 1);
+      }
+      moving = (msg.toInt() != 0);
+    }
+    if(moving){
+      delay(statusPollMillis);
+    }
+  }
+}
+
+void sendSequencedCommandToStepperController(String p_cmd){
+  //Send it with the next sequence number until it is ACKed. A NAK or no ACK in time sends it again.
+  //The stepper controller runs it once however many copies arrive.
+  String sequence = String(nextSequence);
+  nextSequence++;
+  keepWaiting = true;
+  while(keepWaiting == true){
+    sendMessageToSC(sequence + "#" + addressCommand(p_cmd));
+    keepWaiting = !waitForAck_SC(sequence);
+  }
+  //If using the get settings command, wait for the settings
+  if(p_cmd == "1"){
+    waitForMessage_SC(msgSettings);
+    //Convert and assign values to variables
+    processMotorSettings(msg);
+  }
+}
+
+bool waitForAck_SC(String p_sequence){
+  //Returns true on the ACK. False on a NAK or the timeout.
+  unsigned long start = millis();
+  String line = "";
+  while(millis() - start < ackTimeoutMillis){
+    if(Serial1.available() > 0){
+      char c = Serial1.read();
+      if(c != '\n'){
+        line += c;
+      }
+      else{
+        line.trim();
+        if(line.startsWith("Strike(")){
+          line = cleanStepperControllerMsg(line);
+          if(line == msgAck + p_sequence){
+            return true;
+          }
+          if(line.startsWith(msgNak)){
+            return false;
+          }
+        }
+        line = "";
+      }
+    }
+  }
+  return false;
+}
+
+void sendSequencedFrameToStepperController(uint8_t opcode, const uint8_t* payload, uint8_t length){
+  //Send it with the next sequence number until it is ACKed. A NAK or no ACK in time sends it again.
+  uint8_t sequence = nextSequence;
+  nextSequence++;
+  keepWaiting = true;
+  while(keepWaiting == true){
+    beginBusTransmit();
+    LightningStepperProtocol::writeSequencedFrame(Serial1, sequence, stepperControllerNode << 4, opcode, payload, length);
+    Serial1.flush();
+    endBusTransmit();
+    keepWaiting = !waitForAckFrame_SC(sequence);
+  }
+}
+
+bool waitForAckFrame_SC(uint8_t p_sequence){
+  //Returns true on the ACK. False on a NAK or the timeout.
+  unsigned long start = millis();
+  frameDecoder.reset();
+  while(millis() - start < ackTimeoutMillis){
+    if(Serial1.available() > 0 && frameDecoder.feed(Serial1.read()) == LightningStepperFrameDecoder::Complete){
+      if(frameDecoder.opcode == LightningStepperProtocol::opAck && frameDecoder.payload[0] == p_sequence){
+        return true;
+      }
+      if(frameDecoder.opcode == LightningStepperProtocol::opNak){
+        return false;
+      }
+    }
+  }
+  return false;
+}
+
+void waitForFrame_SC(uint8_t p_opcode){
+  //Decode bytes until a reply with this opcode arrives
+  frameDecoder.reset();
+  keepWaiting = true;
+  while(keepWaiting == true){
+    if(Serial1.available() > 0){
+      if(frameDecoder.feed(Serial1.read()) == LightningStepperFrameDecoder::Complete && frameDecoder.opcode == p_opcode){
+        keepWaiting = false;
+      }
+    }
+  }
+}
+
+void changeStepperControllerBaud(unsigned long baud){
+  //The stepper controller replies at the old rate and then switches. Read the reply before following it.
+  sendCommandToStepperController_NoInterrupts("15," + String(baud));
+  waitForMessage_SC(msgBaud);
+  Serial1.begin(baud);
+  sendMessageToIDE(msg);
+}
+
 void setupStepperController(){
   sendMessageToIDE("Command Controller is setting up the Stepper Controller");
 
@@ -577,7 +970,7 @@ void setupStepperController(){
   digitalWrite(pin_CmdReady, LOW);
 
   //Wait for the stepper controller to power up and request setup mode
-  //ex: Strike(Motor Running. To manually setup a motor reply '1', to auto setup a motor reply '2')
+  //ex: Strike(Motor Running. To manually setup a motor reply '1', to auto setup a motor reply '2', to home with the limit switches reply '3')
   waitForMessage_SC(msgMotorRunning);
   sendMessageToIDE("motor running");
   //Remove the signal from the CMDReady pin
@@ -4,14 +4,15 @@
 
 #include <LightningStepper.h>
 
-//-Warning!!: Physical limit switches should be used when controlling motors. For simplicity of code and the fact that my motor is setup with a safe full range of motion, the physical limit switches are not included.
+//-Warning!!: Physical limit switches should be used when controlling motors. For simplicity of code and the fact that my motor is setup with a safe full range of motion, the physical limit switches are not used in this example.
+//They can be attached with setLimitSwitches in setup.
 //Please read the disclamer on the README file in the repository.
 
 //Sketch uses 12678  bytes of program storage space.
 //Global variables use 970 bytes of dynamic memory
 
 //Serial Communications:
-//Ensure baud rate is 9600
+//Ensure baud rate is 9600. The command controller can raise it after the setup with Cmd 15.
 //Ensure message is sent with the Message() block. This is default in the new IDE.
 //Ensure newline is sent. 
 
@@ -22,11 +23,32 @@
 //The pin_Done will produce +5V when the stepper controller is done running the command sent to it. This can go to an LED or to your command controller for an iterrupt in it's logic.
 //pin_Processing is used by the command controller logic. See the example sketch LightningStepper_CommandController for details.
 LightningStepper myStepper(2,3,4,5,12,11,10);
+//To keep the USB port free for debugging, talk to the command controller on another port and pick its starting baud rate. ex: Serial1 on a Mega
+//LightningStepper myStepper(2,3,4,5,12,11,10,Serial1,9600);
+//With sequenced commands the three handshake pins can be left out with -1, ex: on a shared RS-485 bus
+//LightningStepper myStepper(2,3,4,5,-1,-1,-1,Serial1,115200);
+//More motors can be driven from this board. Create each one with just its IN pins and attach it in setup. Send commands to it with its axis number, ex: Message(1:2,100,400,1)
+//Keep the four IN pins of each motor on one port, ex: 2-5 or A0-A3 on an Uno. See LightningStepperCoils.h for pins that span ports.
+//LightningStepper mySecondStepper(A0,A1,A2,A3);
 
 void setup() {
+  //Attach any extra motors before runSetup. The first one attached is axis 1.
+  //myStepper.attachAxis(mySecondStepper);
+  //Save the settings and position to EEPROM so the next power up skips the setup. Hold pin_CmdReady low at power up to run the setup anyway.
+  //myStepper.setPersistence(true);
+  //Attach limit switches, -1 for none. They are INPUT_PULLUP like pin_CmdReady. With a min switch the setup can home the motor (reply '3').
+  //myStepper.setLimitSwitches(6,7);
+  //Stop every motor the moment pin_CmdReady goes low. Needs pin_CmdReady on an interrupt pin.
+  //myStepper.setHaltOnCmdReady(true);
+  //Release the coils after 2 seconds idle, keep a quarter strength hold, and sleep between commands
+  //myStepper.setIdlePolicy(2000, 64, true);
+  //Share the serial bus with other stepper controllers as node 3. Pin 13 drives the RS-485 transceiver's DE/RE pins.
+  //myStepper.setBusNode(3, 13);
+  //Ease the acceleration in and out with an S-curve instead of the trapezoid ramp. Uncomment LIGHTNINGSTEPPER_SCURVE in LightningStepper.h first.
+  //myStepper.setSpeedProfile(LightningStepper::SCurve);
   //Call the RunSetup method on the LightningStepper object.
   //Send the CmdReady pin low to start the setup prompt.
-  //Either reply to manually setup or set to known parameters with auto setup. 
+  //Either reply to manually setup, set to known parameters with auto setup, or home with the limit switches. 
   myStepper.runSetup();
 }
 
@@ -0,0 +1,139 @@
+/*
+  Arduino.h - Simulated Arduino core for building the LightningStepper library on a PC.
+  Part of the LightningStepper library by Calvin Bultz.
+  Released into the public domain.
+  -Only the parts of the Arduino API the library uses. __AVR__ is not defined so the library takes its portable paths:
+    the step timer is emulated with micros() from run() and the coils are written with digitalWrite.
+  -ARDUINO_HOST is defined so the library can use the parts of avr-libc the simulated core has as well, like avr/eeprom.h.
+  -Time, pins, and the serial ports are virtual. Tests drive them through ArduinoHost.h.
+*/
+#ifndef Arduino_h
+#define Arduino_h
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+#include <stdlib.h>
+
+#define ARDUINO_HOST
+
+#define HIGH 0x1
+#define LOW 0x0
+
+#define INPUT 0x0
+#define OUTPUT 0x1
+#define INPUT_PULLUP 0x2
+
+#define CHANGE 1
+#define FALLING 2
+#define RISING 3
+#define NOT_AN_INTERRUPT -1
+
+#define DEC 10
+#define HEX 16
+
+//Flash and RAM are the same thing on a PC
+#define PROGMEM
+#define pgm_read_byte(address) (*(const uint8_t*)(address))
+#define pgm_read_word(address) (*(const uint16_t*)(address))
+class __FlashStringHelper;
+#define F(string_literal) (reinterpret_cast<const __FlashStringHelper*>(string_literal))
+
+typedef bool boolean;
+typedef uint8_t byte;
+
+void pinMode(uint8_t pin, uint8_t mode);
+void digitalWrite(uint8_t pin, uint8_t value);
+int digitalRead(uint8_t pin);
+
+unsigned long micros();
+unsigned long millis();
+void delay(unsigned long ms);
+void delayMicroseconds(unsigned int us);
+
+void noInterrupts();
+void interrupts();
+//Pins 2 and 3 have external interrupts 0 and 1 like an Uno
+int digitalPinToInterrupt(uint8_t pin);
+void attachInterrupt(uint8_t interruptNum, void (*isr)(), int mode);
+void detachInterrupt(uint8_t interruptNum);
+
+class Print
+{
+    public:
+        virtual ~Print() {}
+        virtual size_t write(uint8_t c) = 0;
+        virtual size_t write(const uint8_t* buffer, size_t size);
+        size_t write(const char* str);
+        virtual void flush() {}
+
+        size_t print(const __FlashStringHelper* text);
+        size_t print(const char* text);
+        size_t print(char c);
+        size_t print(unsigned char value, int base = DEC);
+        size_t print(int value, int base = DEC);
+        size_t print(unsigned int value, int base = DEC);
+        size_t print(long value, int base = DEC);
+        size_t print(unsigned long value, int base = DEC);
+
+        size_t println(const __FlashStringHelper* text);
+        size_t println(const char* text);
+        size_t println(char c);
+        size_t println(unsigned char value, int base = DEC);
+        size_t println(int value, int base = DEC);
+        size_t println(unsigned int value, int base = DEC);
+        size_t println(long value, int base = DEC);
+        size_t println(unsigned long value, int base = DEC);
+        size_t println();
+    private:
+        size_t printNumber(unsigned long value, int base);
+};
+
+class Stream : public Print
+{
+    public:
+        virtual int available() = 0;
+        virtual int read() = 0;
+        virtual int peek() = 0;
+};
+
+//A virtual hardware serial port. What the library sends is captured and what it reads is fed in by the test. Nothing is allocated.
+class HardwareSerial : public Stream
+{
+    public:
+        void begin(unsigned long baud);
+        void end();
+        int available() override;
+        int read() override;
+        int peek() override;
+        size_t write(uint8_t c) override;
+        using Print::write;
+        operator bool() { return true; }
+
+        //--Test side
+        //Queue bytes for the library to read
+        void feed(const char* text);
+        void feed(const uint8_t* data, size_t count);
+        //Everything written since the last clearOutput(), NUL terminated
+        const char* output() const;
+        size_t outputLength() const;
+        void clearOutput();
+        //Rate passed to the last begin(). 0 before begin() or after end().
+        unsigned long baud() const;
+        //Number of times begin() was called
+        unsigned int beginCount() const;
+    private:
+        static const size_t rxSize = 4096;
+        static const size_t txSize = 16384;
+        uint8_t rx[rxSize];
+        size_t rxHead = 0;
+        size_t rxCount = 0;
+        char tx[txSize + 1];
+        size_t txLength = 0;
+        unsigned long currentBaud = 0;
+        unsigned int begins = 0;
+};
+
+extern HardwareSerial Serial;
+extern HardwareSerial Serial1;
+
+#endif
@@ -0,0 +1,602 @@
+/*
+  ArduinoHost.cpp - Simulated Arduino core for building the LightningStepper library on a PC.
+  Part of the LightningStepper library by Calvin Bultz.
+  Released into the public domain.
+*/
+
+#include "Arduino.h"
+#include "ArduinoHost.h"
+#include "avr/eeprom.h"
+
+HardwareSerial Serial;
+HardwareSerial Serial1;
+
+namespace
+{
+    unsigned long virtualClock = 0;
+    unsigned int microsPerCall = 1;
+
+    uint8_t pinModes[ArduinoHost::maxPins];
+    uint8_t outputLevels[ArduinoHost::maxPins];
+    //Inputs the test drives and the level it drives them to
+    bool driven[ArduinoHost::maxPins];
+    uint8_t drivenLevels[ArduinoHost::maxPins];
+
+    const uint8_t interruptCount = 2;
+    void (*isrs[interruptCount])() = { 0, 0 };
+    int isrModes[interruptCount];
+    bool pendingIsr[interruptCount];
+    bool enabled = true;
+
+    ArduinoHost::Edge edges[ArduinoHost::edgeCapacity];
+    size_t edgeStart = 0;
+    size_t edgesHeld = 0;
+    unsigned long edgesDropped = 0;
+
+    uint8_t eepromData[ArduinoHost::eepromSize];
+    unsigned long eepromWriteCounts[ArduinoHost::eepromSize];
+    //A write is in progress until then
+    unsigned long eepromBusyUntil = 0;
+    bool eepromInitialized = false;
+
+    //Starts out blank the first time it is used
+    void eepromPowerUp()
+    {
+        if (eepromInitialized == false)
+        {
+            ArduinoHost::eraseEeprom();
+        }
+    }
+
+    void logEdge(uint8_t pin, uint8_t value)
+    {
+        if (edgesHeld == ArduinoHost::edgeCapacity)
+        {
+            edgeStart = (edgeStart + 1) % ArduinoHost::edgeCapacity;
+            edgesHeld--;
+            edgesDropped++;
+        }
+        ArduinoHost::Edge& edge = edges[(edgeStart + edgesHeld) % ArduinoHost::edgeCapacity];
+        edge.time = virtualClock;
+        edge.pin = pin;
+        edge.value = value;
+        edgesHeld++;
+    }
+
+    int interruptForPin(uint8_t pin)
+    {
+        if (pin == 2)
+        {
+            return 0;
+        }
+        if (pin == 3)
+        {
+            return 1;
+        }
+        return NOT_AN_INTERRUPT;
+    }
+
+    void runPendingIsrs()
+    {
+        for (uint8_t i = 0; i < interruptCount; i++)
+        {
+            if (pendingIsr[i] == true && enabled == true)
+            {
+                pendingIsr[i] = false;
+                //Interrupts are off while an ISR runs
+                enabled = false;
+                isrs[i]();
+                enabled = true;
+            }
+        }
+    }
+
+    uint8_t readLevel(uint8_t pin)
+    {
+        if (driven[pin] == true)
+        {
+            return drivenLevels[pin];
+        }
+        if (pinModes[pin] == OUTPUT)
+        {
+            return outputLevels[pin];
+        }
+        //A floating INPUT reads whatever. Call it HIGH like the pullup.
+        return HIGH;
+    }
+}
+
+#pragma region Core
+
+void pinMode(uint8_t pin, uint8_t mode)
+{
+    if (pin < ArduinoHost::maxPins)
+    {
+        pinModes[pin] = mode;
+    }
+}
+
+void digitalWrite(uint8_t pin, uint8_t value)
+{
+    if (pin >= ArduinoHost::maxPins)
+    {
+        return;
+    }
+    value = (value == LOW) ? LOW : HIGH;
+    if (outputLevels[pin] != value)
+    {
+        outputLevels[pin] = value;
+        logEdge(pin, value);
+    }
+}
+
+int digitalRead(uint8_t pin)
+{
+    if (pin >= ArduinoHost::maxPins)
+    {
+        return LOW;
+    }
+    return readLevel(pin);
+}
+
+unsigned long micros()
+{
+    unsigned long time = virtualClock;
+    virtualClock += microsPerCall;
+    return time;
+}
+
+unsigned long millis()
+{
+    return micros() / 1000UL;
+}
+
+void delay(unsigned long ms)
+{
+    virtualClock += ms * 1000UL;
+}
+
+void delayMicroseconds(unsigned int us)
+{
+    virtualClock += us;
+}
+
+void noInterrupts()
+{
+    enabled = false;
+}
+
+void interrupts()
+{
+    enabled = true;
+    runPendingIsrs();
+}
+
+int digitalPinToInterrupt(uint8_t pin)
+{
+    return interruptForPin(pin);
+}
+
+void attachInterrupt(uint8_t interruptNum, void (*isr)(), int mode)
+{
+    if (interruptNum < interruptCount)
+    {
+        isrs[interruptNum] = isr;
+        isrModes[interruptNum] = mode;
+        pendingIsr[interruptNum] = false;
+    }
+}
+
+void detachInterrupt(uint8_t interruptNum)
+{
+    if (interruptNum < interruptCount)
+    {
+        isrs[interruptNum] = 0;
+        pendingIsr[interruptNum] = false;
+    }
+}
+
+#pragma endregion Core
+
+#pragma region Print
+
+size_t Print::write(const uint8_t* buffer, size_t size)
+{
+    size_t written = 0;
+    for (size_t i = 0; i < size; i++)
+    {
+        written += write(buffer[i]);
+    }
+    return written;
+}
+
+size_t Print::write(const char* str)
+{
+    if (str == 0)
+    {
+        return 0;
+    }
+    return write((const uint8_t*)str, strlen(str));
+}
+
+size_t Print::printNumber(unsigned long value, int base)
+{
+    char buffer[8 * sizeof(unsigned long) + 1];
+    char* cursor = &buffer[sizeof(buffer) - 1];
+    *cursor = '\0';
+    if (base < 2)
+    {
+        base = 10;
+    }
+    do
+    {
+        unsigned long digit = value % base;
+        value /= base;
+        *--cursor = (char)(digit < 10 ? '0' + digit : 'A' + digit - 10);
+    } while (value != 0);
+    return write(cursor);
+}
+
+size_t Print::print(const __FlashStringHelper* text)
+{
+    return write(reinterpret_cast<const char*>(text));
+}
+
+size_t Print::print(const char* text)
+{
+    return write(text);
+}
+
+size_t Print::print(char c)
+{
+    return write((uint8_t)c);
+}
+
+size_t Print::print(unsigned char value, int base)
+{
+    return printNumber(value, base);
+}
+
+size_t Print::print(int value, int base)
+{
+    return print((long)value, base);
+}
+
+size_t Print::print(unsigned int value, int base)
+{
+    return printNumber(value, base);
+}
+
+size_t Print::print(long value, int base)
+{
+    if (base == 10 && value < 0)
+    {
+        return write((uint8_t)'-') + printNumber(0UL - (unsigned long)value, 10);
+    }
+    return printNumber((unsigned long)value, base);
+}
+
+size_t Print::print(unsigned long value, int base)
+{
+    return printNumber(value, base);
+}
+
+size_t Print::println()
+{
+    return write("\r\n");
+}
+
+size_t Print::println(const __FlashStringHelper* text)
+{
+    return print(text) + println();
+}
+
+size_t Print::println(const char* text)
+{
+    return print(text) + println();
+}
+
+size_t Print::println(char c)
+{
+    return print(c) + println();
+}
+
+size_t Print::println(unsigned char value, int base)
+{
+    return print(value, base) + println();
+}
+
+size_t Print::println(int value, int base)
+{
+    return print(value, base) + println();
+}
+
+size_t Print::println(unsigned int value, int base)
+{
+    return print(value, base) + println();
+}
+
+size_t Print::println(long value, int base)
+{
+    return print(value, base) + println();
+}
+
+size_t Print::println(unsigned long value, int base)
+{
+    return print(value, base) + println();
+}
+
+#pragma endregion Print
+
+#pragma region HardwareSerial
+
+void HardwareSerial::begin(unsigned long baud)
+{
+    currentBaud = baud;
+    begins++;
+}
+
+void HardwareSerial::end()
+{
+    currentBaud = 0;
+}
+
+int HardwareSerial::available()
+{
+    return (int)rxCount;
+}
+
+int HardwareSerial::read()
+{
+    if (rxCount == 0)
+    {
+        return -1;
+    }
+    uint8_t data = rx[rxHead];
+    rxHead = (rxHead + 1) % rxSize;
+    rxCount--;
+    return data;
+}
+
+int HardwareSerial::peek()
+{
+    return (rxCount == 0) ? -1 : rx[rxHead];
+}
+
+size_t HardwareSerial::write(uint8_t c)
+{
+    //A full capture drops the byte so nothing is ever allocated
+    if (txLength >= txSize)
+    {
+        return 0;
+    }
+    tx[txLength++] = (char)c;
+    tx[txLength] = '\0';
+    return 1;
+}
+
+void HardwareSerial::feed(const char* text)
+{
+    HardwareSerial::feed((const uint8_t*)text, strlen(text));
+}
+
+void HardwareSerial::feed(const uint8_t* data, size_t count)
+{
+    for (size_t i = 0; i < count && rxCount < rxSize; i++)
+    {
+        rx[(rxHead + rxCount) % rxSize] = data[i];
+        rxCount++;
+    }
+}
+
+const char* HardwareSerial::output() const
+{
+    return tx;
+}
+
+size_t HardwareSerial::outputLength() const
+{
+    return txLength;
+}
+
+void HardwareSerial::clearOutput()
+{
+    txLength = 0;
+    tx[0] = '\0';
+}
+
+unsigned long HardwareSerial::baud() const
+{
+    return currentBaud;
+}
+
+unsigned int HardwareSerial::beginCount() const
+{
+    return begins;
+}
+
+#pragma endregion HardwareSerial
+
+#pragma region EEPROM
+
+uint8_t eeprom_read_byte(const uint8_t* address)
+{
+    eepromPowerUp();
+    return eepromData[(size_t)address % ArduinoHost::eepromSize];
+}
+
+void eeprom_read_block(void* destination, const void* source, size_t count)
+{
+    for (size_t i = 0; i < count; i++)
+    {
+        ((uint8_t*)destination)[i] = eeprom_read_byte((const uint8_t*)source + i);
+    }
+}
+
+void eeprom_update_byte(uint8_t* address, uint8_t value)
+{
+    eepromPowerUp();
+    size_t index = (size_t)address % ArduinoHost::eepromSize;
+    if (eepromData[index] == value)
+    {
+        return;
+    }
+    //Wait out the write before it
+    if ((long)(eepromBusyUntil - virtualClock) > 0)
+    {
+        virtualClock = eepromBusyUntil;
+    }
+    eepromData[index] = value;
+    eepromWriteCounts[index]++;
+    eepromBusyUntil = virtualClock + ArduinoHost::eepromWriteMicros;
+}
+
+void eeprom_update_block(const void* source, void* destination, size_t count)
+{
+    for (size_t i = 0; i < count; i++)
+    {
+        eeprom_update_byte((uint8_t*)destination + i, ((const uint8_t*)source)[i]);
+    }
+}
+
+int eeprom_is_ready()
+{
+    return ((long)(eepromBusyUntil - virtualClock) <= 0) ? 1 : 0;
+}
+
+#pragma endregion EEPROM
+
+#pragma region Host
+
+void ArduinoHost::reset()
+{
+    virtualClock = 0;
+    microsPerCall = 1;
+    enabled = true;
+    for (uint8_t pin = 0; pin < maxPins; pin++)
+    {
+        pinModes[pin] = INPUT;
+        outputLevels[pin] = LOW;
+        driven[pin] = false;
+    }
+    for (uint8_t i = 0; i < interruptCount; i++)
+    {
+        isrs[i] = 0;
+        pendingIsr[i] = false;
+    }
+    ArduinoHost::clearEdges();
+    //A write that was going finishes before the power comes back
+    eepromBusyUntil = 0;
+    Serial.end();
+    Serial.clearOutput();
+    Serial1.end();
+    Serial1.clearOutput();
+    while (Serial.read() >= 0)
+    {
+    }
+    while (Serial1.read() >= 0)
+    {
+    }
+}
+
+unsigned long ArduinoHost::now()
+{
+    return virtualClock;
+}
+
+void ArduinoHost::advance(unsigned long us)
+{
+    virtualClock += us;
+}
+
+void ArduinoHost::setMicrosPerCall(unsigned int us)
+{
+    microsPerCall = us;
+}
+
+void ArduinoHost::setInput(uint8_t pin, uint8_t level)
+{
+    if (pin >= maxPins)
+    {
+        return;
+    }
+    uint8_t before = readLevel(pin);
+    driven[pin] = true;
+    drivenLevels[pin] = (level == LOW) ? LOW : HIGH;
+    int interruptNum = interruptForPin(pin);
+    if (interruptNum != NOT_AN_INTERRUPT && isrs[interruptNum] != 0 && before == HIGH && drivenLevels[pin] == LOW
+        && (isrModes[interruptNum] == FALLING || isrModes[interruptNum] == CHANGE))
+    {
+        pendingIsr[interruptNum] = true;
+        runPendingIsrs();
+    }
+}
+
+void ArduinoHost::releaseInput(uint8_t pin)
+{
+    if (pin < maxPins)
+    {
+        driven[pin] = false;
+    }
+}
+
+uint8_t ArduinoHost::outputLevel(uint8_t pin)
+{
+    return (pin < maxPins) ? outputLevels[pin] : LOW;
+}
+
+uint8_t ArduinoHost::mode(uint8_t pin)
+{
+    return (pin < maxPins) ? pinModes[pin] : INPUT;
+}
+
+bool ArduinoHost::interruptsEnabled()
+{
+    return enabled;
+}
+
+size_t ArduinoHost::edgeCount()
+{
+    return edgesHeld;
+}
+
+const ArduinoHost::Edge& ArduinoHost::edge(size_t index)
+{
+    return edges[(edgeStart + index) % edgeCapacity];
+}
+
+void ArduinoHost::clearEdges()
+{
+    edgeStart = 0;
+    edgesHeld = 0;
+    edgesDropped = 0;
+}
+
+unsigned long ArduinoHost::droppedEdges()
+{
+    return edgesDropped;
+}
+
+uint8_t* ArduinoHost::eeprom()
+{
+    eepromPowerUp();
+    return eepromData;
+}
+
+void ArduinoHost::eraseEeprom()
+{
+    eepromInitialized = true;
+    eepromBusyUntil = virtualClock;
+    for (size_t i = 0; i < eepromSize; i++)
+    {
+        eepromData[i] = 0xFF;
+        eepromWriteCounts[i] = 0;
+    }
+}
+
+unsigned long ArduinoHost::eepromWrites(size_t address)
+{
+    return (address < eepromSize) ? eepromWriteCounts[address] : 0;
+}
+
+#pragma endregion Host
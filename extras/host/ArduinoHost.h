@@ -0,0 +1,65 @@
+/*
+  ArduinoHost.h - Test side of the simulated Arduino core. See Arduino.h.
+  Part of the LightningStepper library by Calvin Bultz.
+  Released into the public domain.
+  -Time only moves when the library asks for it (each micros() call takes setMicrosPerCall microseconds, 1 by default), when delay() or delayMicroseconds() wait, or when the test calls advance().
+    That makes every run deterministic.
+  -Output pins log every change with the time it happened. Inputs float high unless the test drives them, and driving an input low fires an attached FALLING interrupt.
+*/
+#ifndef ArduinoHost_h
+#define ArduinoHost_h
+#include "Arduino.h"
+
+namespace ArduinoHost
+{
+    //Pins 0 to maxPins - 1 exist
+    const uint8_t maxPins = 64;
+
+    struct Edge
+    {
+        unsigned long time;
+        uint8_t pin;
+        uint8_t value;
+    };
+
+    //Back to power up: time 0, every pin an input, no interrupts attached, empty serial ports, empty edge log
+    void reset();
+
+    //--Time
+    unsigned long now();
+    void advance(unsigned long us);
+    //How long a call to micros() takes. 0 freezes time except for advance(), delay() and delayMicroseconds().
+    void setMicrosPerCall(unsigned int us);
+
+    //--Pins
+    //Drive an input pin. A falling edge runs the interrupt attached to it, right away or once interrupts are turned back on.
+    void setInput(uint8_t pin, uint8_t level);
+    //Let an input float again. INPUT_PULLUP pins read HIGH.
+    void releaseInput(uint8_t pin);
+    //Level the library last wrote to a pin
+    uint8_t outputLevel(uint8_t pin);
+    uint8_t mode(uint8_t pin);
+    bool interruptsEnabled();
+
+    //--Edge log. Holds the most recent edgeCapacity changes of output pins.
+    const size_t edgeCapacity = 65536;
+    size_t edgeCount();
+    //0 is the oldest edge still held
+    const Edge& edge(size_t index);
+    void clearEdges();
+    //Edges that fell off the front of the log since the last clearEdges()
+    unsigned long droppedEdges();
+
+    //--EEPROM. Its contents survive reset() like they survive a power cycle.
+    const size_t eepromSize = 1024;
+    //Time a byte write takes
+    const unsigned long eepromWriteMicros = 3300;
+    //The contents, to look at or to corrupt
+    uint8_t* eeprom();
+    //Back to blank (every byte 0xFF) and no writes counted
+    void eraseEeprom();
+    //Bytes written at an address since eraseEeprom(). An update that does not change the byte is not a write.
+    unsigned long eepromWrites(size_t address);
+}
+
+#endif
@@ -0,0 +1,19 @@
+/*
+  eeprom.h - Simulated avr-libc EEPROM functions for building the LightningStepper library on a PC.
+  Part of the LightningStepper library by Calvin Bultz.
+  Released into the public domain.
+  -1KB like an ATmega328P. Tests reach the contents and the write counts through ArduinoHost.h.
+  -A byte write takes 3.3ms of virtual time. eeprom_is_ready() is false until it is done, and a write started before then waits for it like avr-libc does.
+*/
+#ifndef eeprom_h
+#define eeprom_h
+#include <stdint.h>
+#include <stddef.h>
+
+uint8_t eeprom_read_byte(const uint8_t* address);
+void eeprom_read_block(void* destination, const void* source, size_t count);
+void eeprom_update_byte(uint8_t* address, uint8_t value);
+void eeprom_update_block(const void* source, void* destination, size_t count);
+int eeprom_is_ready();
+
+#endif
@@ -0,0 +1,143 @@
+/*
+  LightningStepperTest.h - Helpers shared by the host tests of the LightningStepper library.
+  Part of the LightningStepper library by Calvin Bultz.
+  Released into the public domain.
+  -Each test is its own program since the library keeps its axes and serial port in statics. It returns non-zero when a check fails.
+  -Results meant for tracking are printed one per line as name=value so scripts can pick them out.
+*/
+#ifndef LightningStepperTest_h
+#define LightningStepperTest_h
+#include <stdio.h>
+#include <vector>
+#include "ArduinoHost.h"
+#include "LightningStepper.h"
+
+static int testFailures = 0;
+
+#define CHECK(condition) \
+    do \
+    { \
+        if (!(condition)) \
+        { \
+            printf("FAIL %s:%d: %s\n", __FILE__, __LINE__, #condition); \
+            testFailures++; \
+        } \
+    } while (0)
+
+//Print and return the result of the test from main()
+static int testResult(const char* name)
+{
+    printf("%s %s\n", testFailures == 0 ? "PASS" : "FAIL", name);
+    return testFailures == 0 ? 0 : 1;
+}
+
+//Reaches into the private parts of the library for the tests that measure them directly
+class LightningStepperTest
+{
+    public:
+        //Speed [0-100] to delay through calculateDelay with the given delay range
+        static void setDelayRange(LightningStepper& stepper, int minDelay, int maxDelay)
+        {
+            stepper.minDelayInt = minDelay;
+            stepper.maxDelayInt = maxDelay;
+            stepper.updateDelayRange();
+        }
+        static int calculateDelay(LightningStepper& stepper, int speed)
+        {
+            stepper.calculateDelay(speed);
+            return stepper.currentDelayInt;
+        }
+        //Load the newest clean saved record into the axes like the setup does at power up
+        static bool restoreSettings()
+        {
+            return LightningStepper::restoreSettings();
+        }
+        //True once one of the axis's S-curve tables is worked out for the speed
+        static bool sCurvePlanned(LightningStepper& stepper, int speed)
+        {
+            int cruise = stepper.delayForSpeed(speed);
+            return stepper.sCurvePlanned(0, cruise) || stepper.sCurvePlanned(1, cruise);
+        }
+};
+
+//Pins the tests wire the stepper controller to. pin_CmdReady is on pin 2 so it gets the external interrupt.
+const uint8_t testIN1 = 4;
+const uint8_t testIN2 = 5;
+const uint8_t testIN3 = 6;
+const uint8_t testIN4 = 7;
+const uint8_t testCmdReady = 2;
+const uint8_t testDone = 11;
+const uint8_t testProcessing = 10;
+
+//Go through the setup with option 2 and the given minDelay,maxDelay,currentPosition,maxPosition. Serial must be the port.
+static void testSetup(LightningStepper& stepper, const char* settings)
+{
+    //The setup waits for pin_CmdReady to go low first
+    ArduinoHost::setInput(testCmdReady, LOW);
+    Serial.feed("Message(2)\n");
+    Serial.feed("Message(");
+    Serial.feed(settings);
+    Serial.feed(")\nMessage(Go)\n");
+    stepper.runSetup();
+    ArduinoHost::setInput(testCmdReady, HIGH);
+    Serial.clearOutput();
+}
+
+//Run until pin_Done is high, or give up after maxMicros. Returns true if it went high.
+static bool testRunUntilDone(LightningStepper& stepper, unsigned long maxMicros = 60000000UL)
+{
+    unsigned long start = ArduinoHost::now();
+    while (ArduinoHost::outputLevel(testDone) == LOW)
+    {
+        if (ArduinoHost::now() - start > maxMicros)
+        {
+            return false;
+        }
+        stepper.run();
+    }
+    return true;
+}
+
+//Send a command with the pin_CmdReady handshake the command controller example uses: pull it low, wait for pin_Processing, send, wait for pin_Processing to drop.
+static bool testCommand(LightningStepper& stepper, const char* command)
+{
+    ArduinoHost::setInput(testCmdReady, LOW);
+    for (int i = 0; i < 1000 && ArduinoHost::outputLevel(testProcessing) == LOW; i++)
+    {
+        stepper.run();
+    }
+    ArduinoHost::setInput(testCmdReady, HIGH);
+    if (ArduinoHost::outputLevel(testProcessing) == LOW)
+    {
+        return false;
+    }
+    Serial.feed("Message(");
+    Serial.feed(command);
+    Serial.feed(")\n");
+    for (int i = 0; i < 100000 && ArduinoHost::outputLevel(testProcessing) == HIGH; i++)
+    {
+        stepper.run();
+    }
+    return ArduinoHost::outputLevel(testProcessing) == LOW;
+}
+
+//Times of the steps in the edge log. One step writes all four coil pins at the same instant so the edges at one time count once.
+static std::vector<unsigned long> testStepTimes(uint8_t in1 = testIN1, uint8_t in2 = testIN2, uint8_t in3 = testIN3, uint8_t in4 = testIN4)
+{
+    std::vector<unsigned long> times;
+    for (size_t i = 0; i < ArduinoHost::edgeCount(); i++)
+    {
+        const ArduinoHost::Edge& edge = ArduinoHost::edge(i);
+        if (edge.pin != in1 && edge.pin != in2 && edge.pin != in3 && edge.pin != in4)
+        {
+            continue;
+        }
+        if (times.empty() == true || times.back() != edge.time)
+        {
+            times.push_back(edge.time);
+        }
+    }
+    return times;
+}
+
+#endif
@@ -0,0 +1,25 @@
+/*
+  bus_node.cpp - One stepper controller on the simulated bus of test_bus.cpp.
+  Part of the LightningStepper library by Calvin Bultz.
+  Released into the public domain.
+  -Built into a shared library along with the LightningStepper sources. test_bus loads a copy per node so each node gets its own library statics.
+    The simulated Arduino core is not in here. Every node shares the one in the test program, so they all see the same clock and pins.
+*/
+
+#include "LightningStepper.h"
+
+static LightningStepper* node = 0;
+
+//Set up node nodeId on port with its coils on firstPin to firstPin + 3. The settings messages must already be waiting on the port.
+extern "C" void busNodeSetup(uint8_t nodeId, Stream* port, uint8_t firstPin, int pin_DriverEnable)
+{
+    static LightningStepper stepper(firstPin, firstPin + 1, firstPin + 2, firstPin + 3, -1, -1, -1, *port);
+    stepper.setBusNode(nodeId, pin_DriverEnable);
+    stepper.runSetup();
+    node = &stepper;
+}
+
+extern "C" void busNodeRun()
+{
+    node->run();
+}
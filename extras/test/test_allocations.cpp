@@ -0,0 +1,97 @@
+/*
+  test_allocations.cpp - Counts heap allocations while the stepper controller takes commands, replies, and moves. There must be none.
+  Part of the LightningStepper library by Calvin Bultz.
+  Released into the public domain.
+  -malloc is replaced for the whole program so new and anything in the C++ library that allocates is counted too (glibc only).
+*/
+
+#include <string.h>
+#include "LightningStepperTest.h"
+
+extern "C" void* __libc_malloc(size_t size);
+extern "C" void* __libc_calloc(size_t count, size_t size);
+extern "C" void* __libc_realloc(void* pointer, size_t size);
+extern "C" void __libc_free(void* pointer);
+
+//Only counted while armed so the test's own vectors and printf do not count
+static bool counting = false;
+static unsigned long allocations = 0;
+static unsigned long allocatedBytes = 0;
+
+static void countAllocation(size_t size)
+{
+    if (counting == true)
+    {
+        allocations++;
+        allocatedBytes += size;
+    }
+}
+
+extern "C" void* malloc(size_t size)
+{
+    countAllocation(size);
+    return __libc_malloc(size);
+}
+
+extern "C" void* calloc(size_t count, size_t size)
+{
+    countAllocation(count * size);
+    return __libc_calloc(count, size);
+}
+
+extern "C" void* realloc(void* pointer, size_t size)
+{
+    countAllocation(size);
+    return __libc_realloc(pointer, size);
+}
+
+extern "C" void free(void* pointer)
+{
+    __libc_free(pointer);
+}
+
+int main()
+{
+    ArduinoHost::reset();
+    LightningStepper stepper(testIN1, testIN2, testIN3, testIN4, testCmdReady, testDone, testProcessing);
+
+    //Make sure the counter sees the library's allocations at all
+    counting = true;
+    void* probe = malloc(8);
+    counting = false;
+    free(probe);
+    CHECK(allocations == 1);
+    allocations = 0;
+    allocatedBytes = 0;
+
+    counting = true;
+    testSetup(stepper, "1000,10000,0,4000");
+
+    //Every reply path plus moves, queued moves, and a binary frame
+    const char* commands[] = { "1", "2,100,200,1", "13", "4,50,100,2", "4,50,100,1", "5", "10,80,1000", "12,0", "12,1", "12,7", "14,0,0", "9,60,40", "99", "22,1", "2,100,300,2", "22,0", "3" };
+    for (size_t i = 0; i < sizeof(commands) / sizeof(commands[0]); i++)
+    {
+        CHECK(testCommand(stepper, commands[i]));
+        CHECK(testRunUntilDone(stepper));
+    }
+    uint8_t status[] = { LightningStepperProtocol::sync, 0x00, LightningStepperProtocol::opStatus, 0x00, 0x00 };
+    status[4] = LightningStepperProtocol::crc8(LightningStepperProtocol::crc8(LightningStepperProtocol::crc8(0, status[1]), status[2]), status[3]);
+    Serial.feed(status, sizeof(status));
+    for (int i = 0; i < 100; i++)
+    {
+        stepper.run();
+    }
+    counting = false;
+
+    //The commands did run
+    CHECK(strstr(Serial.output(), "Strike(Status: ") != 0);
+    CHECK(strstr(Serial.output(), "Strike(Queue: ") != 0);
+    CHECK(strstr(Serial.output(), "Strike(SC Error: bad step mode)") != 0);
+
+    CHECK(allocations == 0);
+    printf("allocations=%lu\n", allocations);
+    printf("allocated_bytes=%lu\n", allocatedBytes);
+    printf("sizeof_lightningstepper=%lu\n", (unsigned long)sizeof(LightningStepper));
+
+    return testResult("allocations");
+}
@@ -0,0 +1,110 @@
+/*
+  test_bench.cpp - Runs moves on the library built with LIGHTNINGSTEPPER_BENCHMARK and prints the Cmd 6 reports.
+  Part of the LightningStepper library by Calvin Bultz.
+  Released into the public domain.
+  -Each report is printed one key per line as run_key=value, ex: half_step_jitter_p99_us=1, so the numbers can be tracked from version to version.
+  -Times are in virtual microseconds of the simulated core where each micros() call takes 1. Run the sketch with the benchmark on the board for real numbers.
+*/
+
+#include <stdlib.h>
+#include <string.h>
+#include "LightningStepperTest.h"
+
+static char report[512];
+
+//Ask for the report, keep a copy, and print it as run_key=value lines
+static bool takeReport(LightningStepper& stepper, const char* run)
+{
+    Serial.clearOutput();
+    if (testCommand(stepper, "6") == false)
+    {
+        return false;
+    }
+    const char* start = strstr(Serial.output(), "Strike(Bench: ");
+    if (start == 0)
+    {
+        return false;
+    }
+    start += strlen("Strike(Bench: ");
+    const char* end = strchr(start, ')');
+    size_t length = (end == 0) ? strlen(start) : (size_t)(end - start);
+    length = (length < sizeof(report) - 1) ? length : sizeof(report) - 1;
+    memcpy(report, start, length);
+    report[length] = '\0';
+    printf("%s_", run);
+    for (const char* c = report; *c != '\0'; c++)
+    {
+        if (*c == ',')
+        {
+            printf("\n%s_", run);
+        }
+        else
+        {
+            putchar(*c);
+        }
+    }
+    putchar('\n');
+    return true;
+}
+
+//Value of a key in the last report
+static unsigned long reportValue(const char* key)
+{
+    size_t keyLength = strlen(key);
+    for (const char* c = report; c != 0 && *c != '\0'; c = strchr(c, ','))
+    {
+        if (*c == ',')
+        {
+            c++;
+        }
+        if (strncmp(c, key, keyLength) == 0 && c[keyLength] == '=')
+        {
+            return strtoul(c + keyLength + 1, 0, 10);
+        }
+    }
+    printf("FAIL no %s in the report\n", key);
+    testFailures++;
+    return 0;
+}
+
+//Clear the capture, run a move to the end, and report it
+static bool benchMove(LightningStepper& stepper, const char* move, const char* run)
+{
+    return testCommand(stepper, "7") && testCommand(stepper, move) && testRunUntilDone(stepper) && takeReport(stepper, run);
+}
+
+int main()
+{
+    ArduinoHost::reset();
+    LightningStepper stepper(testIN1, testIN2, testIN3, testIN4, testCmdReady, testDone, testProcessing);
+    testSetup(stepper, "1000,10000,0,40000");
+
+    //The 8 step (half step) and 4 step (full step) sequences at a 1000us cruise
+    CHECK(benchMove(stepper, "2,100,1000,1", "half_step"));
+    //Every step plus the call that finds the move finished
+    CHECK(reportValue("steps") == 1001);
+    CHECK(reportValue("interval_min_us") >= 999);
+    CHECK(reportValue("jitter_max_us") <= 10);
+    //The cruise reached the commanded 1000 steps per second
+    CHECK(reportValue("max_steps_per_s") >= 990 && reportValue("max_steps_per_s") <= 1010);
+    CHECK(reportValue("latency_last_us") > 0);
+
+    CHECK(testCommand(stepper, "12,0"));
+    CHECK(benchMove(stepper, "2,100,400,2", "full_step"));
+    CHECK(reportValue("steps") == 401);
+    CHECK(reportValue("max_steps_per_s") >= 990 && reportValue("max_steps_per_s") <= 1010);
+    CHECK(testCommand(stepper, "12,1"));
+
+    //Push minDelay down to see how fast the loop keeps up
+    CHECK(testCommand(stepper, "8,100,2000,0,40000"));
+    CHECK(benchMove(stepper, "2,100,4000,1", "fast"));
+    CHECK(reportValue("max_steps_per_s") >= 9000);
+
+    //Slow steps longer than the fine grained clock can time on an AVR (32.8ms) are still measured right
+    CHECK(testCommand(stepper, "8,1000,40000,4000,40000"));
+    CHECK(benchMove(stepper, "2,0,5,1", "slow"));
+    CHECK(reportValue("interval_max_us") >= 39990 && reportValue("interval_max_us") <= 40010);
+    CHECK(reportValue("max_steps_per_s") == 0);
+
+    return testResult("bench");
+}
@@ -0,0 +1,275 @@
+/*
+  test_bus.cpp - Several stepper controllers on one half duplex bus. Measures how many commands per second the bus carries as nodes are added.
+  Part of the LightningStepper library by Calvin Bultz.
+  Released into the public domain.
+  -Each node is its own copy of bus_node's shared library so the library statics are not shared. They all run on the simulated core of this program.
+  -The bus moves one byte every 10us like a 1000000 baud link. A byte goes to everyone but its sender. Two senders in the same byte time is a collision.
+  -Every node runs once per byte time. flush() returns right away and the bus clocks the bytes out after it.
+  -Results are printed as name=value per node count.
+*/
+
+#include <dlfcn.h>
+#include <string.h>
+#include <deque>
+#include "LightningStepperTest.h"
+
+const unsigned long byteMicros = 10;
+const uint8_t maxNodes = 8;
+
+//One transceiver on the bus
+class BusPort : public Stream
+{
+    public:
+        std::deque<uint8_t> rx;
+        std::deque<uint8_t> tx;
+        int available() { return (int)rx.size(); }
+        int read()
+        {
+            if (rx.empty() == true)
+            {
+                return -1;
+            }
+            uint8_t data = rx.front();
+            rx.pop_front();
+            return data;
+        }
+        int peek() { return rx.empty() ? -1 : rx.front(); }
+        size_t write(uint8_t c)
+        {
+            tx.push_back(c);
+            return 1;
+        }
+        void send(const char* text)
+        {
+            Print::write(text);
+        }
+};
+
+typedef void (*NodeSetup)(uint8_t nodeId, Stream* port, uint8_t firstPin, int pin_DriverEnable);
+typedef void (*NodeRun)();
+
+static BusPort controller;
+static BusPort ports[maxNodes];
+static NodeRun nodeRuns[maxNodes];
+static unsigned long collisions = 0;
+
+//Load a private copy of the node library. dlopen hands back the library already loaded for a path it has seen, so each node needs its own file.
+static bool loadNode(uint8_t index)
+{
+    char path[512];
+    snprintf(path, sizeof(path), "%s.node%u", LIGHTNINGSTEPPER_BUS_NODE, index);
+    FILE* from = fopen(LIGHTNINGSTEPPER_BUS_NODE, "rb");
+    FILE* to = fopen(path, "wb");
+    if (from == 0 || to == 0)
+    {
+        return false;
+    }
+    char buffer[4096];
+    size_t count;
+    while ((count = fread(buffer, 1, sizeof(buffer), from)) > 0)
+    {
+        fwrite(buffer, 1, count, to);
+    }
+    fclose(from);
+    fclose(to);
+    void* library = dlopen(path, RTLD_NOW | RTLD_LOCAL);
+    if (library == 0)
+    {
+        printf("%s\n", dlerror());
+        return false;
+    }
+    NodeSetup setup = (NodeSetup)dlsym(library, "busNodeSetup");
+    nodeRuns[index] = (NodeRun)dlsym(library, "busNodeRun");
+    if (setup == 0 || nodeRuns[index] == 0)
+    {
+        return false;
+    }
+    //Node ids start at 1. Coils on pins 4 + 4 * index up, driver enables on 40 up.
+    ports[index].send("Message(2)\nMessage(1000,10000,0,4000)\nMessage(Go)\n");
+    ports[index].rx.assign(ports[index].tx.begin(), ports[index].tx.end());
+    ports[index].tx.clear();
+    setup(index + 1, &ports[index], 4 + 4 * index, 40 + index);
+    ports[index].tx.clear();
+    return true;
+}
+
+//One byte time: move a byte across the bus and let every node run
+static void busTick()
+{
+    BusPort* sender = 0;
+    int senders = 0;
+    if (controller.tx.empty() == false)
+    {
+        sender = &controller;
+        senders++;
+    }
+    for (uint8_t i = 0; i < maxNodes; i++)
+    {
+        if (ports[i].tx.empty() == false)
+        {
+            sender = &ports[i];
+            senders++;
+        }
+    }
+    if (senders > 1)
+    {
+        //Garbled. Every sender loses the byte.
+        collisions++;
+        controller.tx.empty() ? (void)0 : controller.tx.pop_front();
+        for (uint8_t i = 0; i < maxNodes; i++)
+        {
+            ports[i].tx.empty() ? (void)0 : ports[i].tx.pop_front();
+        }
+    }
+    else if (senders == 1)
+    {
+        uint8_t data = sender->tx.front();
+        sender->tx.pop_front();
+        if (sender != &controller)
+        {
+            controller.rx.push_back(data);
+        }
+        for (uint8_t i = 0; i < maxNodes; i++)
+        {
+            if (sender != &ports[i])
+            {
+                ports[i].rx.push_back(data);
+            }
+        }
+    }
+    for (uint8_t i = 0; i < maxNodes; i++)
+    {
+        nodeRuns[i]();
+    }
+    ArduinoHost::advance(byteMicros);
+}
+
+//Wait for a reply the way the command controller would. Text replies end with a newline and binary ones are whole frames.
+static bool awaitReply(bool binary, unsigned long timeoutMicros)
+{
+    LightningStepperFrameDecoder decoder;
+    unsigned long start = ArduinoHost::now();
+    while (ArduinoHost::now() - start < timeoutMicros)
+    {
+        busTick();
+        while (controller.available() > 0)
+        {
+            uint8_t data = (uint8_t)controller.read();
+            if (binary == false && data == '\n')
+            {
+                return true;
+            }
+            if (binary == true && decoder.feed(data) == LightningStepperFrameDecoder::Complete)
+            {
+                return true;
+            }
+        }
+    }
+    return false;
+}
+
+//Ask the first nodeCount nodes for their status in turn for a second of bus time. Returns the replies per second.
+static unsigned long measureThroughput(uint8_t nodeCount, bool binary, unsigned long& timeouts)
+{
+    unsigned long replies = 0;
+    unsigned long start = ArduinoHost::now();
+    uint8_t next = 0;
+    while (ArduinoHost::now() - start < 1000000UL)
+    {
+        if (binary == true)
+        {
+            LightningStepperProtocol::writeFrame(controller, (uint8_t)((next + 1) << 4), LightningStepperProtocol::opStatus, 0, 0);
+        }
+        else
+        {
+            char command[24];
+            snprintf(command, sizeof(command), "Message(%u/13)\n", next + 1);
+            controller.send(command);
+        }
+        if (awaitReply(binary, 20000) == true)
+        {
+            replies++;
+        }
+        else
+        {
+            timeouts++;
+        }
+        next = (next + 1) % nodeCount;
+    }
+    return (replies * 1000000UL) / (ArduinoHost::now() - start);
+}
+
+int main()
+{
+    ArduinoHost::reset();
+    //Time only moves a byte time at a time so the nodes run side by side
+    ArduinoHost::setMicrosPerCall(0);
+    for (uint8_t i = 0; i < maxNodes; i++)
+    {
+        if (loadNode(i) == false)
+        {
+            printf("FAIL could not load node %u\n", i + 1);
+            return 1;
+        }
+    }
+
+    //Every node answers only to its own address so nothing collides. The bus is the limit so adding nodes keeps the total about the same.
+    const uint8_t nodeCounts[] = { 1, 2, 4, 8 };
+    unsigned long textFirst = 0;
+    unsigned long binaryFirst = 0;
+    for (size_t i = 0; i < sizeof(nodeCounts); i++)
+    {
+        unsigned long timeouts = 0;
+        unsigned long text = measureThroughput(nodeCounts[i], false, timeouts);
+        unsigned long binary = measureThroughput(nodeCounts[i], true, timeouts);
+        textFirst = (i == 0) ? text : textFirst;
+        binaryFirst = (i == 0) ? binary : binaryFirst;
+        CHECK(timeouts == 0);
+        CHECK(text * 10 >= textFirst * 9);
+        CHECK(binary * 10 >= binaryFirst * 9);
+        CHECK(binary > text);
+        printf("bus_text_cmds_per_s_nodes_%u=%lu\n", nodeCounts[i], text);
+        printf("bus_binary_cmds_per_s_nodes_%u=%lu\n", nodeCounts[i], binary);
+    }
+    CHECK(collisions == 0);
+    printf("bus_collisions=%lu\n", collisions);
+
+    //Broadcast sync start. Node 15 holds every node, each gets a queued move, and one broadcast starts them all.
+    controller.send("Message(15/17)\n");
+    for (uint8_t i = 0; i < maxNodes; i++)
+    {
+        char command[32];
+        snprintf(command, sizeof(command), "Message(%u/4,100,50,1)\n", i + 1);
+        controller.send(command);
+    }
+    for (int i = 0; i < 2000; i++)
+    {
+        busTick();
+    }
+    ArduinoHost::clearEdges();
+    controller.send("Message(15/18)\n");
+    for (int i = 0; i < 20000; i++)
+    {
+        busTick();
+    }
+    unsigned long firstStep = 0xFFFFFFFFUL;
+    unsigned long lastStep = 0;
+    for (uint8_t i = 0; i < maxNodes; i++)
+    {
+        uint8_t pin = 4 + 4 * i;
+        std::vector<unsigned long> steps = testStepTimes(pin, pin + 1, pin + 2, pin + 3);
+        CHECK(steps.size() == 50);
+        if (steps.empty() == false)
+        {
+            firstStep = (steps[0] < firstStep) ? steps[0] : firstStep;
+            lastStep = (steps[0] > lastStep) ? steps[0] : lastStep;
+        }
+    }
+    //All in the same byte time
+    CHECK(lastStep - firstStep <= byteMicros);
+    CHECK(controller.rx.empty() == true);
+    CHECK(collisions == 0);
+    printf("bus_sync_start_spread_us=%lu\n", lastStep - firstStep);
+
+    return testResult("bus");
+}
@@ -0,0 +1,144 @@
+/*
+  test_multi_axis.cpp - Two axes on one stepper controller sharing the step timer.
+  Part of the LightningStepper library by Calvin Bultz.
+  Released into the public domain.
+  -Starting and stopping one axis must not move the steps of an axis that is already cruising.
+*/
+
+#include <string.h>
+#include "LightningStepperTest.h"
+
+const uint8_t testAxisIN1 = 8;
+const uint8_t testAxisIN2 = 9;
+const uint8_t testAxisIN3 = 12;
+const uint8_t testAxisIN4 = 13;
+
+static void runFor(LightningStepper& stepper, unsigned long us)
+{
+    unsigned long start = ArduinoHost::now();
+    while (ArduinoHost::now() - start < us)
+    {
+        stepper.run();
+    }
+}
+
+//Give run() long enough to read and answer a command. Sequenced commands need no handshake.
+static void runCalls(LightningStepper& stepper)
+{
+    for (int i = 0; i < 1000; i++)
+    {
+        stepper.run();
+    }
+}
+
+//Send a sequenced binary frame with no payload and return the opcode of the ACK or NAK it gets. reason is the NAK reason.
+static uint8_t sendSequencedFrame(LightningStepper& stepper, uint8_t sequence, uint8_t address, uint8_t opcode, uint8_t& reason)
+{
+    uint8_t frame[6] = { 0xA6, sequence, address, opcode, 0, 0 };
+    uint8_t crc = 0;
+    for (uint8_t i = 1; i < 5; i++)
+    {
+        crc = LightningStepperProtocol::crc8(crc, frame[i]);
+    }
+    frame[5] = crc;
+    Serial.clearOutput();
+    Serial.feed(frame, sizeof(frame));
+    runCalls(stepper);
+    LightningStepperFrameDecoder decoder;
+    for (size_t i = 0; i < Serial.outputLength(); i++)
+    {
+        if (decoder.feed((uint8_t)Serial.output()[i]) == LightningStepperFrameDecoder::Complete
+            && (decoder.opcode == LightningStepperProtocol::opAck || decoder.opcode == LightningStepperProtocol::opNak) && decoder.payload[0] == sequence)
+        {
+            reason = (decoder.opcode == LightningStepperProtocol::opNak) ? decoder.payload[1] : 0;
+            return decoder.opcode;
+        }
+    }
+    return 0;
+}
+
+int main()
+{
+    ArduinoHost::reset();
+    LightningStepper stepper(testIN1, testIN2, testIN3, testIN4, testCmdReady, testDone, testProcessing);
+    LightningStepper axis(testAxisIN1, testAxisIN2, testAxisIN3, testAxisIN4);
+    CHECK(stepper.attachAxis(axis));
+    testSetup(stepper, "1000,10000,0,40000");
+    CHECK(testCommand(stepper, "8,1000,10000,0,40000"));
+    CHECK(testCommand(stepper, "1:8,1000,10000,0,40000"));
+
+    //Axis 1 gets up to its 1000us cruise, then axis 0 starts and stops a few times under it
+    ArduinoHost::clearEdges();
+    CHECK(testCommand(stepper, "1:2,100,3000,1"));
+    runFor(stepper, 400000);
+    CHECK(testCommand(stepper, "2,100,40,1"));
+    runFor(stepper, 300000);
+    CHECK(testCommand(stepper, "2,60,200,2"));
+    runFor(stepper, 200000);
+    //Stopped part way through
+    CHECK(testCommand(stepper, "3"));
+    CHECK(testRunUntilDone(stepper));
+
+    std::vector<unsigned long> axisSteps = testStepTimes(testAxisIN1, testAxisIN2, testAxisIN3, testAxisIN4);
+    std::vector<unsigned long> stepperSteps = testStepTimes();
+    CHECK(axisSteps.size() == 3000);
+    CHECK(stepperSteps.size() > 40 && stepperSteps.size() < 240);
+
+    //Past the ramp up the cruise of axis 1 keeps exactly to its 1000us whatever axis 0 does
+    unsigned long worst = 0;
+    for (size_t i = 200; i + 200 < axisSteps.size(); i++)
+    {
+        unsigned long interval = axisSteps[i] - axisSteps[i - 1];
+        unsigned long shift = (interval > 1000) ? interval - 1000 : 1000 - interval;
+        worst = (shift > worst) ? shift : worst;
+    }
+    CHECK(worst == 0);
+    printf("multi_axis_cruise_worst_shift_us=%lu\n", worst);
+
+    //The axis 0 moves did run while axis 1 was cruising
+    CHECK(stepperSteps.size() > 0 && stepperSteps[0] > axisSteps[200] && stepperSteps.back() < axisSteps[axisSteps.size() - 200]);
+
+    //A move started while a slow axis is stepping takes its first step right away, not when the slow axis steps next, and the slow axis keeps its timing
+    ArduinoHost::clearEdges();
+    CHECK(testCommand(stepper, "1:2,1,20,2"));
+    runFor(stepper, 30000);
+    size_t edges = ArduinoHost::edgeCount();
+    while (ArduinoHost::edgeCount() == edges)
+    {
+        stepper.run();
+    }
+    unsigned long sent = ArduinoHost::now();
+    CHECK(testCommand(stepper, "2,100,10,1"));
+    unsigned long answered = ArduinoHost::now();
+    CHECK(testRunUntilDone(stepper));
+    stepperSteps = testStepTimes();
+    axisSteps = testStepTimes(testAxisIN1, testAxisIN2, testAxisIN3, testAxisIN4);
+    CHECK(stepperSteps.size() == 10 && stepperSteps[0] > sent && stepperSteps[0] <= answered + 100);
+    CHECK(axisSteps.size() == 20);
+    //Up to the ramp down at the end
+    for (size_t i = 2; i + 1 < axisSteps.size(); i++)
+    {
+        CHECK(axisSteps[i] - axisSteps[i - 1] == axisSteps[1] - axisSteps[0]);
+    }
+
+    //A sequenced command for an axis that does not exist is NAKed and its sequence number goes to the next command
+    Serial.clearOutput();
+    Serial.feed("Message(10#16)\n");
+    runCalls(stepper);
+    CHECK(strstr(Serial.output(), "Strike(ACK 10)") != 0);
+    Serial.clearOutput();
+    Serial.feed("Message(11#5:13)\n");
+    runCalls(stepper);
+    CHECK(strstr(Serial.output(), "Strike(NAK 11,4)") != 0);
+    CHECK(strstr(Serial.output(), "Status") == 0);
+    Serial.clearOutput();
+    Serial.feed("Message(11#1:13)\n");
+    runCalls(stepper);
+    CHECK(strstr(Serial.output(), "Strike(ACK 11)") != 0);
+    uint8_t reason = 0;
+    CHECK(sendSequencedFrame(stepper, 12, 0x05, LightningStepperProtocol::opStatus, reason) == LightningStepperProtocol::opNak);
+    CHECK(reason == LightningStepperProtocol::nakNoAxis);
+    CHECK(sendSequencedFrame(stepper, 12, 0x01, LightningStepperProtocol::opStatus, reason) == LightningStepperProtocol::opAck);
+
+    return testResult("multi_axis");
+}
@@ -0,0 +1,101 @@
+/*
+  test_script.cpp - Writes and runs motion scripts through Cmd 19 and Cmd 20.
+  Part of the LightningStepper library by Calvin Bultz.
+  Released into the public domain.
+*/
+
+#include <string.h>
+#include "LightningStepperTest.h"
+
+//Run for a while. The clock is moved along too since run() reads no time while a script only waits on a pin.
+static void runFor(LightningStepper& stepper, unsigned long us)
+{
+    unsigned long start = ArduinoHost::now();
+    while (ArduinoHost::now() - start < us)
+    {
+        stepper.run();
+        ArduinoHost::advance(1);
+    }
+}
+
+int main()
+{
+    ArduinoHost::reset();
+    LightningStepper stepper(testIN1, testIN2, testIN3, testIN4, testCmdReady, testDone, testProcessing);
+    testSetup(stepper, "1000,10000,0,4000");
+
+    //A wait pin on a coil pin is refused and the script dropped
+    CHECK(testCommand(stepper, "19,0,7,4,0"));
+    CHECK(strstr(Serial.output(), "Strike(SC Error: script pin in use)") != 0);
+    Serial.clearOutput();
+    CHECK(testCommand(stepper, "20"));
+    CHECK(ArduinoHost::mode(testIN1) == OUTPUT);
+    CHECK(ArduinoHost::outputLevel(testDone) == HIGH);
+
+    //Also when the instruction is split across writes. pin_Processing is the pin here.
+    Serial.clearOutput();
+    CHECK(testCommand(stepper, "19,0,3,7"));
+    CHECK(strstr(Serial.output(), "SC Error") == 0);
+    CHECK(testCommand(stepper, "19,2,10,1"));
+    CHECK(strstr(Serial.output(), "Strike(SC Error: script pin in use)") != 0);
+    CHECK(testCommand(stepper, "20"));
+    CHECK(ArduinoHost::mode(testProcessing) == OUTPUT);
+
+    //Move 200 steps, wait for it, then wait for pin 20 to go low
+    Serial.clearOutput();
+    ArduinoHost::clearEdges();
+    CHECK(testCommand(stepper, "19,0,1,0,100,200,0,1,3,7,20,0,0"));
+    CHECK(strstr(Serial.output(), "SC Error") == 0);
+    CHECK(testCommand(stepper, "20"));
+    runFor(stepper, 2000000UL);
+    CHECK(ArduinoHost::outputLevel(testDone) == LOW);
+    CHECK(testStepTimes().size() == 200);
+    CHECK(ArduinoHost::mode(20) == INPUT_PULLUP);
+    ArduinoHost::setInput(20, LOW);
+    CHECK(testRunUntilDone(stepper));
+
+    //A full script ending in a one byte instruction in its last byte
+    CHECK(testCommand(stepper, "19,0,3,3,3,3,3,3,3,3,3,3,3,3,3,3,3,3"));
+    CHECK(testCommand(stepper, "19,16,3,3,3,3,3,3,3,3,3,3,3,3,3,3,3,3"));
+    CHECK(testCommand(stepper, "19,32,3,3,3,3,3,3,3,3,3,3,3,3,3,3,3,3"));
+    CHECK(testCommand(stepper, "19,48,3,3,3,3,3,3,3,3,3,3,3,3,3,3,3,0"));
+    Serial.clearOutput();
+    CHECK(testCommand(stepper, "20"));
+    CHECK(testRunUntilDone(stepper));
+    CHECK(strstr(Serial.output(), "SC Error") == 0);
+
+    //Saving goes out a byte per run() so run() and the serial port keep going. A full script is about a quarter second of writes.
+    //Writing the script waits until it is done.
+    ArduinoHost::eraseEeprom();
+    CHECK(testCommand(stepper, "2,100,400,1"));
+    unsigned long before = ArduinoHost::now();
+    CHECK(testCommand(stepper, "21"));
+    CHECK(ArduinoHost::now() - before < 20000UL);
+    CHECK(LightningStepperScript::saving() == true);
+    Serial.clearOutput();
+    before = ArduinoHost::now();
+    CHECK(testCommand(stepper, "13"));
+    CHECK(ArduinoHost::now() - before < 20000UL);
+    CHECK(strstr(Serial.output(), "Strike(Status:") != 0);
+    Serial.clearOutput();
+    CHECK(testCommand(stepper, "19,0,0"));
+    CHECK(strstr(Serial.output(), "Strike(SC Error: script saving)") != 0);
+    CHECK(LightningStepperScript::length == 64);
+    CHECK(testRunUntilDone(stepper));
+    runFor(stepper, 500000UL);
+    CHECK(LightningStepperScript::saving() == false);
+    CHECK(ArduinoHost::eeprom()[LIGHTNINGSTEPPER_SCRIPT_ADDRESS] == 64);
+    Serial.clearOutput();
+    CHECK(testCommand(stepper, "19,0,0"));
+    CHECK(strstr(Serial.output(), "SC Error") == 0);
+    CHECK(LightningStepperScript::load() == true);
+    CHECK(LightningStepperScript::length == 64 && LightningStepperScript::code[0] == 3 && LightningStepperScript::code[63] == 0);
+
+    //Saving the same script again writes nothing
+    unsigned long writes = ArduinoHost::eepromWrites(LIGHTNINGSTEPPER_SCRIPT_ADDRESS);
+    CHECK(testCommand(stepper, "21"));
+    CHECK(LightningStepperScript::saving() == false);
+    CHECK(ArduinoHost::eepromWrites(LIGHTNINGSTEPPER_SCRIPT_ADDRESS) == writes);
+
+    return testResult("script");
+}
@@ -0,0 +1,135 @@
+/*
+  test_scurve.cpp - Compares the step intervals of S-curve moves with the commanded velocity curve.
+  Part of the LightningStepper library by Calvin Bultz.
+  Released into the public domain.
+  -The commanded curve is the smoothstep blend of the maxDelay and cruise speeds worked out in doubles. The library plays it from an integer table.
+  -Accelerations are in steps/s^2 between neighboring intervals. Results are printed as name=value.
+*/
+
+#include <math.h>
+#include "LightningStepperTest.h"
+
+//minDelay,maxDelay of the moves. An 8:1 speed ratio gets a 63 step ramp.
+const int minDelay = 1000;
+const int maxDelay = 8000;
+const int rampLength = 63;
+
+//Step intervals of the last move
+static std::vector<unsigned long> intervals()
+{
+    std::vector<unsigned long> steps = testStepTimes();
+    std::vector<unsigned long> result;
+    for (size_t i = 1; i < steps.size(); i++)
+    {
+        result.push_back(steps[i] - steps[i - 1]);
+    }
+    return result;
+}
+
+//Interval the velocity curve commands after step entry of the ramp
+static double commandedDelay(int entry)
+{
+    double x = (double)entry / (rampLength + 1);
+    double s = 3 * x * x - 2 * x * x * x;
+    double speed = 1.0 / maxDelay + (1.0 / minDelay - 1.0 / maxDelay) * s;
+    return 1.0 / speed;
+}
+
+//Largest change of speed between neighboring intervals, and the one at the start of the move
+static double peakAcceleration(const std::vector<unsigned long>& delays, double& first)
+{
+    double peak = 0;
+    for (size_t i = 1; i < delays.size(); i++)
+    {
+        double change = 1e6 / delays[i] - 1e6 / delays[i - 1];
+        double acceleration = fabs(change) / ((delays[i] + delays[i - 1]) / 2e6);
+        first = (i == 1) ? acceleration : first;
+        peak = (acceleration > peak) ? acceleration : peak;
+    }
+    return peak;
+}
+
+static void runMove(LightningStepper& stepper, const char* move)
+{
+    ArduinoHost::clearEdges();
+    CHECK(testCommand(stepper, move));
+    CHECK(testRunUntilDone(stepper));
+}
+
+int main()
+{
+    ArduinoHost::reset();
+    LightningStepper stepper(testIN1, testIN2, testIN3, testIN4, testCmdReady, testDone, testProcessing);
+    testSetup(stepper, "1000,8000,0,40000");
+
+    //The trapezoid for comparison
+    runMove(stepper, "2,100,400,1");
+    std::vector<unsigned long> trapezoid = intervals();
+    double trapezoidFirst = 0;
+    double trapezoidPeak = peakAcceleration(trapezoid, trapezoidFirst);
+
+    CHECK(testCommand(stepper, "22,1"));
+    CHECK(LightningStepperTest::sCurvePlanned(stepper, 100) == false);
+    runMove(stepper, "2,100,400,1");
+    //The whole table was worked out when the command came in
+    CHECK(LightningStepperTest::sCurvePlanned(stepper, 100));
+    std::vector<unsigned long> sCurve = intervals();
+    CHECK(sCurve.size() == 399);
+
+    //Ramp up follows the commanded curve, then the cruise
+    double worst = 0;
+    for (int entry = 1; entry <= rampLength; entry++)
+    {
+        double error = fabs(sCurve[entry - 1] - commandedDelay(entry)) / commandedDelay(entry);
+        worst = (error > worst) ? error : worst;
+    }
+    CHECK(worst < 0.005);
+    for (size_t i = rampLength; i + rampLength < sCurve.size(); i++)
+    {
+        CHECK(sCurve[i] == (unsigned long)minDelay);
+    }
+    //Ramp down is the exact mirror
+    bool symmetric = true;
+    for (size_t i = 0; i < sCurve.size(); i++)
+    {
+        symmetric = symmetric && (sCurve[i] == sCurve[sCurve.size() - 1 - i]);
+    }
+    CHECK(symmetric);
+
+    //About the trapezoid's peak acceleration, but it builds up from nothing instead of starting at full
+    double sCurveFirst = 0;
+    double sCurvePeak = peakAcceleration(sCurve, sCurveFirst);
+    CHECK(sCurvePeak <= trapezoidPeak);
+    CHECK(sCurveFirst < sCurvePeak / 4);
+    CHECK(trapezoidFirst > trapezoidPeak / 2);
+    printf("scurve_worst_error_percent=%.3f\n", worst * 100);
+    printf("scurve_peak_acceleration=%.0f\n", sCurvePeak);
+    printf("scurve_first_acceleration=%.0f\n", sCurveFirst);
+    printf("trapezoid_peak_acceleration=%.0f\n", trapezoidPeak);
+    printf("trapezoid_first_acceleration=%.0f\n", trapezoidFirst);
+
+    //A faster move queued behind a running one gets its table before the step timer chains it, and carries on at speed
+    ArduinoHost::clearEdges();
+    CHECK(testCommand(stepper, "2,50,600,1"));
+    CHECK(LightningStepperTest::sCurvePlanned(stepper, 80) == false);
+    CHECK(testCommand(stepper, "4,80,600,1"));
+    CHECK(LightningStepperTest::sCurvePlanned(stepper, 80));
+    CHECK(testRunUntilDone(stepper));
+    std::vector<unsigned long> chained = intervals();
+    CHECK(chained.size() == 1199);
+    //Picks the speed 80 ramp up where the speed 50 cruise is on it and no harder than a move from a stop
+    unsigned long cruise50 = (unsigned long)LightningStepperTest::calculateDelay(stepper, 50);
+    unsigned long cruise80 = (unsigned long)LightningStepperTest::calculateDelay(stepper, 80);
+    CHECK(chained[598] == cruise50 && chained[599] == cruise50);
+    CHECK(chained[600] < cruise50);
+    std::vector<unsigned long> speedUp(chained.begin() + 600, chained.begin() + 700);
+    double speedUpFirst = 0;
+    CHECK(peakAcceleration(speedUp, speedUpFirst) <= sCurvePeak);
+    for (size_t i = 601; i < 700; i++)
+    {
+        CHECK(chained[i] <= chained[i - 1] && chained[i] >= cruise80);
+    }
+    CHECK(chained[700] == cruise80);
+
+    return testResult("scurve");
+}
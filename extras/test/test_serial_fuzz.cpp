@@ -0,0 +1,159 @@
+/*
+  test_serial_fuzz.cpp - Feeds fragmented and random serial input while the motor moves and checks the steps keep their timing.
+  Part of the LightningStepper library by Calvin Bultz.
+  Released into the public domain.
+  -The same move is run quiet and then with input arriving a few bytes at a time. Every step of the noisy runs must land within one step period of the quiet run.
+  -Virtual time only moves when the library reads the clock, so anything in the parse path that waits on it (ex: the old readStringUntil timeout) shows up as shifted steps.
+*/
+
+#include <string.h>
+#include "LightningStepperTest.h"
+
+static unsigned long seed = 12345;
+
+//Small LCG so every run feeds the same bytes
+static unsigned long nextRandom(unsigned long range)
+{
+    seed = seed * 1103515245UL + 12345UL;
+    return ((seed >> 16) & 0x7FFF) % range;
+}
+
+//Step times relative to the first step
+static std::vector<unsigned long> relativeStepTimes()
+{
+    std::vector<unsigned long> times = testStepTimes();
+    for (size_t i = 1; i < times.size(); i++)
+    {
+        times[i] -= times[0];
+    }
+    if (times.empty() == false)
+    {
+        times[0] = 0;
+    }
+    return times;
+}
+
+//Longest distance of a step from where the quiet run put it
+static unsigned long worstShift(const std::vector<unsigned long>& quiet, const std::vector<unsigned long>& noisy)
+{
+    unsigned long worst = 0;
+    for (size_t i = 0; i < quiet.size() && i < noisy.size(); i++)
+    {
+        unsigned long shift = (noisy[i] > quiet[i]) ? noisy[i] - quiet[i] : quiet[i] - noisy[i];
+        worst = (shift > worst) ? shift : worst;
+    }
+    return worst;
+}
+
+//Count the times text shows up in what was sent
+static int countReplies(const char* text)
+{
+    int count = 0;
+    for (const char* found = strstr(Serial.output(), text); found != 0; found = strstr(found + 1, text))
+    {
+        count++;
+    }
+    return count;
+}
+
+//Run the move to the end. Between run() calls pending bytes go out a random 1 to 7 at a time every 1 to 40 calls.
+static void runFeeding(LightningStepper& stepper, const std::vector<uint8_t>& input)
+{
+    size_t sent = 0;
+    unsigned long wait = 0;
+    unsigned long start = ArduinoHost::now();
+    while (ArduinoHost::outputLevel(testDone) == LOW && ArduinoHost::now() - start < 60000000UL)
+    {
+        if (wait == 0 && sent < input.size())
+        {
+            size_t chunk = 1 + nextRandom(7);
+            chunk = (chunk > input.size() - sent) ? input.size() - sent : chunk;
+            Serial.feed(&input[sent], chunk);
+            sent += chunk;
+            wait = 1 + nextRandom(40);
+        }
+        wait = (wait > 0) ? wait - 1 : 0;
+        stepper.run();
+    }
+}
+
+static void appendText(std::vector<uint8_t>& input, const char* text)
+{
+    input.insert(input.end(), text, text + strlen(text));
+}
+
+int main()
+{
+    ArduinoHost::reset();
+    LightningStepper stepper(testIN1, testIN2, testIN3, testIN4, testCmdReady, testDone, testProcessing);
+    testSetup(stepper, "1000,10000,0,4000");
+    const unsigned long period = 1000;
+    const int moveSteps = 3000;
+
+    //Quiet run for reference
+    ArduinoHost::clearEdges();
+    CHECK(testCommand(stepper, "2,100,3000,1"));
+    CHECK(testRunUntilDone(stepper));
+    std::vector<unsigned long> quiet = relativeStepTimes();
+    CHECK(quiet.size() == (size_t)moveSteps);
+
+    //Status requests split at random points between junk lines. Junk has no ( so it is never a Message() block, and some lines are too long for the line buffer.
+    std::vector<uint8_t> input;
+    int statusSent = 0;
+    for (int line = 0; line < 200; line++)
+    {
+        if (nextRandom(3) == 0)
+        {
+            appendText(input, "Message(13)\r\n");
+            statusSent++;
+        }
+        else
+        {
+            size_t length = 1 + nextRandom(80);
+            for (size_t i = 0; i < length; i++)
+            {
+                uint8_t c = (uint8_t)(' ' + nextRandom(95));
+                input.push_back((c == '(') ? '[' : c);
+            }
+            input.push_back('\n');
+        }
+    }
+    ArduinoHost::clearEdges();
+    CHECK(testCommand(stepper, "2,100,3000,2"));
+    Serial.clearOutput();
+    runFeeding(stepper, input);
+    std::vector<unsigned long> text = relativeStepTimes();
+    CHECK(text.size() == (size_t)moveSteps);
+    CHECK(worstShift(quiet, text) < period);
+    //Every status request was put back together from its pieces and answered
+    CHECK(countReplies("Strike(Status: ") == statusSent);
+    printf("serial_fuzz_text_bytes=%lu\n", (unsigned long)input.size());
+    printf("serial_fuzz_text_worst_shift_us=%lu\n", worstShift(quiet, text));
+
+    //Any byte at all, binary sync bytes included
+    input.clear();
+    for (int i = 0; i < 3000; i++)
+    {
+        input.push_back((uint8_t)nextRandom(256));
+    }
+    ArduinoHost::clearEdges();
+    CHECK(testCommand(stepper, "2,100,3000,1"));
+    runFeeding(stepper, input);
+    std::vector<unsigned long> binary = relativeStepTimes();
+    CHECK(binary.size() == (size_t)moveSteps);
+    CHECK(worstShift(quiet, binary) < period);
+    printf("serial_fuzz_binary_bytes=%lu\n", (unsigned long)input.size());
+    printf("serial_fuzz_binary_worst_shift_us=%lu\n", worstShift(quiet, binary));
+
+    //Still takes commands once whatever frame or line the junk left open is ended. A binary frame is at most 21 bytes.
+    Serial.feed("\n\n\n\n\n\n\n\n\n\n\n\n\n\n\n\n\n\n\n\n\n\n\n\n");
+    for (int i = 0; i < 10; i++)
+    {
+        stepper.run();
+    }
+    Serial.clearOutput();
+    CHECK(testCommand(stepper, "1"));
+    CHECK(strstr(Serial.output(), "Strike(Settings: 3000,4000,1000,10000)") != 0);
+
+    return testResult("serial_fuzz");
+}
@@ -0,0 +1,131 @@
+/*
+  test_setup_and_move.cpp - Drives runSetup() and run() end to end on the simulated Arduino core.
+  Part of the LightningStepper library by Calvin Bultz.
+  Released into the public domain.
+*/
+
+#include <string.h>
+#include "LightningStepperTest.h"
+
+int main()
+{
+    ArduinoHost::reset();
+    LightningStepper stepper(testIN1, testIN2, testIN3, testIN4, testCmdReady, testDone, testProcessing);
+    testSetup(stepper, "1000,10000,0,4000");
+    CHECK(Serial.baud() == 9600);
+    CHECK(ArduinoHost::outputLevel(testDone) == HIGH);
+    CHECK(ArduinoHost::outputLevel(testProcessing) == LOW);
+
+    //A move steps the requested amount and raises pin_Done at the end
+    ArduinoHost::clearEdges();
+    CHECK(testCommand(stepper, "2,100,200,1"));
+    CHECK(ArduinoHost::outputLevel(testDone) == LOW);
+    CHECK(testRunUntilDone(stepper));
+    std::vector<unsigned long> steps = testStepTimes();
+    CHECK(steps.size() == 200);
+    //Ramped: the first interval is the slowest and the middle runs at minDelay
+    CHECK(steps.size() > 100 && steps[1] - steps[0] > steps[101] - steps[100]);
+    CHECK(steps.size() > 100 && steps[101] - steps[100] >= 1000 && steps[101] - steps[100] <= 1010);
+
+    //Cmd 1 reports where it ended up
+    Serial.clearOutput();
+    CHECK(testCommand(stepper, "1"));
+    CHECK(strstr(Serial.output(), "Strike(Settings: 200,4000,1000,10000)") != 0);
+
+    //Moves are clamped to the limits
+    ArduinoHost::clearEdges();
+    CHECK(testCommand(stepper, "2,100,500,2"));
+    CHECK(testRunUntilDone(stepper));
+    CHECK(testStepTimes().size() == 200);
+
+    //A queued move takes its first step one cruise interval after the last step of the move before it
+    ArduinoHost::clearEdges();
+    CHECK(testCommand(stepper, "2,100,300,1"));
+    CHECK(testCommand(stepper, "4,100,300,1"));
+    CHECK(testRunUntilDone(stepper));
+    steps = testStepTimes();
+    CHECK(steps.size() == 600);
+    for (size_t i = 200; i < 400 && i < steps.size(); i++)
+    {
+        CHECK(steps[i] - steps[i - 1] == 1000);
+    }
+    CHECK(testCommand(stepper, "2,100,600,2"));
+    CHECK(testRunUntilDone(stepper));
+
+    //A short move sent at speed in the same direction slows down over the steps it has instead of stopping at speed
+    ArduinoHost::clearEdges();
+    CHECK(testCommand(stepper, "2,100,1000,1"));
+    unsigned long cruising = ArduinoHost::now() + 400000UL;
+    while ((long)(ArduinoHost::now() - cruising) < 0)
+    {
+        stepper.run();
+    }
+    steps = testStepTimes();
+    size_t before = steps.size();
+    CHECK(before > 100 && before < 1000 && steps[before - 1] - steps[before - 2] <= 1010);
+    CHECK(testCommand(stepper, "2,100,5,1"));
+    CHECK(testRunUntilDone(stepper));
+    steps = testStepTimes();
+    CHECK(steps.size() > before && steps.size() <= before + 6);
+    //The step pending when it came in keeps its time
+    CHECK(steps.size() > before && steps[before] - steps[before - 1] >= 1000);
+    CHECK(steps.size() > before && steps[steps.size() - 1] - steps[steps.size() - 2] > 1500);
+    CHECK(testCommand(stepper, "2,100,2000,2"));
+    CHECK(testRunUntilDone(stepper));
+
+    //A bad value is reported and the stepper controller keeps going
+    Serial.clearOutput();
+    CHECK(testCommand(stepper, "12,7"));
+    CHECK(strstr(Serial.output(), "Strike(SC Error: bad step mode)") != 0);
+    //The S-curve is not built into this library
+    CHECK(testCommand(stepper, "22,1"));
+    CHECK(strstr(Serial.output(), "Strike(SC Error: bad profile)") != 0);
+    CHECK(testCommand(stepper, "1"));
+    CHECK(strstr(Serial.output(), "Strike(Settings: 0,4000,1000,10000)") != 0);
+
+    //Step mode round trips keep the half step maxPosition that halving rounds off
+    CHECK(testCommand(stepper, "8,1000,10000,0,4024"));
+    CHECK(testCommand(stepper, "12,0"));
+    CHECK(testCommand(stepper, "1"));
+    CHECK(strstr(Serial.output(), "Strike(Settings: 0,2011,1000,10000)") != 0);
+    CHECK(testCommand(stepper, "12,2"));
+    CHECK(testCommand(stepper, "12,1"));
+    Serial.clearOutput();
+    CHECK(testCommand(stepper, "1"));
+    CHECK(strstr(Serial.output(), "Strike(Settings: 0,4024,1000,10000)") != 0);
+    //A maxPosition set in full step is converted. The motor stopped a half step off the full step phases the first time so halfOffset is 1.
+    CHECK(testCommand(stepper, "12,0"));
+    CHECK(testCommand(stepper, "8,1000,10000,0,1000"));
+    CHECK(testCommand(stepper, "12,1"));
+    Serial.clearOutput();
+    CHECK(testCommand(stepper, "1"));
+    CHECK(strstr(Serial.output(), "Strike(Settings: 1,2001,1000,10000)") != 0);
+
+    //With halt on pin_CmdReady the running move and everything queued behind it stop on the falling edge, before the command is read
+    CHECK(testCommand(stepper, "2,100,300,1"));
+    CHECK(testCommand(stepper, "4,100,300,1"));
+    CHECK(testCommand(stepper, "4,100,300,2"));
+    stepper.setHaltOnCmdReady(true);
+    unsigned long halt = ArduinoHost::now() + 200000UL;
+    while ((long)(ArduinoHost::now() - halt) < 0)
+    {
+        stepper.run();
+    }
+    ArduinoHost::clearEdges();
+    Serial.clearOutput();
+    CHECK(testCommand(stepper, "13"));
+    CHECK(ArduinoHost::outputLevel(testDone) == HIGH);
+    //Nothing is stepping so run() reads no time. Move the clock along.
+    halt = ArduinoHost::now() + 1000000UL;
+    while ((long)(ArduinoHost::now() - halt) < 0)
+    {
+        stepper.run();
+        ArduinoHost::advance(10);
+    }
+    CHECK(testStepTimes().size() == 0);
+    //Stopped with nothing left in the queue
+    CHECK(strstr(Serial.output(), ",0,0,0)") != 0);
+    stepper.setHaltOnCmdReady(false);
+
+    return testResult("setup_and_move");
+}
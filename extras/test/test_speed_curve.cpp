@@ -0,0 +1,69 @@
+/*
+  test_speed_curve.cpp - Checks the integer speed curve lookup against the float math it replaced and times both.
+  Part of the LightningStepper library by Calvin Bultz.
+  Released into the public domain.
+  -The times are host nanoseconds per call. On an AVR without an FPU the float path costs far more than it does here.
+*/
+
+#include <math.h>
+#include <chrono>
+#include "LightningStepperTest.h"
+
+//calculateDelay before the lookup table
+static int floatDelay(int minDelay, int maxDelay, int speed)
+{
+    float m = ((float)minDelay - (float)maxDelay) / ((float)100 - (float)0);
+    float y = (m * (float)speed) + (float)maxDelay;
+    return (int)round(y);
+}
+
+int main()
+{
+    ArduinoHost::reset();
+    LightningStepper stepper(testIN1, testIN2, testIN3, testIN4, testCmdReady, testDone, testProcessing);
+
+    //Every speed of a spread of delay ranges lands within a microsecond of the float math
+    const int ranges[][2] = { { 1000, 10000 }, { 800, 32000 }, { 1, 2 }, { 1500, 1500 }, { 999, 65000 }, { 2, 30001 } };
+    int worst = 0;
+    for (size_t r = 0; r < sizeof(ranges) / sizeof(ranges[0]); r++)
+    {
+        LightningStepperTest::setDelayRange(stepper, ranges[r][0], ranges[r][1]);
+        for (int speed = 0; speed <= 100; speed++)
+        {
+            int error = abs(LightningStepperTest::calculateDelay(stepper, speed) - floatDelay(ranges[r][0], ranges[r][1], speed));
+            worst = (error > worst) ? error : worst;
+        }
+        //The ends are exact
+        CHECK(LightningStepperTest::calculateDelay(stepper, 0) == ranges[r][1]);
+        CHECK(LightningStepperTest::calculateDelay(stepper, 100) == ranges[r][0]);
+        //Out of range speeds are held to the ends
+        CHECK(LightningStepperTest::calculateDelay(stepper, -5) == ranges[r][1]);
+        CHECK(LightningStepperTest::calculateDelay(stepper, 250) == ranges[r][0]);
+    }
+    CHECK(worst <= 1);
+    printf("speed_curve_max_error_us=%d\n", worst);
+
+    //Time both paths over the same speeds
+    const long rounds = 200000;
+    LightningStepperTest::setDelayRange(stepper, 1000, 10000);
+    volatile int minDelay = 1000;
+    volatile int maxDelay = 10000;
+    volatile long sink = 0;
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    for (long i = 0; i < rounds; i++)
+    {
+        sink += floatDelay(minDelay, maxDelay, (int)(i % 101));
+    }
+    double floatNs = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count() / rounds;
+    start = std::chrono::steady_clock::now();
+    for (long i = 0; i < rounds; i++)
+    {
+        sink += LightningStepperTest::calculateDelay(stepper, (int)(i % 101));
+    }
+    double tableNs = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count() / rounds;
+    printf("speed_curve_float_ns=%.2f\n", floatNs);
+    printf("speed_curve_table_ns=%.2f\n", tableNs);
+    (void)sink;
+
+    return testResult("speed_curve");
+}
@@ -0,0 +1,188 @@
+/*
+  test_storage.cpp - Saves the settings and position to the simulated EEPROM, corrupts records, and restores them.
+  Part of the LightningStepper library by Calvin Bultz.
+  Released into the public domain.
+  -The library keeps its axes in statics, so the power cycle runs this program again with the EEPROM contents in a file.
+*/
+
+#include <string.h>
+#include <string>
+#include "LightningStepperTest.h"
+#include "LightningStepperStorage.h"
+
+//Bytes a record takes: sequence, count, the axes, crc, and the clean marker
+const size_t recordSize = 4 + LIGHTNINGSTEPPER_STORAGE_AXES * sizeof(LightningStepperAxisSettings);
+
+static size_t slotAddress(uint8_t slot)
+{
+    return LIGHTNINGSTEPPER_STORAGE_ADDRESS + slot * recordSize;
+}
+
+//Run for a while. The clock is moved along too since run() reads no time while it sits idle. 50us is well under the shortest step delay.
+static void runFor(LightningStepper& stepper, unsigned long us)
+{
+    unsigned long start = ArduinoHost::now();
+    while (ArduinoHost::now() - start < us)
+    {
+        stepper.run();
+        ArduinoHost::advance(50);
+    }
+}
+
+//Sit past the save delay and long enough for the record to be written out
+const unsigned long saveTime = LIGHTNINGSTEPPER_STORAGE_DELAY * 1000UL + 2000000UL;
+
+//Move, then wait for the record to be saved
+static void moveAndSave(LightningStepper& stepper, const char* move)
+{
+    CHECK(testCommand(stepper, move));
+    CHECK(testRunUntilDone(stepper));
+    runFor(stepper, saveTime);
+}
+
+//The newest good record, checked for one axis at position
+static void checkSaved(int position, bool clean)
+{
+    LightningStepperAxisSettings settings[LIGHTNINGSTEPPER_STORAGE_AXES];
+    uint8_t count = 0;
+    bool wasClean = !clean;
+    CHECK(LightningStepperStorage::load(settings, count, wasClean));
+    CHECK(count == 1);
+    CHECK(wasClean == clean);
+    CHECK(settings[0].currentPosition == position);
+    CHECK(settings[0].maxPosition == 4000);
+    CHECK(settings[0].minDelay == 1000 && settings[0].maxDelay == 10000);
+}
+
+//Coil pattern on the pins, bit 0 is IN1
+static uint8_t coilPattern()
+{
+    return ArduinoHost::outputLevel(testIN1) | (ArduinoHost::outputLevel(testIN2) << 1) | (ArduinoHost::outputLevel(testIN3) << 2) | (ArduinoHost::outputLevel(testIN4) << 3);
+}
+
+//Place of a pattern in the half step coil sequence
+static int coilPhase(uint8_t pattern)
+{
+    const uint8_t sequence[8] = { 0x01, 0x03, 0x02, 0x06, 0x04, 0x0C, 0x08, 0x09 };
+    for (int i = 0; i < 8; i++)
+    {
+        if (sequence[i] == pattern)
+        {
+            return i;
+        }
+    }
+    return -1;
+}
+
+//Power up on the EEPROM contents in image. The setup is skipped for the saved settings and the coils hold the phase they stopped on.
+static int powerUp(const char* image, uint8_t stoppedPattern)
+{
+    FILE* file = fopen(image, "rb");
+    CHECK(file != 0 && fread(ArduinoHost::eeprom(), 1, ArduinoHost::eepromSize, file) == ArduinoHost::eepromSize);
+    if (file != 0)
+    {
+        fclose(file);
+    }
+    ArduinoHost::reset();
+    LightningStepper stepper(testIN1, testIN2, testIN3, testIN4, testCmdReady, testDone, testProcessing);
+    stepper.setPersistence(true);
+    //The setup would wait on pin_CmdReady forever
+    LightningStepperAxisSettings settings[LIGHTNINGSTEPPER_STORAGE_AXES];
+    uint8_t count = 0;
+    bool clean = false;
+    CHECK(LightningStepperStorage::load(settings, count, clean) && clean == true);
+    if (testFailures > 0)
+    {
+        return testResult("storage_power_up");
+    }
+    stepper.runSetup();
+    CHECK(strstr(Serial.output(), "Strike(Settings restored. currentPosition: 1400 maxPosition: 4000)") != 0);
+    CHECK(ArduinoHost::outputLevel(testDone) == HIGH);
+    CHECK(coilPattern() == stoppedPattern);
+    Serial.clearOutput();
+    CHECK(testCommand(stepper, "1"));
+    CHECK(strstr(Serial.output(), "Strike(Settings: 1400,4000,1000,10000)") != 0);
+    //The first step is one half step on from there
+    CHECK(testCommand(stepper, "2,100,1,1"));
+    CHECK(testRunUntilDone(stepper));
+    int before = coilPhase(stoppedPattern);
+    int after = coilPhase(coilPattern());
+    CHECK(before >= 0 && after >= 0 && (after == ((before + 1) & 7) || after == ((before + 7) & 7)));
+    return testResult("storage_power_up");
+}
+
+int main(int argc, char** argv)
+{
+    if (argc == 4 && strcmp(argv[1], "power_up") == 0)
+    {
+        return powerUp(argv[2], (uint8_t)atoi(argv[3]));
+    }
+    ArduinoHost::eraseEeprom();
+    ArduinoHost::reset();
+    LightningStepper stepper(testIN1, testIN2, testIN3, testIN4, testCmdReady, testDone, testProcessing);
+    stepper.setPersistence(true);
+    //Blank EEPROM so the setup runs
+    testSetup(stepper, "1000,10000,0,4000");
+
+    //Nothing is written until the motor has sat stopped for the save delay, so stop and go moves do not wear the EEPROM
+    CHECK(testCommand(stepper, "2,100,200,1"));
+    CHECK(testRunUntilDone(stepper));
+    runFor(stepper, LIGHTNINGSTEPPER_STORAGE_DELAY * 500UL);
+    CHECK(testCommand(stepper, "2,100,100,2"));
+    CHECK(testRunUntilDone(stepper));
+    runFor(stepper, LIGHTNINGSTEPPER_STORAGE_DELAY * 500UL);
+    CHECK(ArduinoHost::eepromWrites(slotAddress(0)) == 0);
+    runFor(stepper, saveTime);
+    checkSaved(100, true);
+
+    //Each save goes to the next slot
+    moveAndSave(stepper, "2,100,200,1");
+    CHECK(ArduinoHost::eeprom()[slotAddress(1) + recordSize - 1] == 0x5A);
+    checkSaved(300, true);
+    moveAndSave(stepper, "2,100,100,1");
+    CHECK(ArduinoHost::eeprom()[slotAddress(2) + recordSize - 1] == 0x5A);
+    checkSaved(400, true);
+    CHECK(ArduinoHost::eepromWrites(slotAddress(3)) == 0);
+
+    //A record that fails its CRC is skipped. The one before it went stale when the move after it started, so nothing is trusted.
+    ArduinoHost::eeprom()[slotAddress(2) + 6] ^= 0x10;
+    checkSaved(300, false);
+    CHECK(LightningStepperTest::restoreSettings() == false);
+    moveAndSave(stepper, "2,100,2000,1");
+    checkSaved(2400, true);
+
+    //A move marks the newest record stale until the next save, so a power loss mid move is not trusted
+    CHECK(testCommand(stepper, "2,100,1000,2"));
+    runFor(stepper, 100000UL);
+    checkSaved(2400, false);
+    CHECK(LightningStepperTest::restoreSettings() == false);
+    CHECK(testRunUntilDone(stepper));
+    runFor(stepper, saveTime);
+    checkSaved(1400, true);
+    CHECK(LightningStepperTest::restoreSettings());
+
+    //Power up on what was saved
+    std::string image = std::string(argv[0]) + ".eeprom";
+    FILE* file = fopen(image.c_str(), "wb");
+    CHECK(file != 0 && fwrite(ArduinoHost::eeprom(), 1, ArduinoHost::eepromSize, file) == ArduinoHost::eepromSize);
+    if (file != 0)
+    {
+        fclose(file);
+    }
+    std::string command = "\"" + std::string(argv[0]) + "\" power_up \"" + image + "\" " + std::to_string(coilPattern());
+    CHECK(system(command.c_str()) == 0);
+    remove(image.c_str());
+
+    //Every slot bad
+    for (uint8_t slot = 0; slot < LIGHTNINGSTEPPER_STORAGE_SLOTS; slot++)
+    {
+        ArduinoHost::eeprom()[slotAddress(slot) + 2] ^= 0xFF;
+    }
+    LightningStepperAxisSettings settings[LIGHTNINGSTEPPER_STORAGE_AXES];
+    uint8_t count = 0;
+    bool clean = false;
+    CHECK(LightningStepperStorage::load(settings, count, clean) == false);
+    CHECK(LightningStepperTest::restoreSettings() == false);
+
+    return testResult("storage");
+}
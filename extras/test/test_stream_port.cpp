@@ -0,0 +1,33 @@
+/*
+  test_stream_port.cpp - The Stream constructor leaves the port the sketch passed in alone, even when it is Serial.
+  Part of the LightningStepper library by Calvin Bultz.
+  Released into the public domain.
+*/
+
+#include <string.h>
+#include "LightningStepperTest.h"
+
+int main()
+{
+    ArduinoHost::reset();
+    //The sketch starts Serial at its own rate and hands it over as a Stream
+    Serial.begin(115200);
+    unsigned int begins = Serial.beginCount();
+    LightningStepper stepper(testIN1, testIN2, testIN3, testIN4, testCmdReady, testDone, testProcessing, (Stream&)Serial);
+    testSetup(stepper, "1000,10000,0,4000");
+    CHECK(Serial.baud() == 115200);
+    CHECK(Serial.beginCount() == begins);
+
+    //Cmd 15 cannot change the rate of a port the library did not start
+    CHECK(testCommand(stepper, "15,57600"));
+    CHECK(strstr(Serial.output(), "Strike(SC Error: baud rate not changed)") != 0);
+    CHECK(Serial.baud() == 115200);
+    CHECK(Serial.beginCount() == begins);
+
+    //The port still works
+    Serial.clearOutput();
+    CHECK(testCommand(stepper, "1"));
+    CHECK(strstr(Serial.output(), "Strike(Settings: 0,4000,1000,10000)") != 0);
+
+    return testResult("stream_port");
+}
@@ -2,12 +2,40 @@
   LightningStepper.h - Library for controlling a unipolar stepper motor using the ULN2003 Driver Board.
   Created by Calvin Bultz, September 1, 2022.
   Released into the public domain.
-  -Warning!!: Physical limit switches should be used when controlling motors. For simplicity of code and the fact that my motor is setup with a safe full range of motion, the physical limit switches are not included.
+  -Warning!!: Physical limit switches should be used when controlling motors. Attach them with setLimitSwitches() to end moves at the switches and to home the motor.
     Please read the disclamer on the README file in the repository.
 */
 
 #include "Arduino.h"
 #include "LightningStepper.h"
+#if defined(__AVR__)
+#include <avr/sleep.h>
+#endif
+
+//A saved record must have room for every axis that can be attached
+static_assert(LIGHTNINGSTEPPER_STORAGE_AXES >= LIGHTNINGSTEPPER_MAX_AXES, "LIGHTNINGSTEPPER_STORAGE_AXES is smaller than LIGHTNINGSTEPPER_MAX_AXES");
+
+//Linear speed curve. Entry n is the fraction of the way from maxDelay to minDelay for speed n, scaled to 65535.
+static const uint16_t linearSpeedCurve[101] PROGMEM = {
+    0, 655, 1311, 1966, 2621, 3277, 3932, 4587, 5243, 5898,
+    6554, 7209, 7864, 8520, 9175, 9830, 10486, 11141, 11796, 12452,
+    13107, 13762, 14418, 15073, 15728, 16384, 17039, 17694, 18350, 19005,
+    19660, 20316, 20971, 21627, 22282, 22937, 23593, 24248, 24903, 25559,
+    26214, 26869, 27525, 28180, 28835, 29491, 30146, 30801, 31457, 32112,
+    32768, 33423, 34078, 34734, 35389, 36044, 36700, 37355, 38010, 38666,
+    39321, 39976, 40632, 41287, 41942, 42598, 43253, 43908, 44564, 45219,
+    45874, 46530, 47185, 47841, 48496, 49151, 49807, 50462, 51117, 51773,
+    52428, 53083, 53739, 54394, 55049, 55705, 56360, 57015, 57671, 58326,
+    58982, 59637, 60292, 60948, 61603, 62258, 62914, 63569, 64224, 64880,
+    65535
+};
+
+//Used for string comparison/parsing
+static const char msgIDEchunk[] = "Message(";
+
+//Half step coil sequence: A, AB, B, BC, C, CD, D, DA. Bit 0 is IN1 through bit 3 is IN4 to match LightningStepperCoils.
+//Stepping CCW moves forward through the table and CW moves backward.
+static constexpr uint8_t coilSequence[8] = { 0x01, 0x03, 0x02, 0x06, 0x04, 0x0C, 0x08, 0x09 };
 
 LightningStepper::LightningStepper(int pin_IN1, int pin_IN2, int pin_IN3, int pin_IN4, int pin_CmdReady, int pin_Done, int pin_Processing)
 {
@@ -18,1134 +46,3215 @@ LightningStepper::LightningStepper(int pin_IN1, int pin_IN2, int pin_IN3, int pi
 	this->pin_CmdReady = pin_CmdReady;
 	this->pin_Done = pin_Done;
     this->pin_Processing = pin_Processing;
+    speedCurve = linearSpeedCurve;
+#if defined(LIGHTNINGSTEPPER_BENCHMARK)
+    bench.reset();
+#endif
 }
 
-#pragma region Utilities
+LightningStepper::LightningStepper(int pin_IN1, int pin_IN2, int pin_IN3, int pin_IN4, int pin_CmdReady, int pin_Done, int pin_Processing, HardwareSerial& port, unsigned long baud)
+    : LightningStepper(pin_IN1, pin_IN2, pin_IN3, pin_IN4, pin_CmdReady, pin_Done, pin_Processing)
+{
+    LightningStepper::port = &port;
+    hardwarePort = &port;
+    defaultPort = false;
+    baudRate = baud;
+}
 
-void LightningStepper::waitForMessage(String p_msg)
+LightningStepper::LightningStepper(int pin_IN1, int pin_IN2, int pin_IN3, int pin_IN4, int pin_CmdReady, int pin_Done, int pin_Processing, Stream& port)
+    : LightningStepper(pin_IN1, pin_IN2, pin_IN3, pin_IN4, pin_CmdReady, pin_Done, pin_Processing)
 {
-    //Reset keepWaiting
-    keepWaiting = true;
-    //Reset msg 
-    msg = "";
-    while (keepWaiting == true) {
-        //Keep adding chunks of a message until the whole thing arrives.
-        msg = msg + Serial.readString();
-        msgLength = msg.length();
-        //remove any leading and trailing whitespace
-        msg.trim();
-        if (msgLength > 2) {
-            //Look for the block() start
-            indexOfP = msg.indexOf('(');
-            if (indexOfP > 0) {
-                //look for the block end
-                indexOfP = msg.indexOf(')');
-                if (indexOfP > 0) {
-                    //Entire block arrived
-                    //remove the block
-                    msg = LightningStepper::cleanMsg(msg);
-                    //Compare
-                    if (msg.startsWith(p_msg)) {
-                        //Match
-                        keepWaiting = false;
-                    }
-                    else {
-                        //Error. Send to IDE for debug. May need to turn off the Stepper Controller and turn back on.
-                        LightningStepper::sendMessage("SC Error: " + msg);                        
-                        //Reset the msg
-                        msg = "";
-                    }
-                }
-            }
-        }
-    }
+    LightningStepper::port = &port;
+    hardwarePort = 0;
+    //Even if it is Serial the sketch started it at the rate it wanted
+    defaultPort = false;
 }
 
-void LightningStepper::sendMessage(String p_msg)
+LightningStepper::LightningStepper(int pin_IN1, int pin_IN2, int pin_IN3, int pin_IN4)
 {
-    //Cannot compile if Serial1 or Serial2 etc don't exist on the board. Must use the default Serial. The modulation of the stepper takes up a lot of the boards abillity to process other things anyway.
-    //That being said you can easily use comments to enable and disable what Serial port the library uses.
+    stepper_pin1 = pin_IN1;
+    stepper_pin2 = pin_IN2;
+    stepper_pin3 = pin_IN3;
+    stepper_pin4 = pin_IN4;
+    //The handshake pins belong to the motor this one is attached to
+    pin_CmdReady = -1;
+    pin_Done = -1;
+    pin_Processing = -1;
+    speedCurve = linearSpeedCurve;
+#if defined(LIGHTNINGSTEPPER_BENCHMARK)
+    bench.reset();
+#endif
+}
 
-    //Add the Strike() block so that parsing messages on the command controller is much easier.    
-    Serial.println("Strike(" + p_msg + ")");
-    Serial.flush();
-    //Serial1.println("Strike(" + p_msg + ")");
-    //Serial1.flush();
-    //Serial2.println("Strike(" + p_msg + ")");
-    //Serial2.flush();
-    //Serial3.println("Strike(" + p_msg + ")"); 
-    //Serial3.flush();
+bool LightningStepper::attachAxis(LightningStepper& axis)
+{
+    //This motor is always axis 0
+    if (axisCount == 0)
+    {
+        axes[0] = this;
+        axisCount = 1;
+    }
+    if (axisCount >= LIGHTNINGSTEPPER_MAX_AXES)
+    {
+        return false;
+    }
+    //Every axis raises the same pin_Done once they are all done
+    axis.pin_Done = pin_Done;
+    axis.axisId = axisCount;
+    axes[axisCount] = &axis;
+    axisCount++;
+    return true;
 }
 
-String LightningStepper::readSerial()
+void LightningStepper::setSpeedCurve(const uint16_t* curve)
 {
-    //Cannot compile if Serial1 or Serial2 etc don't exist on the board. Must use the default Serial. The modulation of the stepper takes up a lot of the boards abillity to process other things anyway.
-    //That being said you can easily use comments to enable and disable what Serial port the library uses.
-    return Serial.readStringUntil('\n');
-    //return Serial1.readStringUntil('\n');
-    //return Serial2.readStringUntil('\n');
-    //return Serial3.readStringUntil('\n');   
+    speedCurve = curve;
 }
 
-String LightningStepper::cleanMsg(String p_msg)
+void LightningStepper::setLimitSwitches(int pin_MinSwitch, int pin_MaxSwitch)
 {
+    this->pin_MinSwitch = pin_MinSwitch;
+    this->pin_MaxSwitch = pin_MaxSwitch;
+}
 
-    //LightningStepper::printSerial("clean recieved: " + p_msg);
-    if (p_msg.startsWith(msgIDEchunk))
-    {
-        //Clean it
-        p_msg.remove(0, 8);
-        indexOfP = p_msg.indexOf(')');
-        p_msg.remove(indexOfP);
-    }
-    //LightningStepper::printSerial("clean produced: " + p_msg);
-    return p_msg;
+void LightningStepper::setHaltOnCmdReady(bool enabled)
+{
+    haltOnCmdReady = enabled;
 }
 
-void LightningStepper::calculateDelay(int speedVal)
+void LightningStepper::setBusNode(uint8_t nodeId, int pin_DriverEnable)
 {
-    float m = ((float)minDelayInt - (float)maxDelayInt) / ((float)100 - (float)0);
-    float y = (m * (float)speedVal) + (float)maxDelayInt;
-    currentDelayInt = round(y);
-    //LightningStepper::sendMessage("currentDelay: " + String(currentDelayInt));
+    LightningStepper::nodeId = nodeId & 0x0F;
+    LightningStepper::pin_DriverEnable = pin_DriverEnable;
 }
-#pragma endregion Utilities
 
-#pragma region Commands
+void LightningStepper::setIdlePolicy(unsigned long idleMillis, uint8_t holdDuty, bool sleep)
+{
+    LightningStepper::idleMillis = idleMillis;
+    LightningStepper::holdDuty = holdDuty;
+    sleepWhenIdle = sleep;
+}
 
-//This method sets up the pins, speed, and position tracking.
-void LightningStepper::runSetup()
+void LightningStepper::setPersistence(bool enabled)
 {
-    //This code will not compile if Serial1 or Serial2 etc don't exist on the board. 
-    //That being said you can easily use comments to enable and disable what Serial port the code uses.
-    //The modulation of the stepper takes up a lot of the boards abillity to process other things so do so with this understanding.
+    persistent = enabled;
+}
 
+void LightningStepper::setStepMode(StepMode mode)
+{
+    LightningStepper::applyStepMode(mode);
+    queuedMode = mode;
+}
 
-    //Optimize timeout for speedy short messages
-    Serial.setTimeout(1000);
-    Serial.begin(9600);
-    while (!Serial)
-    {
-        ; // wait for serial port to connect.    
-    }
-    /*
-    //Optimize timeout for speedy short messages
-    Serial1.setTimeout(100);
-    Serial1.begin(9600);
-    while (!Serial1)
+void LightningStepper::setSpeedProfile(SpeedProfile profile)
+{
+    if (profile <= lastProfile)
     {
-      ; // wait for serial port to connect.
+        speedProfile = profile;
     }
+}
 
-    //Optimize timeout for speedy short messages
-    Serial2.setTimeout(100);
-    Serial2.begin(9600);
-    while (!Serial2)
+//Set the step increment for a mode. The coil phase is moved onto the mode's entries without writing the coils.
+void LightningStepper::applyStepMode(StepMode mode)
+{
+    stepMode = mode;
+    if (mode == HalfStep)
     {
-      ; // wait for serial port to connect.
+        phaseIncrement = 1;
     }
-
-    //Optimize timeout for speedy short messages
-    Serial3.setTimeout(100);
-    Serial3.begin(9600);
-    while (!Serial3)
+    else
     {
-      ; // wait for serial port to connect.
+        phaseIncrement = 2;
+        //Full step uses the two coil entries (odd) and wave drive the one coil entries (even)
+        if (mode == FullStep)
+        {
+            coilPhase |= 0x01;
+        }
+        else
+        {
+            coilPhase &= 0x06;
+        }
     }
-    */
+}
 
-    //Initialize pins
-    pinMode(stepper_pin1, OUTPUT);
-    pinMode(stepper_pin2, OUTPUT);
-    pinMode(stepper_pin3, OUTPUT);
-    pinMode(stepper_pin4, OUTPUT);
-    digitalWrite(stepper_pin1, LOW);
-    digitalWrite(stepper_pin2, LOW);
-    digitalWrite(stepper_pin3, LOW);
-    digitalWrite(stepper_pin4, LOW);
-    pinMode(pin_CmdReady, INPUT_PULLUP);
-    pinMode(pin_Done, OUTPUT);
-    pinMode(pin_Processing, OUTPUT);
+volatile bool LightningStepper::homingFinished = false;
+bool LightningStepper::cmdReadyInterrupt = false;
+volatile bool LightningStepper::cmdReadyFlag = false;
+volatile bool LightningStepper::cmdReadyWasLow = false;
+bool LightningStepper::haltOnCmdReady = false;
+uint8_t LightningStepper::expectedSequence = 0;
+uint8_t LightningStepper::nodeId = 0;
+int LightningStepper::pin_DriverEnable = -1;
+bool LightningStepper::replyMuted = false;
+bool LightningStepper::syncHold = false;
+volatile bool LightningStepper::scriptRunning = false;
+uint8_t LightningStepper::scriptPc = 0;
+LightningStepper::ScriptWait LightningStepper::scriptWait = LightningStepper::ScriptReady;
+unsigned long LightningStepper::scriptWaitStart = 0;
+unsigned int LightningStepper::scriptDwell = 0;
+uint8_t LightningStepper::scriptPin = 0;
+uint8_t LightningStepper::scriptPinLevel = 0;
+uint8_t LightningStepper::scriptLoopStart[LIGHTNINGSTEPPER_SCRIPT_LOOPS];
+uint8_t LightningStepper::scriptLoopCount[LIGHTNINGSTEPPER_SCRIPT_LOOPS];
+uint8_t LightningStepper::scriptLoopDepth = 0;
+Stream* LightningStepper::port = &Serial;
+HardwareSerial* LightningStepper::hardwarePort = 0;
+bool LightningStepper::defaultPort = true;
+unsigned long LightningStepper::baudRate = 9600;
+uint8_t LightningStepper::telemetryAxes = 0;
+unsigned long LightningStepper::idleMillis = 0;
+uint8_t LightningStepper::holdDuty = 0;
+bool LightningStepper::sleepWhenIdle = false;
+unsigned long LightningStepper::idleSince = 0;
+volatile bool LightningStepper::coilsIdle = false;
+bool LightningStepper::holdOn = false;
+bool LightningStepper::persistent = false;
+bool LightningStepper::storageClean = false;
+unsigned long LightningStepper::storageSince = 0;
+LightningStepper* LightningStepper::axes[LIGHTNINGSTEPPER_MAX_AXES];
+uint8_t LightningStepper::axisCount = 0;
+unsigned long LightningStepper::scheduleClock = 0;
+unsigned int LightningStepper::coordinatedSteps = 0;
 
-    //Wait for the CMDReady pin signal. This eliminates the issue where the command controller would have to power up first.
+#pragma region Utilities
+
+void LightningStepper::waitForMessage(const char* p_msg)
+{
+    //Reset keepWaiting
     keepWaiting = true;
-    while (keepWaiting == true)
-    {
-        //Check the pin. Remember this is INPUT_PULLUP so a value of 0 is the signal
-        pin_CmdReady_Value = digitalRead(pin_CmdReady);
-        if (pin_CmdReady_Value == 0)
-        {
-            //Proceed
+    while (keepWaiting == true) {
+        //Wait for a whole Message() block
+        char* msg = LightningStepper::readMessage();
+        //Compare
+        if (strncmp(msg, p_msg, strlen(p_msg)) == 0) {
+            //Match
             keepWaiting = false;
         }
+        else {
+            //Error. Send to IDE for debug. May need to turn off the Stepper Controller and turn back on.
+            LightningStepper::beginReply();
+            LightningStepper::appendReply(F("SC Error: "));
+            LightningStepper::appendReply(msg);
+            LightningStepper::sendReply();
+        }
     }
+}
 
+void LightningStepper::sendMessage(const char* p_msg)
+{
+    LightningStepper::beginReply();
+    LightningStepper::appendReply(p_msg);
+    LightningStepper::sendReply();
+}
 
+void LightningStepper::sendMessage(const __FlashStringHelper* p_msg)
+{
+    LightningStepper::beginReply();
+    LightningStepper::appendReply(p_msg);
+    LightningStepper::sendReply();
+}
 
-    //Prompt the user for either the manual setup or the auto setup
-    LightningStepper::preSetupPrompt();
-
-    if (launchMode == 1)
+//Replies are written to the serial port piece by piece as they are built so neither a String nor a reply buffer is needed.
+//The port's transmit buffer sends them in the background. Pick the port with the constructor.
+void LightningStepper::beginReply()
+{
+    if (replyMuted == true)
     {
-        LightningStepper::startUpManually();
+        return;
     }
-    else if (launchMode == 2)
+    LightningStepper::beginTransmit();
+    //Add the Strike() block so that parsing messages on the command controller is much easier.    
+    port->print(F("Strike("));
+}
+
+void LightningStepper::appendReply(char c)
+{
+    if (replyMuted == false)
     {
-        LightningStepper::startUpAuto();
+        port->write(c);
     }
-    else
+}
+
+void LightningStepper::appendReply(const char* text)
+{
+    if (replyMuted == false)
     {
-        LightningStepper::sendMessage("SC Error: setup code wrong");
+        port->print(text);
     }
-    
-    LightningStepper::sendMessage("Exiting the runSetup routine. Type Go to proceed to run");
-    //Wait for go
-    LightningStepper::waitForMessage("Go");
-    //Go ahead and set the done pin high for the first loop. The command controller always checks this before sending a command unless it needs to interupt.
-    digitalWrite(pin_Done, HIGH);
-    //Go ahead and set the processing pin low for the first loop.
-    digitalWrite(pin_Processing, LOW);
 }
 
-void LightningStepper::preSetupPrompt()
+void LightningStepper::appendReply(const __FlashStringHelper* text)
 {
-    LightningStepper::sendMessage("Motor Running. To manually setup a motor reply '1', to auto setup a motor reply '2'");
-    
-    //Reset keepWaiting
-    keepWaiting = true;
-    //Reset msg 
-    msg = "";
-    while (keepWaiting == true)
+    if (replyMuted == false)
     {
-        //Keep adding chunks of a message until the whole thing arrives.
-        msg = msg + LightningStepper::readSerial();
-        msgLength = msg.length();
-        //remove any leading and trailing whitespace
-        msg.trim();        
-        if (msgLength > 2)
-        {
-            //Look for the block() start
-            indexOfP = msg.indexOf('(');
-            if (indexOfP > 0) 
-            {
-                //look for the block end
-                indexOfP = msg.indexOf(')');
-                if (indexOfP > 0) 
-                {
-                    //Entire block arrived
-                    //remove the block
-                    msg = LightningStepper::cleanMsg(msg);
-                    //Compare
-                    if (msg == "1")
-                    {
-                        keepWaiting = false;
-                        launchMode = 1;
-                        LightningStepper::sendMessage("read: " + msg);
-                    }
-                    else if (msg == "2")
-                    {
-                        keepWaiting = false;
-                        launchMode = 2;
-                        LightningStepper::sendMessage("read: " + msg);
-                    }
-                    else
-                    {
-                        LightningStepper::sendMessage("Error 1");
-                        //Loop again
-                        //Reset 
-                        msg = "";
-                    }                    
-                }
-            }            
-        }
+        port->print(text);
     }
 }
 
-void LightningStepper::startUpAuto()
+void LightningStepper::appendReply(long value)
 {
-    LightningStepper::sendMessage("Auto setup initiated. Please specify: minDelay,maxDelay,currentPosition,MaxPosition");
-
-    //Reset keepWaiting
-    keepWaiting = true;
-    //Reset msg 
-    msg = "";
-    while (keepWaiting == true)
+    //Integer to ASCII in a small stack buffer. Digits come out backwards so collect them first.
+    char digits[12];
+    uint8_t count = sizeof(digits) - 1;
+    digits[count] = '\0';
+    unsigned long magnitude = (unsigned long)value;
+    if (value < 0)
     {
-        //Keep adding chunks of a message until the whole thing arrives.
-        msg = msg + LightningStepper::readSerial();
-        msgLength = msg.length();
-        //remove any leading and trailing whitespace
-        msg.trim();
-        if (msgLength > 2)
-        {
-            //Look for the block() start
-            indexOfP = msg.indexOf('(');
-            if (indexOfP > 0)
-            {
-                //look for the block end
-                indexOfP = msg.indexOf(')');
-                if (indexOfP > 0)
-                {
-                    //Entire block arrived
-                    //remove the block
-                    msg = LightningStepper::cleanMsg(msg);
-                    //Process msg settings
-                    LightningStepper::processSettings();
-                    keepWaiting = false;
-                }
-            }
-        }        
+        magnitude = 0UL - magnitude;
+    }
+    do
+    {
+        count--;
+        digits[count] = '0' + (magnitude % 10);
+        magnitude /= 10;
+    } while (magnitude > 0);
+    if (value < 0)
+    {
+        count--;
+        digits[count] = '-';
     }
-    LightningStepper::sendMessage("Recieved minDelay: " + minDelayString + " maxDelay: " + maxDelayString + " currentPosition: " + currentPositionString + " maxPosition: " + maxPositionString);
+    LightningStepper::appendReply(&digits[count]);
 }
 
-void LightningStepper::startUpManually()
+void LightningStepper::sendReply()
 {
-
-    LightningStepper::sendMessage("Manual setup initiated. Please specify: minDelay,maxDelay");
-
-    //--Process min and max delay setting
-    //Reset keepWaiting
-    keepWaiting = true;
-    //Reset msg 
-    msg = "";
-    while (keepWaiting == true)
+    if (replyMuted == true)
     {
-        //Keep adding chunks of a message until the whole thing arrives.
-        msg = msg + LightningStepper::readSerial();
-        msgLength = msg.length();
-        //remove any leading and trailing whitespace
-        msg.trim();
-        if (msgLength > 2)
-        {
-            //Look for the block() start
-            indexOfP = msg.indexOf('(');
-            if (indexOfP > 0)
-            {
-                //look for the block end
-                indexOfP = msg.indexOf(')');
-                if (indexOfP > 0)
-                {
-                    //Entire block arrived
-                    //remove the block
-                    msg = LightningStepper::cleanMsg(msg);
-                    //Process msg settings
-                    //Separate first chunk
-                    commaIndex = msg.indexOf(",");
-                    minDelayString = msg.substring(0, commaIndex);
-                    //Remove the first chunk
-                    msg.remove(0, (commaIndex + 1));
-                    //Separate second chunk
-                    commaIndex = msg.indexOf(",");
-                    maxDelayString = msg.substring(0, commaIndex);
-                    minDelayInt = minDelayString.toInt();
-                    maxDelayInt = maxDelayString.toInt();
-
-                    keepWaiting = false;
-                }
-            }
-        }
+        return;
     }
-    LightningStepper::sendMessage("Recieved minDelay: " + minDelayString + " maxDelay: " + maxDelayString);
-    
-
-    //--Set the ccw stop    
-    LightningStepper::sendMessage("Type 'Go' to move. To stop, drive the pin_CmdReady low thus setting the zero position");
-    //Wait for go    
-    LightningStepper::waitForMessage("Go");
+    //No flush. Waiting for the transmit buffer to drain would hold up run() for the whole reply.
+    port->println(')');
+    LightningStepper::endTransmit();
+}
 
-    //Wait for CmdReady pin. Stop and set zero
-    keepWaiting = true;
-    while (keepWaiting == true)
+//Binary replies. The address carries this node so the command controller can tell who answered.
+void LightningStepper::sendFrame(uint8_t address, uint8_t opcode, const uint8_t* payload, uint8_t length)
+{
+    if (replyMuted == true)
     {
-        pin_CmdReady_Value = digitalRead(pin_CmdReady);
-        if (pin_CmdReady_Value == 0)
-        {
-            LightningStepper::sendMessage("The zero position has been set");
-            LightningStepper::sendMessage("Type 'Go' to move. To stop, drive the pin_CmdReady low thus setting the max position");
-            currentPositionInt = 0;
-            keepWaiting = false;
-        }
-        else
-        {
-            //Modulate stepper
-            LightningStepper::stepCCW();
-            delayMicroseconds(3000);
-        }
+        return;
     }
-    //Wait for go
-    LightningStepper::waitForMessage("Go");
+    LightningStepper::beginTransmit();
+    LightningStepperProtocol::writeFrame(*port, (nodeId << 4) | (address & 0x0F), opcode, payload, length);
+    LightningStepper::endTransmit();
+}
 
-    //--Set the cw stop aka max position
-    //Wait for pin 30. Stop and set maxposition
-    keepWaiting = true;
-    while (keepWaiting == true)
+//On a half duplex bus the transceiver only drives the line while this node replies
+void LightningStepper::beginTransmit()
+{
+    if (pin_DriverEnable >= 0)
     {
-        pin_CmdReady_Value = digitalRead(pin_CmdReady);
-        if (pin_CmdReady_Value == 0)
-        {
-            maxPositionInt = currentPositionInt;
-            maxPositionString = String(maxPositionInt);
-            LightningStepper::sendMessage("Max position: " + maxPositionString);            
-            //Move one step so its not right on max
-            LightningStepper::stepCCW();
-            currentPositionInt--;
-            keepWaiting = false;
-        }
-        else
-        {
-            //Modulate stepper
-            LightningStepper::stepCW();
-            currentPositionInt++;
-            delayMicroseconds(3000);
-        }
-    }    
+        digitalWrite(pin_DriverEnable, HIGH);
+    }
 }
 
-//This method listens for commands and runs the stepper motor.
-void LightningStepper::run()
+void LightningStepper::endTransmit()
 {
-    //Check the pin for if there is a msg to read or not. This is way faster than checking the serial input. 
-    pin_CmdReady_Value = digitalRead(pin_CmdReady);
-    if (pin_CmdReady_Value == 0)
+    if (pin_DriverEnable >= 0)
     {
-        //The serial input is ready. Note this pin is configured as input_Pullup
-        LightningStepper::processCmd();
+        //The line must be let go right after the last bit so the next node can answer. This is the one place a reply waits on the port.
+        port->flush();
+        digitalWrite(pin_DriverEnable, LOW);
     }
-    else
+}
+
+//Handshake pins are -1 when they are left out
+void LightningStepper::writePin(int pin, uint8_t value)
+{
+    if (pin >= 0)
     {
-        if (done == true)
-        {
-            //Do nothing. 
-        }
-        else
-        {
-            //modulate stepper one step. 
-            LightningStepper::modulateStepper();
-        }
+        digitalWrite(pin, value);
     }
 }
 
-void LightningStepper::processSettings() 
+//The manual setup stops the motor on pin_CmdReady going low. Without the pin any message stops it.
+bool LightningStepper::stopSignaled()
 {
-    //Separate first chunk
-    commaIndex = msg.indexOf(",");
-    minDelayString = msg.substring(0, commaIndex);
-    //Remove the first chunk
-    msg.remove(0, (commaIndex + 1));
-
-    //Separate second chunk
-    commaIndex = msg.indexOf(",");
-    maxDelayString = msg.substring(0, commaIndex);
-    //Remove the second chunk
-    msg.remove(0, (commaIndex + 1));
-
-    //Separate 3rd chunk
-    commaIndex = msg.indexOf(",");
-    currentPositionString = msg.substring(0, commaIndex);
-    //Remove the 3rd chunk
-    msg.remove(0, (commaIndex + 1));
-
-    //Separate 4th chunk
-    commaIndex = msg.indexOf(",");
-    maxPositionString = msg.substring(0, commaIndex);
-    //Remove the 3rd chunk
-    msg.remove(0, (commaIndex + 1));
-
-    //Convert all strings to ints
-    minDelayInt = minDelayString.toInt();
-    maxDelayInt = maxDelayString.toInt();
-    currentPositionInt = currentPositionString.toInt();
-    maxPositionInt = maxPositionString.toInt();
+    if (pin_CmdReady < 0)
+    {
+        return LightningStepper::pollSerial() == TextFrame;
+    }
+    return digitalRead(pin_CmdReady) == 0;
 }
 
-void LightningStepper::processCmd()
+//Only used by the setup routines where there is nothing else to do. Wait for a whole Message() block and return what is inside it.
+char* LightningStepper::readMessage()
 {
-    /*
-        Commands:
-        Cmd 1-get the motor's details.        Send: 1                           Replies: Strike(Settings: currentPosition,maxPosition,currentDelay,minDelay,maxDelay)
-        Cmd 2-move to position.               Send: 2,speed,steps,direction     Replies:
-        Cmd 3 stop.                           Send: 3                           Replies:
-
-        Notes:
-        Speed is [0-100]   1 the slowest. 100 the fastest. 
-        Direction 1=cw currentPosition increases, 2=ccw currentPosition decreases
-
-        pin_Processing:
-        Low to High: stepper controller ready for a message/cmd
-        High to Low: stepper controller processed message and ready for another interupt from pin_CmdReady
-    */
-    
-
-    //--Let the command controller know that the stepper controller has started processing.
-    //The command controller will then start the serial transmission
-    digitalWrite(pin_Processing, HIGH);
-    
-    //--Enter msg checker loop
-    //Reset keepWaiting
-    keepWaiting = true;
-    //Reset msg 
-    msg = "";
-    while (keepWaiting == true)
+    char* msg = 0;
+    while (msg == 0)
     {
-        //Keep adding chunks of a message until the whole thing arrives.
-        msg = msg + LightningStepper::readSerial();
-        msgLength = msg.length();
-        //remove any leading and trailing whitespace
-        msg.trim();
-        if (msgLength > 2)
+        while (LightningStepper::pollSerial() != TextFrame)
         {
-            //Look for the block() start
-            indexOfP = msg.indexOf('(');
-            if (indexOfP > 0)
-            {
-                //look for the block end
-                indexOfP = msg.indexOf(')');
-                if (indexOfP > 0)
-                {
-                    //Entire block arrived
-                    //remove the Message() block
-                    msg = LightningStepper::cleanMsg(msg);
-                    //Process cmd
-                    //Either a single digit or digits with commas
-                    msgLength = msg.length();
-                    if (msgLength > 1)
-                    {
-                        //Separate first chunk. The cmd
-                        commaIndex = msg.indexOf(",");
-                        cmdMarkString = msg.substring(0, commaIndex);
-                    }
-                    else
-                    {
-                        cmdMarkString = msg;
-                    }
-
-                    //Analyze cmdMark and Determine if further processing is needed
-                    //cmds marks
-                    //1: get motors details
-                    //2: move to postition
-                    //3: stop
-                    if (cmdMarkString == "3")
-                    {
-                        //Stop. 
-
-                        //Program enters done loop. The user must then apply a voltage to send another cmd
-                        done = true;
-                        //Set the done pin high
-                        digitalWrite(pin_Done, HIGH);
-                    }
-                    else if (cmdMarkString == "1")
-                    {
-                        //Reply with motor details
-
-                        //Get strings of all metrics
-                        currentPositionString = String(currentPositionInt);
-                        maxPositionString = String(maxPositionInt);
-                        speedString = String(speedInt);
-                        minDelayString = String(minDelayInt);
-                        maxDelayString = String(maxDelayInt);
-                        LightningStepper::sendMessage("Settings: " + currentPositionString + "," + maxPositionString + "," + minDelayString + "," + maxDelayString);
-                        done = true;
-                        //Set the done pin high
-                        digitalWrite(pin_Done, HIGH);
-                    }
-                    else if (cmdMarkString == "2")
-                    {
-                        //Move to position
-
-                        //Process more chunks
-                        //Remove the first chunk. The cmd.
-                        msg.remove(0, (commaIndex + 1));
-
-                        //Separate the second chunk. The speed
-                        commaIndex = msg.indexOf(",");
-                        speedString = msg.substring(0, commaIndex);
-                        //Remove the second chunk.
-                        msg.remove(0, (commaIndex + 1));
-
-                        //Separate the 3rd chunk. The steps
-                        commaIndex = msg.indexOf(",");
-                        stepsString = msg.substring(0, commaIndex);
-                        //Remove the 3rd chunk
-                        msg.remove(0, (commaIndex + 1));
-
-                        //All that is left is the 4th chunk. The direction
-                        directionString = msg;
-                        //Set all metrics                 
-                        speedInt = speedString.toInt();
-                        stepsInt = stepsString.toInt();
-                        directionInt = directionString.toInt();
-                        //Turn 0-100 speed into microsecond delay
-                        //Calculates and sets the currentDelay used in the modulation loop.
-                        LightningStepper::calculateDelay(speedInt);
-
-                        //The stepper controller is not done until it steps the requested amount. It can be interupted before done in the run routine.
-                        done = false;
-                        //Set the done pin low meaning it is not done 
-                        digitalWrite(pin_Done, LOW);
-                    }
-                    //Stop listening for serial messages/commands
-                    keepWaiting = false;
-                }
-                else 
-                {
-                    //Loop...Keep reading and adding chunks
-                }
-            }
         }
+        msg = LightningStepper::cleanMsg(lineBuffer);
     }
-
-    //The command controller cannot interupt yet with the CmdReady pin.
-    //Let the command controller know that the stepper controller is finished processing
-    digitalWrite(pin_Processing, LOW);    
+    return msg;
 }
 
-#pragma endregion Commands
-
-#pragma region StepperControl
-
-void LightningStepper::modulateStepper() {
-    //Direction 1 = cw currentPosition increases, 2 = ccw currentPosition decreases
-    //Check if it has reached limts factor in direction for if it is at 0 but is going up
-    if (currentPositionInt == 0 && directionInt == 1) 
+//Consume whatever bytes have arrived without waiting for more. Returns the kind of frame once a whole one is ready.
+//Text lines end up in lineBuffer and binary frames in frameDecoder.
+LightningStepper::SerialFrame LightningStepper::pollSerial()
+{
+    while (port->available() > 0)
     {
-        //At limit but will move back in bounds. Free to move
-        //Check if the steps are 0 to know if it has reached the requested position 
-        if (stepsInt <= 0)
-        {
-            //Finished Instructions
-            done = true;
-            //Set the done pin high
-            digitalWrite(pin_Done, HIGH);
-        }
-        else if (stepsInt > 0)
+        uint8_t data = port->read();
+        //Binary frames start with a sync byte. Neither can show up in a line of text.
+        if (receivingBinary == true || (lineLength == 0 && (data == LightningStepperProtocol::sync || data == LightningStepperProtocol::syncSequenced)))
         {
-            //Keep going
-            //Determine Direction
-            if (directionInt == 1)
+            receivingBinary = true;
+            LightningStepperFrameDecoder::Status status = frameDecoder.feed(data);
+            if (status == LightningStepperFrameDecoder::Complete)
             {
-                //cw is considered positive heading away from the zero position towards max position
-                //Modulate
-                LightningStepper::stepCW();
-                //Requested steps will go down by one
-                stepsInt--;
-                //Postion moves positive
-                currentPositionInt++;
+                receivingBinary = false;
+                return BinaryFrame;
             }
-            else if (directionInt == 2)
+            else if (status == LightningStepperFrameDecoder::Error)
             {
-                //ccw is considered negative heading towards zero and away from max position
-                LightningStepper::stepCCW();
-                //Requested steps will go down by one
-                stepsInt--;
-                //Positon moves negative
-                currentPositionInt--;
+                receivingBinary = false;
+                return (frameDecoder.sequenced == true) ? BadSequencedFrame : BadFrame;
             }
-            //Delay for speed
-            delayMicroseconds(currentDelayInt);
         }
-
-    }
-    else if (currentPositionInt == maxPositionInt && directionInt == 2) 
-    {
-        //At limit but will move back in bounds. Free to move
-        //Check if the steps are 0 to know if it has reached the requested position 
-        if (stepsInt <= 0)
-        {
-            //Finished Instructions
-            done = true;
-            //Set the done pin high
-            digitalWrite(pin_Done, HIGH);
-        }
-        else if (stepsInt > 0)
+        else if (data == '\n')
         {
-            //Keep going
-            //Determine Direction
-            if (directionInt == 1)
-            {
-                //cw is considered positive heading away from the zero position towards max position
-                //Modulate
-                LightningStepper::stepCW();
-                //Requested steps will go down by one
-                stepsInt--;
-                //Postion moves positive
-                currentPositionInt++;
-            }
-            else if (directionInt == 2)
+            if (lineLength > 0)
             {
-                //ccw is considered negative heading towards zero and away from max position
-                LightningStepper::stepCCW();
-                //Requested steps will go down by one
-                stepsInt--;
-                //Positon moves negative
-                currentPositionInt--;
+                lineBuffer[lineLength] = '\0';
+                lineLength = 0;
+                if (lineOverflow == true)
+                {
+                    //Too long to be a command
+                    lineOverflow = false;
+                    return BadFrame;
+                }
+                return TextFrame;
             }
-            //Delay for speed
-            delayMicroseconds(currentDelayInt);
-        }
-    }
-    else if (currentPositionInt < maxPositionInt && currentPositionInt > 0)
-    {
-        //Not at limit. Free to move
-        //Check if the steps are 0 to know if it has reached the requested position 
-        if (stepsInt <= 0)
-        {
-            //Finished Instructions
-            done = true;
-            //Set the done pin high
-            digitalWrite(pin_Done, HIGH);
         }
-        else if (stepsInt > 0)
+        else if (data != '\r')
         {
-            //Keep going
-            //Determine Direction
-            if (directionInt == 1)
+            if (lineLength < sizeof(lineBuffer) - 1)
             {
-                //cw is considered positive heading away from the zero position towards max position
-                //Modulate
-                LightningStepper::stepCW();
-                //Requested steps will go down by one
-                stepsInt--;
-                //Postion moves positive
-                currentPositionInt++;
+                lineBuffer[lineLength] = data;
+                lineLength++;
             }
-            else if (directionInt == 2)
+            else
             {
-                //ccw is considered negative heading towards zero and away from max position
-                LightningStepper::stepCCW();
-                //Requested steps will go down by one
-                stepsInt--;
-                //Positon moves negative
-                currentPositionInt--;
+                lineOverflow = true;
             }
-            //Delay for speed
-            delayMicroseconds(currentDelayInt);
         }
+    }
+    return NoFrame;
+}
 
+//Strips the Message() block in place. Returns 0 if the line is not a whole block.
+char* LightningStepper::cleanMsg(char* p_msg)
+{
+    //remove any leading whitespace
+    while (*p_msg == ' ' || *p_msg == '\t')
+    {
+        p_msg++;
+    }
+    //Look for the block() start and end
+    char* blockStart = strchr(p_msg, '(');
+    char* blockEnd = strchr(p_msg, ')');
+    if (blockStart == 0 || blockStart == p_msg || blockEnd == 0)
+    {
+        return 0;
     }
-    else if (currentPositionInt >= maxPositionInt || currentPositionInt <= 0)
+    if (strncmp(p_msg, msgIDEchunk, sizeof(msgIDEchunk) - 1) == 0)
     {
-        //Ran into a limit. Stop Moving
-        done = true;
-        //Set the done pin high
-        digitalWrite(pin_Done, HIGH);
+        //Clean it
+        p_msg += sizeof(msgIDEchunk) - 1;
+        blockEnd = strchr(p_msg, ')');
+        *blockEnd = '\0';
     }
+    return p_msg;
 }
 
-//Counter Clockwise. Just adjust the device doing the commanding if this needs to flip direction.
-void LightningStepper::stepCCW()
+//Read the next comma separated integer and move the cursor past the comma. Works like toInt on each chunk.
+long LightningStepper::nextField(const char*& cursor)
 {
-    if (isHigh_pin4 == false && isHigh_pin3 == false && isHigh_pin2 == false && isHigh_pin1 == true)
+    while (*cursor == ' ')
     {
-
-        //currentstep = "A";
-        if (stepKind == 4)
+        cursor++;
+    }
+    bool negative = false;
+    if (*cursor == '-')
+    {
+        negative = true;
+        cursor++;
+    }
+    long value = 0;
+    while (*cursor >= '0' && *cursor <= '9')
+    {
+        value = (value * 10) + (*cursor - '0');
+        cursor++;
+    }
+    //Skip whatever is left of the chunk
+    while (*cursor != '\0' && *cursor != ',')
+    {
+        cursor++;
+    }
+    if (*cursor == ',')
+    {
+        cursor++;
+    }
+    return negative ? -value : value;
+}
+
+void LightningStepper::calculateDelay(int speedVal)
+{
+    currentDelayInt = LightningStepper::delayForSpeed(speedVal);
+    //LightningStepper::sendMessage("currentDelay: " + String(currentDelayInt));
+}
+
+//Delay of a speed without changing the move. Used to plan the S-curve of a queued move ahead of time.
+int LightningStepper::delayForSpeed(int speedVal)
+{
+    //Integer only lookup. This runs while pin_Processing is high so the command controller is waiting on it.
+    if (speedVal < 0)
+    {
+        speedVal = 0;
+    }
+    else if (speedVal > 100)
+    {
+        speedVal = 100;
+    }
+    unsigned long fraction = pgm_read_word(&speedCurve[speedVal]);
+    //Stretch [0-65535] to [0-65536] so the top of the curve lands exactly on minDelay
+    fraction += fraction >> 15;
+    return maxDelayInt - (int)(((unsigned long)delaySpan * fraction + 32768UL) >> 16);
+}
+
+//Integer square root. Only used when a command arrives, never between steps.
+static unsigned int integerSqrt(unsigned long value)
+{
+    unsigned long root = 0;
+    unsigned long bit = 1UL << 30;
+    while (bit > value)
+    {
+        bit >>= 2;
+    }
+    while (bit != 0)
+    {
+        if (value >= root + bit)
+        {
+            value -= root + bit;
+            root = (root >> 1) + bit;
+        }
+        else
+        {
+            root >>= 1;
+        }
+        bit >>= 2;
+    }
+    return (unsigned int)root;
+}
+
+//Call whenever minDelay or maxDelay change
+void LightningStepper::updateDelayRange()
+{
+    delaySpan = (unsigned int)(maxDelayInt - minDelayInt);
+}
+#pragma endregion Utilities
+
+#pragma region Commands
+
+//This method sets up the pins, speed, and position tracking.
+void LightningStepper::runSetup()
+{
+    //The modulation of the stepper takes up a lot of the boards abillity to process other things so do so with this understanding.
+    //Serial input is parsed a byte at a time as it arrives so no read timeout is needed
+    LightningStepper::beginPort();
+
+    //This motor is axis 0 even if no other axes were attached
+    if (axisCount == 0)
+    {
+        axes[0] = this;
+        axisCount = 1;
+    }
+
+    //Initialize pins
+    //The coil pins are resolved once here so every step is a single pattern write
+    for (uint8_t i = 0; i < axisCount; i++)
+    {
+        if (axes[i]->coils.begin(axes[i]->stepper_pin1, axes[i]->stepper_pin2, axes[i]->stepper_pin3, axes[i]->stepper_pin4) == false)
+        {
+            //The port register backend needs the four pins on one port. See LightningStepperCoils.h
+            LightningStepper::sendMessage(F("SC Error: coil pins on more than one port"));
+        }
+        axes[i]->minSwitch.begin(axes[i]->pin_MinSwitch);
+        axes[i]->maxSwitch.begin(axes[i]->pin_MaxSwitch);
+    }
+    //The handshake pins are optional with sequenced commands. -1 leaves a pin out.
+    if (pin_DriverEnable >= 0)
+    {
+        pinMode(pin_DriverEnable, OUTPUT);
+        digitalWrite(pin_DriverEnable, LOW);
+    }
+    if (pin_CmdReady >= 0)
+    {
+        pinMode(pin_CmdReady, INPUT_PULLUP);
+    }
+    if (pin_Done >= 0)
+    {
+        pinMode(pin_Done, OUTPUT);
+    }
+    if (pin_Processing >= 0)
+    {
+        pinMode(pin_Processing, OUTPUT);
+    }
+
+    //The axes share the step timer
+    LightningStepperTimer::begin();
+    //A script saved with Cmd 21 is ready to run with Cmd 20
+    LightningStepperScript::load();
+
+    //Skip the setup when the settings and position were saved after the motors last stopped.
+    //Holding pin_CmdReady low at power up goes through the setup anyway. Remember this is INPUT_PULLUP so a value of 0 is the signal.
+    if (persistent == true && LightningStepper::restoreSettings() == true && (pin_CmdReady < 0 || digitalRead(pin_CmdReady) == 1))
+    {
+        LightningStepper::beginReply();
+        LightningStepper::appendReply(F("Settings restored. currentPosition: "));
+        LightningStepper::appendReply((long)currentPositionInt);
+        LightningStepper::appendReply(F(" maxPosition: "));
+        LightningStepper::appendReply((long)maxPositionInt);
+        LightningStepper::sendReply();
+        LightningStepper::writePin(pin_Done, HIGH);
+        LightningStepper::writePin(pin_Processing, LOW);
+        LightningStepper::attachCmdReadyInterrupt();
+        return;
+    }
+    storageClean = false;
+
+    //Wait for the CMDReady pin signal. This eliminates the issue where the command controller would have to power up first.
+    //Without the pin the setup prompt goes out right away.
+    keepWaiting = (pin_CmdReady >= 0);
+    while (keepWaiting == true)
+    {
+        //Check the pin. Remember this is INPUT_PULLUP so a value of 0 is the signal
+        pin_CmdReady_Value = digitalRead(pin_CmdReady);
+        if (pin_CmdReady_Value == 0)
+        {
+            //Proceed
+            keepWaiting = false;
+        }
+    }
+
+
+
+    //Prompt the user for either the manual setup or the auto setup
+    LightningStepper::preSetupPrompt();
+
+    if (launchMode == 1)
+    {
+        LightningStepper::startUpManually();
+    }
+    else if (launchMode == 2)
+    {
+        LightningStepper::startUpAuto();
+    }
+    else if (launchMode == 3)
+    {
+        LightningStepper::startUpHoming();
+    }
+    else
+    {
+        LightningStepper::sendMessage(F("SC Error: setup code wrong"));
+    }
+    
+    //Attached axes start out with the same settings. Cmd 8 changes them.
+    for (uint8_t i = 1; i < axisCount; i++)
+    {
+        axes[i]->minDelayInt = minDelayInt;
+        axes[i]->maxDelayInt = maxDelayInt;
+        axes[i]->currentPositionInt = currentPositionInt;
+        axes[i]->maxPositionInt = maxPositionInt;
+        axes[i]->updateDelayRange();
+    }
+
+    LightningStepper::sendMessage(F("Exiting the runSetup routine. Type Go to proceed to run"));
+    //Wait for go
+    LightningStepper::waitForMessage("Go");
+    //Go ahead and set the done pin high for the first loop. The command controller always checks this before sending a command unless it needs to interupt.
+    LightningStepper::writePin(pin_Done, HIGH);
+    //Go ahead and set the processing pin low for the first loop.
+    LightningStepper::writePin(pin_Processing, LOW);
+    //The setup waits on the pin level since there is nothing else to do. From here on a falling edge signals a command.
+    LightningStepper::attachCmdReadyInterrupt();
+}
+
+//Start the serial port unless the sketch already started the Stream it passed in
+void LightningStepper::beginPort()
+{
+    if (hardwarePort != 0)
+    {
+        hardwarePort->begin(baudRate);
+    }
+    else if (defaultPort == true)
+    {
+        Serial.begin(baudRate);
+        while (!Serial)
+        {
+            ; // wait for serial port to connect.    
+        }
+    }
+}
+
+//Listen for pin_CmdReady with an interrupt if the pin has one
+void LightningStepper::attachCmdReadyInterrupt()
+{
+    cmdReadyFlag = false;
+    if (pin_CmdReady < 0)
+    {
+        return;
+    }
+    int interruptNumber = digitalPinToInterrupt(pin_CmdReady);
+    if (interruptNumber != NOT_AN_INTERRUPT)
+    {
+        attachInterrupt(interruptNumber, LightningStepper::cmdReadyFell, FALLING);
+        cmdReadyInterrupt = true;
+    }
+#if defined(__AVR__) && defined(LIGHTNINGSTEPPER_PCINT_CMDREADY)
+    else if (digitalPinToPCICR(pin_CmdReady) != 0)
+    {
+        cmdReadyInput.begin(pin_CmdReady);
+        cmdReadyWasLow = cmdReadyInput.isClosed();
+        uint8_t oldSREG = SREG;
+        cli();
+        *digitalPinToPCMSK(pin_CmdReady) |= (1 << digitalPinToPCMSKbit(pin_CmdReady));
+        *digitalPinToPCICR(pin_CmdReady) |= (1 << digitalPinToPCICRbit(pin_CmdReady));
+        SREG = oldSREG;
+        cmdReadyInterrupt = true;
+    }
+#endif
+    //The command controller may have pulled the pin low before the interrupt was attached. It can send a command right after Go.
+    if (cmdReadyInterrupt == true && digitalRead(pin_CmdReady) == 0)
+    {
+        cmdReadyFlag = true;
+    }
+}
+
+//pin_CmdReady went low. Runs in interrupt context.
+void LightningStepper::cmdReadyFell()
+{
+    cmdReadyFlag = true;
+    if (haltOnCmdReady == true)
+    {
+        LightningStepper::haltAllAxes();
+    }
+}
+
+//A pin change interrupt fires for any pin in its group and on both edges. Only pin_CmdReady going low counts.
+void LightningStepper::cmdReadyPinChanged()
+{
+    if (axisCount == 0)
+    {
+        return;
+    }
+    bool low = axes[0]->cmdReadyInput.isClosed();
+    if (low == true && cmdReadyWasLow == false)
+    {
+        LightningStepper::cmdReadyFell();
+    }
+    cmdReadyWasLow = low;
+}
+
+//Emergency stop from interrupt context. Every axis stops on the step it is at and the queues are cleared.
+void LightningStepper::haltAllAxes()
+{
+    //Also runs from run() when pin_CmdReady is polled. The step timer is held off until every queue is empty so it cannot chain a queued move
+    //onto an axis that was already stopped. The interrupt state is put back as it was since this can run inside an interrupt.
+#if defined(__AVR__)
+    uint8_t oldSREG = SREG;
+    cli();
+#else
+    noInterrupts();
+#endif
+    for (uint8_t i = 0; i < axisCount; i++)
+    {
+        LightningStepper* axis = axes[i];
+        axis->stepping = false;
+        axis->queueCount = 0;
+        axis->leading = false;
+        axis->following = false;
+        axis->homingPhase = HomeIdle;
+        axis->done = true;
+    }
+    //While the coils idle the step timer is only chopping them
+    if (coilsIdle == false)
+    {
+        LightningStepperTimer::stop();
+    }
+#if defined(__AVR__)
+    SREG = oldSREG;
+#else
+    interrupts();
+#endif
+    scriptRunning = false;
+    if (axisCount > 0)
+    {
+        LightningStepper::writePin(axes[0]->pin_Done, HIGH);
+    }
+}
+
+void LightningStepper::preSetupPrompt()
+{
+    LightningStepper::sendMessage(F("Motor Running. To manually setup a motor reply '1', to auto setup a motor reply '2', to home with the limit switches reply '3'"));
+    
+    //Reset keepWaiting
+    keepWaiting = true;
+    while (keepWaiting == true)
+    {
+        char* msg = LightningStepper::readMessage();
+        //Compare
+        if (strcmp(msg, "1") == 0)
+        {
+            keepWaiting = false;
+            launchMode = 1;
+        }
+        else if (strcmp(msg, "2") == 0)
+        {
+            keepWaiting = false;
+            launchMode = 2;
+        }
+        else if (strcmp(msg, "3") == 0 && minSwitch.isAttached() == true)
+        {
+            keepWaiting = false;
+            launchMode = 3;
+        }
+        else
+        {
+            LightningStepper::sendMessage(F("Error 1"));
+            //Loop again
+        }                    
+    }
+    LightningStepper::beginReply();
+    LightningStepper::appendReply(F("read: "));
+    LightningStepper::appendReply((long)launchMode);
+    LightningStepper::sendReply();
+}
+
+void LightningStepper::startUpAuto()
+{
+    LightningStepper::sendMessage(F("Auto setup initiated. Please specify: minDelay,maxDelay,currentPosition,MaxPosition"));
+
+    //Process msg settings
+    LightningStepper::processSettings(LightningStepper::readMessage());
+
+    LightningStepper::beginReply();
+    LightningStepper::appendReply(F("Recieved minDelay: "));
+    LightningStepper::appendReply((long)minDelayInt);
+    LightningStepper::appendReply(F(" maxDelay: "));
+    LightningStepper::appendReply((long)maxDelayInt);
+    LightningStepper::appendReply(F(" currentPosition: "));
+    LightningStepper::appendReply((long)currentPositionInt);
+    LightningStepper::appendReply(F(" maxPosition: "));
+    LightningStepper::appendReply((long)maxPositionInt);
+    LightningStepper::sendReply();
+}
+
+void LightningStepper::startUpManually()
+{
+
+    LightningStepper::sendMessage(F("Manual setup initiated. Please specify: minDelay,maxDelay"));
+
+    //--Process min and max delay setting
+    const char* cursor = LightningStepper::readMessage();
+    minDelayInt = LightningStepper::nextField(cursor);
+    maxDelayInt = LightningStepper::nextField(cursor);
+    LightningStepper::updateDelayRange();
+
+    LightningStepper::beginReply();
+    LightningStepper::appendReply(F("Recieved minDelay: "));
+    LightningStepper::appendReply((long)minDelayInt);
+    LightningStepper::appendReply(F(" maxDelay: "));
+    LightningStepper::appendReply((long)maxDelayInt);
+    LightningStepper::sendReply();
+    
+
+    //--Set the ccw stop    
+    LightningStepper::sendMessage(F("Type 'Go' to move. To stop, drive the pin_CmdReady low (or send any message without it) thus setting the zero position"));
+    //Wait for go    
+    LightningStepper::waitForMessage("Go");
+
+    //Wait for CmdReady pin. Stop and set zero
+    keepWaiting = true;
+    while (keepWaiting == true)
+    {
+        if (LightningStepper::stopSignaled() == true)
+        {
+            LightningStepper::sendMessage(F("The zero position has been set"));
+            LightningStepper::sendMessage(F("Type 'Go' to move. To stop, drive the pin_CmdReady low (or send any message without it) thus setting the max position"));
+            currentPositionInt = 0;
+            keepWaiting = false;
+        }
+        else
+        {
+            //Modulate stepper
+            LightningStepper::stepCCW();
+            delayMicroseconds(3000);
+        }
+    }
+    //Wait for go
+    LightningStepper::waitForMessage("Go");
+
+    //--Set the cw stop aka max position
+    //Wait for pin 30. Stop and set maxposition
+    keepWaiting = true;
+    while (keepWaiting == true)
+    {
+        if (LightningStepper::stopSignaled() == true)
+        {
+            maxPositionInt = currentPositionInt;
+            LightningStepper::beginReply();
+            LightningStepper::appendReply(F("Max position: "));
+            LightningStepper::appendReply((long)maxPositionInt);
+            LightningStepper::sendReply();
+            //Move one step so its not right on max
+            LightningStepper::stepCCW();
+            currentPositionInt--;
+            keepWaiting = false;
+        }
+        else
+        {
+            //Modulate stepper
+            LightningStepper::stepCW();
+            currentPositionInt++;
+            delayMicroseconds(3000);
+        }
+    }    
+}
+
+void LightningStepper::startUpHoming()
+{
+    LightningStepper::sendMessage(F("Homing setup initiated. Please specify: minDelay,maxDelay,speed,maxPosition (maxPosition is only used without a max switch)"));
+
+    //Chunks in order: minDelay,maxDelay,speed,maxPosition
+    const char* cursor = LightningStepper::readMessage();
+    minDelayInt = LightningStepper::nextField(cursor);
+    maxDelayInt = LightningStepper::nextField(cursor);
+    LightningStepper::updateDelayRange();
+    int speed = LightningStepper::nextField(cursor);
+    maxPositionInt = LightningStepper::nextField(cursor);
+
+    //Home and wait for it to finish. Nothing else needs the board during setup.
+    LightningStepper::startHoming(speed);
+    while (done == false)
+    {
+        LightningStepperTimer::poll();
+    }
+    homingFinished = false;
+    LightningStepper::reportHoming();
+}
+
+//This method listens for commands and runs the stepper motor.
+void LightningStepper::run()
+{
+    //Check the pin for if there is a msg to read or not. This is way faster than checking the serial input. 
+    //With an interrupt on the pin there is only a flag to check. Without the pin the commands are sequenced and acknowledged instead.
+    if (awaitingCmd == false && pin_CmdReady >= 0)
+    {
+        if (cmdReadyInterrupt == true)
+        {
+            //Only cleared once it has been seen set. Clearing it every time would lose an edge that lands between the read and the clear.
+            pin_CmdReady_Value = 1;
+            if (cmdReadyFlag == true)
+            {
+                cmdReadyFlag = false;
+                pin_CmdReady_Value = 0;
+            }
+        }
+        else
+        {
+            pin_CmdReady_Value = digitalRead(pin_CmdReady);
+        }
+        if (pin_CmdReady_Value == 0)
+        {
+            //The serial input is ready. Note this pin is configured as input_Pullup
+            //Let the command controller know that the stepper controller has started processing.
+            //The command controller will then start the serial transmission
+            LightningStepper::writePin(pin_Processing, HIGH);
+            awaitingCmd = true;
+#if defined(LIGHTNINGSTEPPER_BENCHMARK)
+            //The command can be for any axis so each one times its own latency
+            for (uint8_t i = 0; i < axisCount; i++)
+            {
+                axes[i]->bench.markCmdReady();
+            }
+#endif
+        }
+    }
+
+    //Parse whatever part of the command has arrived. The motor keeps stepping while the rest of it is on the way.
+    SerialFrame frame = LightningStepper::pollSerial();
+    if (frame != NoFrame)
+    {
+#if defined(LIGHTNINGSTEPPER_BENCHMARK)
+        unsigned long cmdStart = micros();
+        LightningStepper::processCmd(frame);
+        bench.recordCmdCost(micros() - cmdStart);
+#else
+        LightningStepper::processCmd(frame);
+#endif
+    }
+
+    //Homing runs in the step timer. Report how it went once it finishes.
+    if (homingFinished == true)
+    {
+        homingFinished = false;
+        for (uint8_t i = 0; i < axisCount; i++)
+        {
+            if (axes[i]->homingResult != HomeNone)
+            {
+                axes[i]->reportHoming();
+            }
+        }
+    }
+
+    //Save the position once every axis has sat stopped for LIGHTNINGSTEPPER_STORAGE_DELAY. EEPROM writes are slow so they are kept out of the step timer and go out a byte at a time.
+    //Waiting out the delay keeps a run of moves with short stops between them from wearing the EEPROM with a record per stop.
+    if (persistent == true)
+    {
+        if (storageClean == false)
+        {
+            if (LightningStepper::allAxesDone() == false || scriptRunning == true)
+            {
+                storageSince = millis();
+            }
+            else if (millis() - storageSince >= LIGHTNINGSTEPPER_STORAGE_DELAY)
+            {
+                LightningStepper::saveSettings();
+            }
+        }
+        LightningStepperStorage::service();
+    }
+    //A script saved with Cmd 21 goes out the same way
+    LightningStepperScript::service();
+
+    //Push status frames for the axes that asked for them. The motor keeps stepping while they go out.
+    if (telemetryAxes > 0)
+    {
+        LightningStepper::sendTelemetry();
+    }
+
+    //Release the coils once every axis has sat done for the idle timeout, then sleep between commands if asked to
+    if (idleMillis != 0)
+    {
+        if (coilsIdle == true)
+        {
+            if (sleepWhenIdle == true)
+            {
+                LightningStepper::sleepUntilCmd();
+            }
+        }
+        else if (LightningStepper::allAxesDone() == false || scriptRunning == true)
+        {
+            //A script holds the motor between its moves
+            idleSince = millis();
+        }
+        else if (millis() - idleSince >= idleMillis)
+        {
+            LightningStepper::enterIdle();
+        }
+    }
+
+    //Carry on with the script. It hands back whenever it has to wait.
+    if (scriptRunning == true)
+    {
+        LightningStepper::runScript();
+    }
+
+    //Plan the S-curve of the next queued move of each axis once the one before it has started, so the step timer never works out a table
+    for (uint8_t i = 0; i < axisCount; i++)
+    {
+        axes[i]->prepareSCurve();
+    }
+
+    //The step timer modulates the stepper in the background.
+    //Boards without a hardware step timer are serviced here instead.
+    LightningStepperTimer::poll();
+}
+
+//Sleep until an interrupt. Serial receive, pin_CmdReady, millis(), and the hold chopping all wake it. run() comes straight back here if there is nothing to do.
+//Without an interrupt on pin_CmdReady the millis() interrupt still wakes it every millisecond to poll the pin.
+void LightningStepper::sleepUntilCmd()
+{
+#if defined(__AVR__)
+    if (awaitingCmd == true)
+    {
+        return;
+    }
+#if defined(LIGHTNINGSTEPPER_BENCHMARK)
+    unsigned long sleepStart = micros();
+#endif
+    //Idle sleep keeps the timers and the serial port running
+    set_sleep_mode(SLEEP_MODE_IDLE);
+    //Check with interrupts off so a command that arrives in between cannot be slept through.
+    //sei() lets one more instruction run before any interrupt so the sleep always starts.
+    cli();
+    if (cmdReadyFlag == false && port->available() == 0)
+    {
+        sleep_enable();
+        sei();
+        sleep_cpu();
+        sleep_disable();
+    }
+    sei();
+#if defined(LIGHTNINGSTEPPER_BENCHMARK)
+    unsigned long slept = micros() - sleepStart;
+    for (uint8_t i = 0; i < axisCount; i++)
+    {
+        axes[i]->bench.recordSleep(slept);
+    }
+#endif
+#endif
+}
+
+void LightningStepper::processSettings(const char* cursor) 
+{
+    //Chunks in order: minDelay,maxDelay,currentPosition,maxPosition
+    minDelayInt = LightningStepper::nextField(cursor);
+    maxDelayInt = LightningStepper::nextField(cursor);
+    currentPositionInt = LightningStepper::nextField(cursor);
+    maxPositionInt = LightningStepper::nextField(cursor);
+    LightningStepper::updateDelayRange();
+}
+
+void LightningStepper::processCmd(SerialFrame frame)
+{
+    /*
+        Commands:
+        Cmd 1-get the motor's details.        Send: 1                           Replies: Strike(Settings: currentPosition,maxPosition,currentDelay,minDelay,maxDelay)
+        Cmd 2-move to position.               Send: 2,speed,steps,direction     Replies:
+        Cmd 3 stop.                           Send: 3                           Replies:
+        Cmd 4-queue a move.                   Send: 4,speed,steps,direction     Replies: Strike(SC Error: queue full) only if the queue is full
+        Cmd 5-queue depth.                    Send: 5                           Replies: Strike(Queue: depth,capacity)
+        Cmd 6-benchmark report.               Send: 6                           Replies: Strike(Bench: ...) See LightningStepperBench.h. Only with LIGHTNINGSTEPPER_BENCHMARK
+        Cmd 7-clear the benchmark.            Send: 7                           Replies:
+        Cmd 8-set an axis's settings.         Send: 8,minDelay,maxDelay,currentPosition,maxPosition     Replies:
+        Cmd 9-coordinated move.               Send: 9,speed,delta0,delta1,...   Replies:
+        Cmd 10-move to an absolute position.  Send: 10,speed,position           Replies:
+        Cmd 11-home with the limit switches.  Send: 11,speed                    Replies: Strike(Homed: axis,currentPosition,maxPosition) when it finishes
+        Cmd 12-step mode.                     Send: 12,mode                     Replies:
+        Cmd 13-status.                        Send: 13                          Replies: Strike(Status: axis,currentPosition,velocity,state,queueDepth)
+        Cmd 14-telemetry.                     Send: 14,intervalMillis,format    Replies: the Cmd 13 status every intervalMillis
+        Cmd 15-baud rate.                     Send: 15,baud                     Replies: Strike(Baud: baud) at the old rate, then switches
+        Cmd 16-sequence reset.                Send: seq#16                      Replies: Strike(ACK seq). Sequenced commands carry on from seq.
+        Cmd 17-hold.                          Send: 17                          Replies:
+        Cmd 18-sync start.                    Send: 18                          Replies:
+        Cmd 19-write the script.              Send: 19,offset,byte,byte,...     Replies: Strike(SC Error: script too long) only if it does not fit, Strike(SC Error: script saving) while Cmd 21 is writing
+        Cmd 20-run the script.                Send: 20                          Replies: pin_Done goes high when it finishes
+        Cmd 21-save the script to EEPROM.     Send: 21                          Replies:
+        Cmd 22-speed profile.                 Send: 22,profile                  Replies:
+
+        Notes:
+        Speed is [0-100]   1 the slowest. 100 the fastest. 
+        Direction 1=cw currentPosition increases, 2=ccw currentPosition decreases
+        Moves are clamped to [0, maxPosition] when they start. Cmd 10 works out the direction and steps itself.
+        Cmd 1 stops the motor. Cmd 13 does not. Velocity is steps per second, positive cw. State 0 done, 1 moving, 2 homing, 3 following. Cmd 14 format 0 is text and 1 binary. Interval 0 turns it off.
+        Cmd 12 mode is 0 full step, 1 half step, 2 wave drive. Positions are in steps of the current mode and are rescaled when it changes. A change sent while moving waits for the running and queued moves.
+        Moves also end when the limit switch in the direction of travel closes. Cmd 11 needs at least a min switch. The speed must be one the motor can start at since homing does not ramp.
+        Queued moves start the moment the move before them finishes. Cmd 2 and Cmd 3 clear the queue.
+        The same commands can be sent as binary frames. See LightningStepperProtocol.h
+        Commands go to axis 0 unless the axis number and a colon come first. Ex: 1:2,100,400,1 moves axis 1. Binary frames use the address byte for the axis.
+        pin_Done is high once every axis is done.
+        Cmd 9 deltas are signed steps for axis 0, 1, 2... in order. Positive is cw. The axes arrive together and speed is measured along the line.
+        Commands are parsed as their bytes arrive from run() so the motor keeps moving while a command is received.
+        A sequence number and # in front of a command ask for an ACK. Ex: 17#1:2,100,400,1 Replies: Strike(ACK 17) before any reply of the command itself,
+        or Strike(NAK expected,reason) and the command does not run. Reason 1 out of order, 3 queue full, 4 no such axis. Resend from expected. A duplicate is ACKed but not run again.
+        Sequenced commands can be sent at any time so pin_CmdReady, pin_Done and pin_Processing can be left out (-1). Cmd 13 status takes the place of pin_Done.
+        On a shared bus a node number and slash come first. Ex: 3/1:2,100,400,1 moves axis 1 of node 3. Without one the command is for node 0. Node 15 is a broadcast that every node runs and none replies to.
+        Cmd 17 makes Cmd 4 moves wait in the queue when the axis is done, for every axis of the node. Cmd 18 ends the hold and starts them. Ex: 15/17, then Cmd 4 to each node, then 15/18 starts every node at once.
+        Scripts are bytecode, see LightningStepperScript.h. Cmd 19 at offset 0 starts a new one and writing stops one that is running. Cmd 1 and Cmd 3 stop it. Cmd 13 state is 4 while a script runs between moves.
+        A script saved with Cmd 21 is loaded again at power up. It is written a byte per run() call and takes about a quarter second. Cmd 19 waits for it.
+        Cmd 22 profile is 0 trapezoid, 1 S-curve. It applies from the next move that starts from a stop. The S-curve needs LIGHTNINGSTEPPER_SCURVE.
+
+        pin_Processing:
+        Low to High: stepper controller ready for a message/cmd
+        High to Low: stepper controller processed message and ready for another interupt from pin_CmdReady
+    */
+
+    if (frame == TextFrame)
+    {
+        //remove the Message() block. Ignore anything that is not a whole block.
+        const char* cursor = LightningStepper::cleanMsg(lineBuffer);
+        if (cursor != 0)
+        {
+            //An optional sequence number and # ask for an ACK. Ex: 17#2,100,400,1
+            bool sequenced = false;
+            uint8_t sequence = 0;
+            const char* hash = strchr(cursor, '#');
+            if (hash != 0)
+            {
+                sequenced = true;
+                sequence = (uint8_t)atoi(cursor);
+                cursor = hash + 1;
+            }
+            //An optional node number and slash pick the stepper controller on a shared bus. Ex: 3/1:2,100,400,1
+            long node = 0;
+            const char* slash = strchr(cursor, '/');
+            if (slash != 0)
+            {
+                node = LightningStepper::nextField(cursor);
+                cursor = slash + 1;
+            }
+            //An optional axis number and colon pick the motor
+            long axis = 0;
+            const char* colon = strchr(cursor, ':');
+            if (colon != 0)
+            {
+                axis = LightningStepper::nextField(cursor);
+                cursor = colon + 1;
+            }
+            bool valid = (axis >= 0 && axis < axisCount);
+            bool run = (node == nodeId || node == LightningStepperProtocol::broadcastNode);
+            //Nothing is sent for a broadcast so the nodes do not talk over each other. It is not sequenced either.
+            replyMuted = (node == LightningStepperProtocol::broadcastNode);
+            if (run == true && replyMuted == false && sequenced == true)
+            {
+                //Peek at the command number without moving the cursor
+                const char* cmdCursor = cursor;
+                long cmd = LightningStepper::nextField(cmdCursor);
+                uint8_t refusal = 0;
+                if (valid == false)
+                {
+                    refusal = LightningStepperProtocol::nakNoAxis;
+                }
+                else if (cmd == 4 && axes[axis]->queueCount >= LIGHTNINGSTEPPER_QUEUE_DEPTH)
+                {
+                    refusal = LightningStepperProtocol::nakBusy;
+                }
+                run = LightningStepper::acceptSequence(sequence, cmd == 16, refusal, false, (uint8_t)axis);
+            }
+            if (run == true)
+            {
+                if (valid == true)
+                {
+                    axes[axis]->processTextCmd(cursor);
+                }
+                else
+                {
+                    LightningStepper::sendMessage(F("SC Error: no such axis"));
+                }
+            }
+            replyMuted = false;
+        }
+    }
+    else if (frame == BinaryFrame)
+    {
+        //The address byte is the node and the axis. Frames for other nodes are skipped. A frame for an axis that does not exist is NAKed if it is sequenced and dropped if not.
+        uint8_t node = frameDecoder.address >> 4;
+        uint8_t axis = frameDecoder.address & 0x0F;
+        bool valid = (axis < axisCount);
+        bool run = (node == nodeId || node == LightningStepperProtocol::broadcastNode);
+        replyMuted = (node == LightningStepperProtocol::broadcastNode);
+        if (run == true && replyMuted == false && frameDecoder.sequenced == true)
+        {
+            uint8_t refusal = 0;
+            if (valid == false)
+            {
+                refusal = LightningStepperProtocol::nakNoAxis;
+            }
+            else if (frameDecoder.opcode == LightningStepperProtocol::opQueueMove && axes[axis]->queueCount >= LIGHTNINGSTEPPER_QUEUE_DEPTH)
+            {
+                refusal = LightningStepperProtocol::nakBusy;
+            }
+            run = LightningStepper::acceptSequence(frameDecoder.sequence, frameDecoder.opcode == LightningStepperProtocol::opSequenceReset, refusal, true, axis);
+        }
+        if (run == true && valid == true)
+        {
+            axes[axis]->processBinaryCmd(frameDecoder);
+        }
+        replyMuted = false;
+    }
+    else if (frame == BadSequencedFrame && (frameDecoder.address >> 4) == nodeId)
+    {
+        //The sequence number may be what got corrupted so ask for everything from the one expected
+        LightningStepper::sendAcknowledgement(false, expectedSequence, LightningStepperProtocol::nakBadCrc, true, frameDecoder.address);
+    }
+    //A bad frame is dropped. The command controller can check pin_Done or ask for the settings to find out nothing happened.
+
+    if (awaitingCmd == true)
+    {
+        //The command controller cannot interupt yet with the CmdReady pin.
+        //Let the command controller know that the stepper controller is finished processing
+        awaitingCmd = false;
+        LightningStepper::writePin(pin_Processing, LOW);
+    }
+}
+
+//Go-back-N flow control for sequenced commands. Returns true when the command should run.
+//Commands only run in order. A duplicate is ACKed again so a lost ACK does not stall the command controller, and anything past a gap is NAKed.
+//refusal is the NAK reason when the command cannot be taken, or 0 when it can.
+bool LightningStepper::acceptSequence(uint8_t sequence, bool reset, uint8_t refusal, bool binary, uint8_t address)
+{
+    if (reset == true)
+    {
+        expectedSequence = sequence;
+    }
+    if (sequence == expectedSequence)
+    {
+        if (refusal != 0)
+        {
+            //Not counted so the retransmit is taken once there is room, or the next command takes the sequence number of one for an axis that does not exist
+            LightningStepper::sendAcknowledgement(false, sequence, refusal, binary, address);
+            return false;
+        }
+        expectedSequence++;
+        LightningStepper::sendAcknowledgement(true, sequence, 0, binary, address);
+        return true;
+    }
+    //Up to half the sequence space behind is a duplicate. Anything else is ahead of a lost command.
+    uint8_t behind = expectedSequence - sequence;
+    if (behind <= 128)
+    {
+        LightningStepper::sendAcknowledgement(true, sequence, 0, binary, address);
+    }
+    else
+    {
+        LightningStepper::sendAcknowledgement(false, expectedSequence, LightningStepperProtocol::nakOutOfOrder, binary, address);
+    }
+    return false;
+}
+
+//ACK replies carry the sequence number. NAK replies carry the sequence number expected and the reason.
+void LightningStepper::sendAcknowledgement(bool ack, uint8_t sequence, uint8_t reason, bool binary, uint8_t address)
+{
+    if (binary == true)
+    {
+        uint8_t reply[2];
+        reply[0] = sequence;
+        reply[1] = reason;
+        LightningStepper::sendFrame(address, ack ? LightningStepperProtocol::opAck : LightningStepperProtocol::opNak, reply, ack ? 1 : 2);
+    }
+    else
+    {
+        LightningStepper::beginReply();
+        if (ack == true)
+        {
+            LightningStepper::appendReply(F("ACK "));
+        }
+        else
+        {
+            LightningStepper::appendReply(F("NAK "));
+        }
+        LightningStepper::appendReply((long)sequence);
+        if (ack == false)
+        {
+            LightningStepper::appendReply(',');
+            LightningStepper::appendReply((long)reason);
+        }
+        LightningStepper::sendReply();
+    }
+}
+
+//Runs on the axis the command is for
+void LightningStepper::processTextCmd(const char* cursor)
+{
+    //Process cmd
+    //Either a single digit or digits with commas. The first chunk is the cmd
+    cmdMarkInt = LightningStepper::nextField(cursor);
+
+    //Analyze cmdMark and Determine if further processing is needed
+    //cmds marks
+    //1: get motors details
+    //2: move to postition
+    //3: stop
+    //4: queue a move
+    //5: queue depth
+    //6: benchmark report
+    //7: clear the benchmark
+    //8: set the axis's settings
+    //9: coordinated move
+    //10: move to an absolute position
+    //11: home
+    //12: step mode
+    //13: status
+    //14: telemetry
+    //15: baud rate
+    //16: sequence reset
+    //17: hold
+    //18: sync start
+    //19: write the script
+    //20: run the script
+    //21: save the script
+    //22: speed profile
+    if (cmdMarkInt == 1)
+    {
+        scriptRunning = false;
+        //Reply with motor details
+        LightningStepper::beginReply();
+        LightningStepper::appendReply(F("Settings: "));
+        LightningStepper::appendReply((long)currentPositionInt);
+        LightningStepper::appendReply(',');
+        LightningStepper::appendReply((long)maxPositionInt);
+        LightningStepper::appendReply(',');
+        LightningStepper::appendReply((long)minDelayInt);
+        LightningStepper::appendReply(',');
+        LightningStepper::appendReply((long)maxDelayInt);
+        LightningStepper::sendReply();
+        LightningStepper::stopMove();
+    }
+    else if (cmdMarkInt == 2)
+    {
+        //Move to position
+        //Chunks in order: speed,steps,direction
+        int speed = LightningStepper::nextField(cursor);
+        int steps = LightningStepper::nextField(cursor);
+        int direction = LightningStepper::nextField(cursor);
+        LightningStepper::startMove(speed, steps, direction);
+    }
+    else if (cmdMarkInt == 3)
+    {
+        //Stop. The script too.
+        scriptRunning = false;
+        LightningStepper::stopMove();
+    }
+    else if (cmdMarkInt == 4)
+    {
+        //Queue a move
+        //Chunks in order: speed,steps,direction
+        int speed = LightningStepper::nextField(cursor);
+        int steps = LightningStepper::nextField(cursor);
+        int direction = LightningStepper::nextField(cursor);
+        if (LightningStepper::queueMove(speed, steps, direction) == false)
+        {
+            LightningStepper::sendMessage(F("SC Error: queue full"));
+        }
+    }
+    else if (cmdMarkInt == 5)
+    {
+        //Reply with the queue depth
+        LightningStepper::sendQueueStatus(false, 0);
+    }
+#if defined(LIGHTNINGSTEPPER_BENCHMARK)
+    else if (cmdMarkInt == 6)
+    {
+        LightningStepper::sendBenchReport();
+    }
+    else if (cmdMarkInt == 7)
+    {
+        bench.reset();
+    }
+#endif
+    else if (cmdMarkInt == 8)
+    {
+        //Chunks in order: minDelay,maxDelay,currentPosition,maxPosition
+        LightningStepper::stopMove();
+        LightningStepper::processSettings(cursor);
+        storageClean = false;
+    }
+    else if (cmdMarkInt == 9)
+    {
+        //Chunks in order: speed,delta0,delta1,... Missing deltas are 0
+        int speed = LightningStepper::nextField(cursor);
+        int deltas[LIGHTNINGSTEPPER_MAX_AXES];
+        for (uint8_t i = 0; i < LIGHTNINGSTEPPER_MAX_AXES; i++)
+        {
+            deltas[i] = LightningStepper::nextField(cursor);
+        }
+        LightningStepper::startCoordinatedMove(speed, deltas, LIGHTNINGSTEPPER_MAX_AXES);
+    }
+    else if (cmdMarkInt == 10)
+    {
+        //Chunks in order: speed,position
+        int speed = LightningStepper::nextField(cursor);
+        int position = LightningStepper::nextField(cursor);
+        LightningStepper::moveTo(speed, position);
+    }
+    else if (cmdMarkInt == 11)
+    {
+        if (minSwitch.isAttached() == true)
+        {
+            LightningStepper::startHoming(LightningStepper::nextField(cursor));
+        }
+        else
+        {
+            LightningStepper::sendMessage(F("SC Error: no limit switch"));
+        }
+    }
+    else if (cmdMarkInt == 12)
+    {
+        //Chunks in order: mode. 0 full step, 1 half step, 2 wave drive
+        long mode = LightningStepper::nextField(cursor);
+        if (mode >= FullStep && mode <= WaveDrive)
+        {
+            LightningStepper::requestStepMode((uint8_t)mode);
+        }
+        else
+        {
+            LightningStepper::sendMessage(F("SC Error: bad step mode"));
+        }
+    }
+    else if (cmdMarkInt == 13)
+    {
+        //Reply with the status without stopping the motor
+        LightningStepper::sendStatus(false);
+    }
+    else if (cmdMarkInt == 14)
+    {
+        //Chunks in order: intervalMillis,format. Format 0 text, 1 binary
+        long interval = LightningStepper::nextField(cursor);
+        long format = LightningStepper::nextField(cursor);
+        LightningStepper::setTelemetry((interval > 0 && interval <= 65535) ? (unsigned int)interval : 0, format == 1);
+    }
+    else if (cmdMarkInt == 15)
+    {
+        //Chunks in order: baud
+        LightningStepper::changeBaudRate((unsigned long)LightningStepper::nextField(cursor), false, 0);
+    }
+    else if (cmdMarkInt == 16)
+    {
+        //Sequence reset. processCmd already took its sequence number and ACKed it.
+    }
+    else if (cmdMarkInt == 17)
+    {
+        //Hold the queued moves of every axis until a sync start
+        syncHold = true;
+    }
+    else if (cmdMarkInt == 18)
+    {
+        LightningStepper::syncStart();
+    }
+    else if (cmdMarkInt == 19)
+    {
+        //Chunks in order: offset,byte,byte,... Offset 0 starts a new script.
+        uint8_t offset = (uint8_t)LightningStepper::nextField(cursor);
+        uint8_t data[LIGHTNINGSTEPPER_SCRIPT_SIZE];
+        uint8_t count = 0;
+        while (*cursor != '\0' && count < sizeof(data))
+        {
+            data[count] = (uint8_t)LightningStepper::nextField(cursor);
+            count++;
+        }
+        LightningStepper::writeScript(offset, data, count, false);
+    }
+    else if (cmdMarkInt == 20)
+    {
+        LightningStepper::startScript();
+    }
+    else if (cmdMarkInt == 21)
+    {
+        LightningStepperScript::save();
+    }
+    else if (cmdMarkInt == 22)
+    {
+        //Chunks in order: profile. 0 trapezoid, 1 S-curve
+        long profile = LightningStepper::nextField(cursor);
+        if (profile >= Trapezoid && profile <= lastProfile)
+        {
+            speedProfile = (SpeedProfile)profile;
+        }
+        else
+        {
+            LightningStepper::sendMessage(F("SC Error: bad profile"));
+        }
+    }
+}
+
+//Runs on the axis the frame is addressed to
+void LightningStepper::processBinaryCmd(const LightningStepperFrameDecoder& frame)
+{
+    //pollSerial already decoded the frame and checked its CRC
+    const uint8_t* payload = frame.payload;
+    switch (frame.opcode)
+    {
+    case LightningStepperProtocol::opGetSettings:
+    {
+        //Reply with motor details
+        uint8_t reply[8];
+        LightningStepperProtocol::putUInt16(&reply[0], (uint16_t)currentPositionInt);
+        LightningStepperProtocol::putUInt16(&reply[2], (uint16_t)maxPositionInt);
+        LightningStepperProtocol::putUInt16(&reply[4], (uint16_t)minDelayInt);
+        LightningStepperProtocol::putUInt16(&reply[6], (uint16_t)maxDelayInt);
+        LightningStepper::sendFrame(frame.address, LightningStepperProtocol::opGetSettings | LightningStepperProtocol::replyFlag, reply, sizeof(reply));
+        scriptRunning = false;
+        LightningStepper::stopMove();
+        break;
+    }
+    case LightningStepperProtocol::opMove:
+        if (frame.length >= 4)
+        {
+            LightningStepper::startMove(payload[0], LightningStepperProtocol::getUInt16(&payload[1]), payload[3]);
+        }
+        break;
+    case LightningStepperProtocol::opStop:
+        scriptRunning = false;
+        LightningStepper::stopMove();
+        break;
+    case LightningStepperProtocol::opQueueMove:
+        if (frame.length >= 4)
+        {
+            if (LightningStepper::queueMove(payload[0], LightningStepperProtocol::getUInt16(&payload[1]), payload[3]) == false)
+            {
+                //Full. Reply with the queue status so the command controller knows the move was not added.
+                LightningStepper::sendQueueStatus(true, frame.address);
+            }
+        }
+        break;
+    case LightningStepperProtocol::opQueueStatus:
+        LightningStepper::sendQueueStatus(true, frame.address);
+        break;
+    case LightningStepperProtocol::opMoveTo:
+        if (frame.length >= 3)
+        {
+            LightningStepper::moveTo(payload[0], (int16_t)LightningStepperProtocol::getUInt16(&payload[1]));
+        }
+        break;
+    case LightningStepperProtocol::opHome:
+        if (frame.length >= 1 && minSwitch.isAttached() == true)
+        {
+            LightningStepper::startHoming(payload[0]);
+        }
+        break;
+    case LightningStepperProtocol::opStatus:
+        LightningStepper::sendStatus(true);
+        break;
+    case LightningStepperProtocol::opTelemetry:
+        if (frame.length >= 3)
+        {
+            LightningStepper::setTelemetry(LightningStepperProtocol::getUInt16(&payload[0]), payload[2] == 1);
+        }
+        break;
+    case LightningStepperProtocol::opBaudRate:
+        if (frame.length >= 4)
+        {
+            LightningStepper::changeBaudRate(LightningStepperProtocol::getUInt32(&payload[0]), true, frame.address);
+        }
+        break;
+    case LightningStepperProtocol::opSequenceReset:
+        //processCmd already took its sequence number and ACKed it
+        break;
+    case LightningStepperProtocol::opScriptWrite:
+        if (frame.length >= 1)
+        {
+            LightningStepper::writeScript(payload[0], &payload[1], frame.length - 1, true);
+        }
+        break;
+    case LightningStepperProtocol::opScriptRun:
+        LightningStepper::startScript();
+        break;
+    case LightningStepperProtocol::opScriptSave:
+        LightningStepperScript::save();
+        break;
+    case LightningStepperProtocol::opSpeedProfile:
+        if (frame.length >= 1 && payload[0] <= lastProfile)
+        {
+            speedProfile = (SpeedProfile)payload[0];
+        }
+        break;
+    case LightningStepperProtocol::opHold:
+        syncHold = true;
+        break;
+    case LightningStepperProtocol::opSyncStart:
+        LightningStepper::syncStart();
+        break;
+    case LightningStepperProtocol::opStepMode:
+        if (frame.length >= 1 && payload[0] <= WaveDrive)
+        {
+            LightningStepper::requestStepMode(payload[0]);
+        }
+        break;
+    case LightningStepperProtocol::opCoordinatedMove:
+        if (frame.length >= 1)
+        {
+            int deltas[LIGHTNINGSTEPPER_MAX_AXES];
+            uint8_t count = (frame.length - 1) / 2;
+            if (count > LIGHTNINGSTEPPER_MAX_AXES)
+            {
+                count = LIGHTNINGSTEPPER_MAX_AXES;
+            }
+            for (uint8_t i = 0; i < count; i++)
+            {
+                deltas[i] = (int16_t)LightningStepperProtocol::getUInt16(&payload[1 + (2 * i)]);
+            }
+            LightningStepper::startCoordinatedMove(payload[0], deltas, count);
+        }
+        break;
+    case LightningStepperProtocol::opSetSettings:
+        if (frame.length >= 8)
+        {
+            LightningStepper::stopMove();
+            minDelayInt = LightningStepperProtocol::getUInt16(&payload[0]);
+            maxDelayInt = LightningStepperProtocol::getUInt16(&payload[2]);
+            currentPositionInt = (int16_t)LightningStepperProtocol::getUInt16(&payload[4]);
+            maxPositionInt = (int16_t)LightningStepperProtocol::getUInt16(&payload[6]);
+            LightningStepper::updateDelayRange();
+            storageClean = false;
+        }
+        break;
+    }
+}
+
+#if defined(LIGHTNINGSTEPPER_BENCHMARK)
+//Reply with the step timing captured since the last clear
+void LightningStepper::sendBenchReport()
+{
+    const char* modeName = "HalfStep";
+    if (stepMode == FullStep)
+    {
+        modeName = "FullStep";
+    }
+    else if (stepMode == WaveDrive)
+    {
+        modeName = "WaveDrive";
+    }
+    LightningStepper::beginReply();
+    bench.report(*port, modeName);
+    LightningStepper::sendReply();
+}
+#endif
+
+//Reply with where the axis is, how fast it is going, and what it is doing. Unlike Cmd 1 the motor keeps moving.
+//Velocity is in steps per second, positive cw. State is a MotionState.
+void LightningStepper::sendStatus(bool binary)
+{
+    //The step timer changes these so take them together
+    noInterrupts();
+    int position = currentPositionInt;
+    uint8_t queueDepth = queueCount;
+    MotionState state = StateDone;
+    if (homingPhase != HomeIdle)
+    {
+        state = StateHoming;
+    }
+    else if (following == true)
+    {
+        state = StateFollowing;
+    }
+    else if (done == false)
+    {
+        state = StateMoving;
+    }
+    else if (scriptRunning == true)
+    {
+        state = StateScript;
+    }
+    interrupts();
+    long velocity = LightningStepper::stepRate();
+
+    if (binary == true)
+    {
+        if (velocity > 32767)
+        {
+            velocity = 32767;
+        }
+        else if (velocity < -32767)
+        {
+            velocity = -32767;
+        }
+        uint8_t reply[6];
+        LightningStepperProtocol::putUInt16(&reply[0], (uint16_t)position);
+        LightningStepperProtocol::putUInt16(&reply[2], (uint16_t)(int16_t)velocity);
+        reply[4] = state;
+        reply[5] = queueDepth;
+        LightningStepper::sendFrame(axisId, LightningStepperProtocol::opStatus | LightningStepperProtocol::replyFlag, reply, sizeof(reply));
+    }
+    else
+    {
+        LightningStepper::beginReply();
+        LightningStepper::appendReply(F("Status: "));
+        LightningStepper::appendReply((long)axisId);
+        LightningStepper::appendReply(',');
+        LightningStepper::appendReply((long)position);
+        LightningStepper::appendReply(',');
+        LightningStepper::appendReply(velocity);
+        LightningStepper::appendReply(',');
+        LightningStepper::appendReply((long)state);
+        LightningStepper::appendReply(',');
+        LightningStepper::appendReply((long)queueDepth);
+        LightningStepper::sendReply();
+    }
+}
+
+//Signed steps per second right now. Positive is cw. A follower goes at its share of the lead's rate.
+long LightningStepper::stepRate()
+{
+    noInterrupts();
+    bool moving = stepping;
+    unsigned int interval = stepInterval;
+    int8_t sign = positionStep;
+    bool isFollowing = following;
+    interrupts();
+    if (isFollowing == true)
+    {
+        for (uint8_t i = 0; i < axisCount; i++)
+        {
+            if (axes[i]->leading == true)
+            {
+                long leadRate = axes[i]->stepRate();
+                if (leadRate < 0)
+                {
+                    leadRate = -leadRate;
+                }
+                return sign * ((leadRate * followDelta) / coordinatedSteps);
+            }
+        }
+        return 0;
+    }
+    if (moving == false || interval == 0)
+    {
+        return 0;
+    }
+    return sign * (1000000L / interval);
+}
+
+//Turn telemetry on for this axis, or off with an interval of 0. The first frame goes out on the next run().
+void LightningStepper::setTelemetry(unsigned int intervalMillis, bool binary)
+{
+    if (telemetryMillis == 0 && intervalMillis != 0)
+    {
+        telemetryAxes++;
+    }
+    else if (telemetryMillis != 0 && intervalMillis == 0)
+    {
+        telemetryAxes--;
+    }
+    telemetryMillis = intervalMillis;
+    telemetryBinary = binary;
+    telemetryLast = millis() - intervalMillis;
+}
+
+//Called from run(). Sends the status of every axis whose telemetry interval is up.
+void LightningStepper::sendTelemetry()
+{
+    unsigned long now = millis();
+    for (uint8_t i = 0; i < axisCount; i++)
+    {
+        LightningStepper* axis = axes[i];
+        if (axis->telemetryMillis != 0 && now - axis->telemetryLast >= axis->telemetryMillis)
         {
-            LightningStepper::writePinHigh(1);
-            LightningStepper::writePinHigh(2);
-            LightningStepper::writePinLow(3);
-            LightningStepper::writePinLow(4);
-            return;
+            axis->telemetryLast = now;
+            axis->sendStatus(axis->telemetryBinary);
         }
-        if (stepKind == 8)
+    }
+}
+
+//Switch the serial port to a new baud rate. The reply goes out at the old rate so the command controller knows to follow.
+//Only a port the library started itself can change. Bad rates are refused.
+void LightningStepper::changeBaudRate(unsigned long baud, bool binary, uint8_t address)
+{
+    bool owned = (hardwarePort != 0 || defaultPort == true);
+    if (owned == false || baud == 0 || baud > 1000000UL)
+    {
+        if (binary == false)
         {
-            LightningStepper::writePinHigh(1);
-            LightningStepper::writePinHigh(2);
-            LightningStepper::writePinLow(3);
-            LightningStepper::writePinLow(4);
-            return;
+            LightningStepper::sendMessage(F("SC Error: baud rate not changed"));
+        }
+        return;
+    }
+    if (binary == true)
+    {
+        uint8_t reply[4];
+        LightningStepperProtocol::putUInt32(reply, baud);
+        LightningStepper::sendFrame(address, LightningStepperProtocol::opBaudRate | LightningStepperProtocol::replyFlag, reply, sizeof(reply));
+    }
+    else
+    {
+        LightningStepper::beginReply();
+        LightningStepper::appendReply(F("Baud: "));
+        LightningStepper::appendReply((long)baud);
+        LightningStepper::sendReply();
+    }
+    //The reply must be all the way out before the rate changes
+    port->flush();
+    baudRate = baud;
+    LightningStepper::beginPort();
+}
+
+//Reply with how many moves are waiting and how many fit
+void LightningStepper::sendQueueStatus(bool binary, uint8_t address)
+{
+    if (binary == true)
+    {
+        uint8_t reply[2];
+        reply[0] = queueCount;
+        reply[1] = LIGHTNINGSTEPPER_QUEUE_DEPTH;
+        LightningStepper::sendFrame(address, LightningStepperProtocol::opQueueStatus | LightningStepperProtocol::replyFlag, reply, sizeof(reply));
+    }
+    else
+    {
+        LightningStepper::beginReply();
+        LightningStepper::appendReply(F("Queue: "));
+        LightningStepper::appendReply((long)queueCount);
+        LightningStepper::appendReply(',');
+        LightningStepper::appendReply((long)LIGHTNINGSTEPPER_QUEUE_DEPTH);
+        LightningStepper::sendReply();
+    }
+}
+
+//End the hold and start the first queued move of every axis that is done. Sent as a broadcast the nodes on a bus start together.
+void LightningStepper::syncStart()
+{
+    syncHold = false;
+    for (uint8_t i = 0; i < axisCount; i++)
+    {
+        if (axes[i]->done == true && axes[i]->queueCount > 0)
+        {
+            axes[i]->startQueuedMove();
+        }
+    }
+}
+
+//Start the move at the head of the queue on an axis that is done. The rest stay queued behind it.
+void LightningStepper::startQueuedMove()
+{
+    MoveSegment& segment = moveQueue[queueHead];
+    queueHead = (queueHead + 1) % LIGHTNINGSTEPPER_QUEUE_DEPTH;
+    queueCount--;
+    LightningStepper::changeStepMode((StepMode)segment.stepMode);
+    LightningStepper::loadMove(segment.speed, segment.steps, segment.direction);
+    LightningStepper::planSCurve();
+    LightningStepper::markMoving();
+    LightningStepper::startStepping();
+}
+
+//Start a move from either protocol. Replaces any move that is running and clears the queue.
+//pathLength is only set by coordinated moves. Speed is measured along the path so the lead axis steps slower than it would on its own.
+void LightningStepper::startMove(int speed, int steps, int direction, unsigned int pathLength)
+{
+    //A running move is replaced between two steps. The new move takes its first step when the pending one was due so no interval is cut short.
+    unsigned int pending = 1;
+    noInterrupts();
+    if (stepping == true)
+    {
+        long left = (long)(nextStepTime - (scheduleClock - LightningStepperTimer::untilNext()));
+        if (left > 1)
+        {
+            pending = (unsigned int)left;
+        }
+    }
+    interrupts();
+    //The step timer must not step while the move is being replaced
+    LightningStepper::stopStepping();
+    LightningStepper::releaseFollowers();
+    following = false;
+    homingPhase = HomeIdle;
+    queueCount = 0;
+    //A step mode change waiting on the replaced moves happens now
+    LightningStepper::changeStepMode(queuedMode);
+    LightningStepper::loadMove(speed, steps, direction);
+    if (steps > 0 && pathLength > (unsigned int)steps)
+    {
+        unsigned long pathDelay = ((unsigned long)currentDelayInt * pathLength) / (unsigned int)steps;
+        currentDelayInt = (pathDelay > 32767UL) ? 32767 : (int)pathDelay;
+    }
+    LightningStepper::planSCurve();
+    //Must be set before the first step so the followers move with it
+    leading = (pathLength != 0);
+
+    LightningStepper::markMoving();
+    if (pending > firstStepDelay)
+    {
+        firstStepDelay = pending;
+    }
+    //Hand the move to the step timer
+    LightningStepper::startStepping();
+}
+
+//Bookkeeping for the motor starting to move. Used by moves and homing.
+void LightningStepper::markMoving()
+{
+#if defined(LIGHTNINGSTEPPER_BENCHMARK)
+    bench.markMoveStarted();
+#endif
+    //Put the coils back on their phase and give the rotor time to follow before the first step
+    if (LightningStepper::wakeCoils() == true)
+    {
+        firstStepDelay = LIGHTNINGSTEPPER_WAKE_SETTLE;
+#if defined(LIGHTNINGSTEPPER_BENCHMARK)
+        bench.markWakeMove();
+#endif
+    }
+    idleSince = millis();
+    storageSince = idleSince;
+    //The saved position is stale once the motor moves. A power loss before it is saved again means the setup must run.
+    if (storageClean == true)
+    {
+        LightningStepperStorage::markDirty();
+        storageClean = false;
+    }
+    //The stepper controller is not done until it steps the requested amount. It can be interupted before done in the run routine.
+    done = false;
+    //Set the done pin low meaning it is not done 
+    LightningStepper::writePin(pin_Done, LOW);
+}
+
+//Find the limit switches from the step timer. speed is used for the fast seeks.
+void LightningStepper::startHoming(int speed)
+{
+    LightningStepper::stopStepping();
+    LightningStepper::releaseFollowers();
+    following = false;
+    queueCount = 0;
+    LightningStepper::changeStepMode(queuedMode);
+    LightningStepper::calculateDelay(speed);
+    homingTowardMax = false;
+    homingSteps = 0;
+    homingTravel = 0;
+    homingResult = HomeNone;
+    homingPhase = HomeSeekFast;
+    LightningStepper::markMoving();
+    LightningStepper::startStepping();
+}
+
+//Reply with how homing went and forget it
+void LightningStepper::reportHoming()
+{
+    if (homingResult == HomeSucceeded)
+    {
+        LightningStepper::beginReply();
+        LightningStepper::appendReply(F("Homed: "));
+        LightningStepper::appendReply((long)axisId);
+        LightningStepper::appendReply(',');
+        LightningStepper::appendReply((long)currentPositionInt);
+        LightningStepper::appendReply(',');
+        LightningStepper::appendReply((long)maxPositionInt);
+        LightningStepper::sendReply();
+    }
+    else if (homingResult == HomeFailed)
+    {
+        LightningStepper::beginReply();
+        LightningStepper::appendReply(F("SC Error: homing failed "));
+        LightningStepper::appendReply((long)axisId);
+        LightningStepper::sendReply();
+    }
+    homingResult = HomeNone;
+}
+
+//Start a coordinated move. deltas are signed steps for axis 0, 1, 2... Axes with a delta of 0 are left alone.
+void LightningStepper::startCoordinatedMove(int speed, const int* deltas, uint8_t count)
+{
+    if (count > axisCount)
+    {
+        count = axisCount;
+    }
+    //An axis with a step mode change waiting is stopped so the change happens and its delta is in steps of the new mode
+    for (uint8_t i = 0; i < count; i++)
+    {
+        if (deltas[i] != 0 && axes[i]->queuedMode != axes[i]->stepMode)
+        {
+            axes[i]->stopMove();
+        }
+    }
+    //Clamp every axis to its limits up front so neither the lead nor the followers check them per step
+    int clamped[LIGHTNINGSTEPPER_MAX_AXES];
+    for (uint8_t i = 0; i < count; i++)
+    {
+        long room = (deltas[i] > 0) ? (long)axes[i]->maxPositionInt - axes[i]->currentPositionInt : -(long)axes[i]->currentPositionInt;
+        clamped[i] = deltas[i];
+        if ((deltas[i] > 0 && deltas[i] > room) || (deltas[i] < 0 && deltas[i] < room))
+        {
+            clamped[i] = (int)room;
+        }
+        if ((long)clamped[i] * deltas[i] < 0)
+        {
+            //Already past the limit it is heading for
+            clamped[i] = 0;
+        }
+    }
+    deltas = clamped;
+
+    //The lead is the axis with the most steps. The path length is the straight line distance in steps.
+    uint8_t lead = 0;
+    unsigned int leadSteps = 0;
+    unsigned long sumSquares = 0;
+    for (uint8_t i = 0; i < count; i++)
+    {
+        unsigned int magnitude = (deltas[i] < 0) ? -(long)deltas[i] : deltas[i];
+        sumSquares += (unsigned long)magnitude * magnitude;
+        if (magnitude > leadSteps)
+        {
+            leadSteps = magnitude;
+            lead = i;
+        }
+    }
+    if (leadSteps == 0)
+    {
+        return;
+    }
+    //A new coordinated move replaces any that is running
+    for (uint8_t i = 0; i < axisCount; i++)
+    {
+        if (axes[i]->leading == true)
+        {
+            axes[i]->stopMove();
+        }
+    }
+
+    //Take the other axes over before the lead starts stepping them
+    coordinatedSteps = leadSteps;
+    for (uint8_t i = 0; i < count; i++)
+    {
+        LightningStepper* axis = axes[i];
+        if (i == lead || deltas[i] == 0)
+        {
+            continue;
+        }
+        axis->stopStepping();
+        axis->releaseFollowers();
+        axis->queueCount = 0;
+        axis->followDelta = (deltas[i] < 0) ? -(long)deltas[i] : deltas[i];
+        axis->setMoveDirection((deltas[i] < 0) ? 2 : 1);
+        //Start half way so the follower steps are centered between lead steps
+        axis->followError = leadSteps / 2;
+        axis->done = false;
+        axis->following = true;
+    }
+
+    axes[lead]->startMove(speed, leadSteps, (deltas[lead] < 0) ? 2 : 1, integerSqrt(sumSquares));
+}
+
+//Start a move to an absolute position. The target is clamped to [0, maxPosition] and the direction and steps are worked out from where the motor is.
+void LightningStepper::moveTo(int speed, int position)
+{
+    //Hold the motor still while the distance is worked out. A move in the same direction keeps its speed.
+    LightningStepper::stopStepping();
+    following = false;
+    //The position is in steps of the mode the move will run in
+    LightningStepper::changeStepMode(queuedMode);
+    if (position < 0)
+    {
+        position = 0;
+    }
+    else if (position > maxPositionInt)
+    {
+        position = maxPositionInt;
+    }
+    int distance = position - currentPositionInt;
+    if (distance > 0)
+    {
+        LightningStepper::startMove(speed, distance, 1);
+    }
+    else if (distance < 0)
+    {
+        LightningStepper::startMove(speed, -distance, 2);
+    }
+    else
+    {
+        //Already there
+        LightningStepper::stopMove();
+    }
+}
+
+//Add a move to the end of the queue. Starts it right away if the motor is idle. Returns false if the queue is full.
+bool LightningStepper::queueMove(int speed, int steps, int direction)
+{
+    bool queued = true;
+    //The step timer takes moves off the queue so it must not run while one is added
+    noInterrupts();
+    if (done == true && syncHold == false)
+    {
+        interrupts();
+        LightningStepper::startMove(speed, steps, direction);
+    }
+    else if (queueCount < LIGHTNINGSTEPPER_QUEUE_DEPTH)
+    {
+        MoveSegment& segment = moveQueue[(queueHead + queueCount) % LIGHTNINGSTEPPER_QUEUE_DEPTH];
+        segment.speed = speed;
+        segment.steps = steps;
+        segment.direction = direction;
+        segment.stepMode = queuedMode;
+        queueCount++;
+        interrupts();
+        LightningStepper::prepareSCurve();
+    }
+    else
+    {
+        interrupts();
+        queued = false;
+    }
+    return queued;
+}
+
+//Set up the metrics for a move. Used to start a move and by the step timer to chain queued moves.
+void LightningStepper::loadMove(int speed, int steps, int direction)
+{
+    //A move in the same direction as the running move keeps its current speed. Otherwise ramp up from a standing start.
+    bool keepSpeed = (done == false && direction == directionInt);
+    //Clamp to the limits once here so the step loop never has to check them
+    long room = 0;
+    if (direction == 1)
+    {
+        room = (long)maxPositionInt - currentPositionInt;
+    }
+    else if (direction == 2)
+    {
+        room = currentPositionInt;
+    }
+    if (steps > room)
+    {
+        steps = (room > 0) ? (int)room : 0;
+    }
+    //Set all metrics                 
+    speedInt = speed;
+    stepsInt = steps;
+    directionInt = direction;
+    LightningStepper::setMoveDirection(direction);
+    //Turn 0-100 speed into microsecond delay
+    //Calculates and sets the currentDelay used in the modulation loop.
+    LightningStepper::calculateDelay(speedInt);
+    if (keepSpeed == false)
+    {
+        rampDelay = (unsigned long)maxDelayInt << 8;
+        rampStep = 0;
+        //A profile change waits for a standing start so a ramp is never switched halfway
+        moveProfile = speedProfile;
+    }
+    else if ((unsigned int)steps < rampStep)
+    {
+        //Too few steps to ramp down from the current speed. Start slowing down now over the steps there are, which ramps down harder but never stops at speed.
+        rampStep = (unsigned int)steps;
+    }
+}
+
+//Work out the branch free step for a direction. cw backs through the coil sequence and counts up, ccw goes forward and counts down.
+void LightningStepper::setMoveDirection(int direction)
+{
+    if (direction == 1)
+    {
+        movePhaseStep = (8 - phaseIncrement) & 7;
+        positionStep = 1;
+        travelSwitch = &maxSwitch;
+    }
+    else
+    {
+        movePhaseStep = phaseIncrement;
+        positionStep = -1;
+        travelSwitch = &minSwitch;
+    }
+}
+
+//Stop the motor where it is and clear the queue
+void LightningStepper::stopMove()
+{
+    LightningStepper::stopStepping();
+    LightningStepper::releaseFollowers();
+    following = false;
+    homingPhase = HomeIdle;
+    queueCount = 0;
+    LightningStepper::changeStepMode(queuedMode);
+    //Program enters done loop. The user must then apply a voltage to send another cmd
+    done = true;
+    //Set the done pin high once the other axes are done too
+    if (scriptRunning == false && LightningStepper::allAxesDone() == true)
+    {
+        LightningStepper::writePin(pin_Done, HIGH);
+    }
+}
+
+//Switch step mode from a command. Right away if the axis is stopped, otherwise once the moves running and queued before it finish.
+void LightningStepper::requestStepMode(uint8_t mode)
+{
+    noInterrupts();
+    queuedMode = (StepMode)mode;
+    bool stopped = (done == true);
+    interrupts();
+    if (stopped == true)
+    {
+        LightningStepper::changeStepMode(queuedMode);
+    }
+}
+
+//Switch step mode without losing the rotor position. currentPosition and maxPosition are rescaled to steps of the new mode.
+//Full step and wave drive only use the two coil (odd) or one coil (even) phases, so the motor takes one half step onto one first if it is between them.
+//Only called while the axis is not stepping. Also runs in the step timer between queued moves.
+void LightningStepper::changeStepMode(StepMode mode)
+{
+    if (mode == stepMode)
+    {
+        return;
+    }
+    //Work in half steps
+    long position = currentPositionInt;
+    long maxPosition = maxPositionInt;
+    if (stepMode != HalfStep)
+    {
+        position = (2 * position) + halfOffset;
+        maxPosition = (maxPositionInt == derivedMaxPosition) ? halfMaxPosition : (2 * maxPosition) + halfOffset;
+    }
+    derivedMaxPosition = -1;
+    if (mode != HalfStep)
+    {
+        uint8_t parity = (mode == FullStep) ? 1 : 0;
+        if ((coilPhase & 1) != parity)
+        {
+            //Half step toward the middle of the range. cw backs through the coil sequence and counts up.
+            if (position > 0)
+            {
+                coilPhase = (coilPhase + 1) & 7;
+                position--;
+            }
+            else
+            {
+                coilPhase = (coilPhase - 1) & 7;
+                position++;
+            }
+            //Released coils pick the new phase up when they wake
+            if (coilsIdle == false)
+            {
+                coils.write(coilSequence[coilPhase]);
+            }
+        }
+        halfOffset = position & 1;
+        position = (position - halfOffset) / 2;
+        //Rounds down so the limit is never past the half step one
+        halfMaxPosition = (int)maxPosition;
+        maxPosition = (maxPosition - halfOffset) / 2;
+        derivedMaxPosition = (int)maxPosition;
+    }
+    currentPositionInt = (int)position;
+    maxPositionInt = (int)maxPosition;
+    LightningStepper::applyStepMode(mode);
+    //The next move ramps up from a standing start since the step size changed
+    directionInt = 0;
+    storageClean = false;
+}
+
+#pragma endregion Commands
+
+#pragma region Script
+
+//Copy part of a script in from Cmd 19. A script that is running stops first so it never runs half written.
+void LightningStepper::writeScript(uint8_t offset, const uint8_t* data, uint8_t count, bool binary)
+{
+    //Cmd 21 is still writing the script out to EEPROM a byte at a time. Changing it now would save a mix of the two.
+    if (LightningStepperScript::saving() == true)
+    {
+        if (binary == false)
+        {
+            LightningStepper::sendMessage(F("SC Error: script saving"));
+        }
+        return;
+    }
+    scriptRunning = false;
+    if (LightningStepperScript::write(offset, data, count) == false)
+    {
+        if (binary == false)
+        {
+            LightningStepper::sendMessage(F("SC Error: script too long"));
         }
+        return;
     }
-    else if (isHigh_pin4 == false && isHigh_pin3 == false && isHigh_pin2 == true && isHigh_pin1 == true)
+    //Checked on every write since a wait pin instruction can arrive split across them. The whole script is dropped so it cannot run.
+    if (LightningStepper::scriptPinsFree() == false)
     {
-        //currentstep = "AB";
-        if (stepKind == 4)
+        LightningStepperScript::length = 0;
+        if (binary == false)
         {
-            LightningStepper::writePinLow(1);
-            LightningStepper::writePinHigh(2);
-            LightningStepper::writePinHigh(3);
-            LightningStepper::writePinLow(4);
+            LightningStepper::sendMessage(F("SC Error: script pin in use"));
+        }
+    }
+}
+
+//True if any axis uses the pin for its coils, handshake, or limit switches, or it drives the bus transceiver
+bool LightningStepper::pinInUse(int pin)
+{
+    if (pin == pin_DriverEnable)
+    {
+        return true;
+    }
+    for (uint8_t i = 0; i < axisCount; i++)
+    {
+        LightningStepper* axis = axes[i];
+        if (pin == axis->stepper_pin1 || pin == axis->stepper_pin2 || pin == axis->stepper_pin3 || pin == axis->stepper_pin4
+            || pin == axis->pin_CmdReady || pin == axis->pin_Done || pin == axis->pin_Processing || pin == axis->pin_MinSwitch || pin == axis->pin_MaxSwitch)
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+//Look through every whole instruction of the script for a wait pin on a pin the library uses
+bool LightningStepper::scriptPinsFree()
+{
+    uint8_t pc = 0;
+    while (pc < LightningStepperScript::length)
+    {
+        const uint8_t* code = &LightningStepperScript::code[pc];
+        uint8_t size = LightningStepperScript::instructionSize(code[0]);
+        if (size == 0 || pc + size > LightningStepperScript::length)
+        {
+            //The rest is not there yet or is caught as a bad script when it runs
+            break;
+        }
+        if (code[0] == LightningStepperScript::opWaitPin && LightningStepper::pinInUse(code[1]) == true)
+        {
+            return false;
+        }
+        pc += size;
+    }
+    return true;
+}
+
+//Start the script from the top. pin_Done stays low until it ends and the motors are done.
+void LightningStepper::startScript()
+{
+    //A saved script may name a pin this sketch uses
+    if (LightningStepper::scriptPinsFree() == false)
+    {
+        LightningStepper::sendMessage(F("SC Error: script pin in use"));
+        return;
+    }
+    scriptPc = 0;
+    scriptWait = ScriptReady;
+    scriptLoopDepth = 0;
+    scriptRunning = true;
+    LightningStepper::writePin(pin_Done, LOW);
+}
+
+//Run script instructions until one has to wait. Called from run() so only a few go per call and the serial port is still read in between.
+void LightningStepper::runScript()
+{
+    for (uint8_t budget = 0; budget < LIGHTNINGSTEPPER_SCRIPT_STEPS; budget++)
+    {
+        //Finish whatever the last instruction is waiting on
+        if (scriptWait == ScriptWaitDone)
+        {
+            if (LightningStepper::allAxesDone() == false)
+            {
+                return;
+            }
+        }
+        else if (scriptWait == ScriptDwell)
+        {
+            if (millis() - scriptWaitStart < scriptDwell)
+            {
+                return;
+            }
+        }
+        else if (scriptWait == ScriptWaitPin)
+        {
+            if (digitalRead(scriptPin) != scriptPinLevel)
+            {
+                return;
+            }
+        }
+        scriptWait = ScriptReady;
+
+        if (scriptPc >= LightningStepperScript::length)
+        {
+            LightningStepper::endScript(0);
+            return;
+        }
+        const uint8_t* code = &LightningStepperScript::code[scriptPc];
+        uint8_t size = LightningStepperScript::instructionSize(code[0]);
+        if (size == 0 || scriptPc + size > LightningStepperScript::length)
+        {
+            LightningStepper::endScript(F("SC Error: bad script"));
+            return;
+        }
+        scriptPc += size;
+        //Only instructions with arguments read them. A one byte instruction can be the last byte of the script.
+        const uint8_t* args = &code[1];
+        //Instructions for an axis that does not exist are skipped
+        LightningStepper* axis = (size > 1 && args[0] < axisCount) ? axes[args[0]] : 0;
+        switch (code[0])
+        {
+        case LightningStepperScript::opEnd:
+            LightningStepper::endScript(0);
+            return;
+        case LightningStepperScript::opMove:
+            if (axis != 0)
+            {
+                axis->startMove(args[1], LightningStepperProtocol::getUInt16(&args[2]), args[4]);
+            }
+            break;
+        case LightningStepperScript::opQueueMove:
+            if (axis != 0)
+            {
+                axis->queueMove(args[1], LightningStepperProtocol::getUInt16(&args[2]), args[4]);
+            }
+            break;
+        case LightningStepperScript::opMoveTo:
+            if (axis != 0)
+            {
+                axis->moveTo(args[1], (int16_t)LightningStepperProtocol::getUInt16(&args[2]));
+            }
+            break;
+        case LightningStepperScript::opWaitDone:
+            scriptWait = ScriptWaitDone;
+            break;
+        case LightningStepperScript::opDwell:
+            scriptDwell = LightningStepperProtocol::getUInt16(&args[0]);
+            scriptWaitStart = millis();
+            scriptWait = ScriptDwell;
+            break;
+        case LightningStepperScript::opWaitPin:
+            scriptPin = args[0];
+            scriptPinLevel = (args[1] != 0) ? HIGH : LOW;
+            pinMode(scriptPin, INPUT_PULLUP);
+            scriptWait = ScriptWaitPin;
+            break;
+        case LightningStepperScript::opLoop:
+            if (scriptLoopDepth >= LIGHTNINGSTEPPER_SCRIPT_LOOPS)
+            {
+                LightningStepper::endScript(F("SC Error: bad script"));
+                return;
+            }
+            scriptLoopStart[scriptLoopDepth] = scriptPc;
+            scriptLoopCount[scriptLoopDepth] = args[0];
+            scriptLoopDepth++;
+            break;
+        case LightningStepperScript::opEndLoop:
+        {
+            if (scriptLoopDepth == 0)
+            {
+                LightningStepper::endScript(F("SC Error: bad script"));
+                return;
+            }
+            uint8_t top = scriptLoopDepth - 1;
+            //A count of 0 loops until the script is stopped
+            if (scriptLoopCount[top] == 0 || --scriptLoopCount[top] > 0)
+            {
+                scriptPc = scriptLoopStart[top];
+            }
+            else
+            {
+                scriptLoopDepth--;
+            }
+            //A loop with nothing to wait on hands back each time around
             return;
         }
-        if (stepKind == 8)
-        {
-            LightningStepper::writePinLow(1);
-            LightningStepper::writePinHigh(2);
-            LightningStepper::writePinLow(3);
-            LightningStepper::writePinLow(4);
-            return;
         }
     }
-    else if (isHigh_pin4 == false && isHigh_pin3 == false && isHigh_pin2 == true && isHigh_pin1 == false)
+}
+
+//The script is over. pin_Done goes high now if the motors are done or else when the last of them finishes.
+void LightningStepper::endScript(const __FlashStringHelper* error)
+{
+    scriptRunning = false;
+    if (error != 0)
     {
-        //currentstep = "B";
-        if (stepKind == 4)
-        {
-            LightningStepper::writePinLow(1);
-            LightningStepper::writePinHigh(2);
-            LightningStepper::writePinHigh(3);
-            LightningStepper::writePinLow(4);
-            return;
-        }
-        if (stepKind == 8)
-        {
-            LightningStepper::writePinLow(1);
-            LightningStepper::writePinHigh(2);
-            LightningStepper::writePinHigh(3);
-            LightningStepper::writePinLow(4);
-            return;
-        }
+        LightningStepper::sendMessage(error);
     }
-    else if (isHigh_pin4 == false && isHigh_pin3 == true && isHigh_pin2 == true && isHigh_pin1 == false)
+    if (LightningStepper::allAxesDone() == true)
     {
-        //currentstep = "BC";
-        if (stepKind == 4)
-        {
-            LightningStepper::writePinLow(1);
-            LightningStepper::writePinLow(2);
-            LightningStepper::writePinHigh(3);
-            LightningStepper::writePinHigh(4);
-            return;
-        }
-        if (stepKind == 8)
+        LightningStepper::writePin(pin_Done, HIGH);
+    }
+}
+
+#pragma endregion Script
+
+#pragma region StepperControl
+
+//Called by the step timer. Emits one step and returns the microseconds until the next step or 0 when done.
+unsigned int LightningStepper::modulateStepper() {
+    //Direction 1 = cw currentPosition increases, 2 = ccw currentPosition decreases
+    //Homing takes over the step timer until it finishes
+    if (homingPhase != HomeIdle)
+    {
+        return LightningStepper::homeStep();
+    }
+    //The steps were clamped to the limits when the move was loaded so only the limit switch is left to check here
+    if (stepsInt <= 0)
+    {
+        //Finished Instructions
+        return LightningStepper::finishMove();
+    }
+    if (travelSwitch->isClosed() == true)
+    {
+        //Ran into a limit switch. Stop Moving
+        stepsInt = 0;
+        return LightningStepper::finishMove();
+    }
+    //Keep going
+    LightningStepper::stepMove();
+    //Requested steps will go down by one
+    stepsInt--;
+    //Coordinated axes follow the lead
+    LightningStepper::stepFollowers();
+    //Delay for speed
+    return LightningStepper::nextStepDelay();
+}
+
+//The current move is finished. Chain straight into the next queued move so there is no idle gap, or stop if the queue is empty.
+//Returns the microseconds until the next step or 0 when done.
+unsigned int LightningStepper::finishMove()
+{
+    //The followers have taken all their steps by the time the lead finishes
+    LightningStepper::releaseFollowers();
+    if (queueCount > 0)
+    {
+        MoveSegment& segment = moveQueue[queueHead];
+        queueHead = (queueHead + 1) % LIGHTNINGSTEPPER_QUEUE_DEPTH;
+        queueCount--;
+        LightningStepper::changeStepMode((StepMode)segment.stepMode);
+        LightningStepper::loadMove(segment.speed, segment.steps, segment.direction);
+        //Its table was planned when it was queued so this only switches to it
+        LightningStepper::pickSCurve();
+        //The interval of the last step is already up so the queued move takes its first step now. A move clamped to no steps chains the next one.
+        return LightningStepper::modulateStepper();
+    }
+    //A step mode change sent while the motor was moving
+    LightningStepper::changeStepMode(queuedMode);
+    done = true;
+    //Set the done pin high once the other axes are done too
+    if (scriptRunning == false && LightningStepper::allAxesDone() == true)
+    {
+        LightningStepper::writePin(pin_Done, HIGH);
+    }
+    return 0;
+}
+
+//One step of homing. Called by the step timer in place of modulating a move. Returns the microseconds until the next step or 0 when done.
+unsigned int LightningStepper::homeStep()
+{
+    LightningStepperSwitch& homeSwitch = homingTowardMax ? maxSwitch : minSwitch;
+    bool closed = homeSwitch.isClosed();
+    //Direction 1 = cw heads for the max switch, 2 = ccw heads for the min switch
+    int toward = homingTowardMax ? 1 : 2;
+    int away = homingTowardMax ? 2 : 1;
+
+    homingTravel++;
+    if (homingTravel > LIGHTNINGSTEPPER_HOMING_MAX_STEPS)
+    {
+        //The switch never closed or never opened
+        return LightningStepper::finishHoming(HomeFailed);
+    }
+
+    if (homingPhase == HomeBackOff)
+    {
+        //Back off until the switch has been open long enough that the slow seek starts the same distance away every time
+        homingSteps = closed ? 0 : homingSteps + 1;
+        if (homingSteps < LIGHTNINGSTEPPER_HOMING_BACKOFF)
         {
-            LightningStepper::writePinLow(1);
-            LightningStepper::writePinLow(2);
-            LightningStepper::writePinHigh(3);
-            LightningStepper::writePinLow(4);
-            return;
+            LightningStepper::setMoveDirection(away);
+            LightningStepper::stepMove();
+            return (unsigned int)maxDelayInt;
         }
+        homingPhase = HomeSeekSlow;
     }
-    else if (isHigh_pin4 == false && isHigh_pin3 == true && isHigh_pin2 == false && isHigh_pin1 == false)
+
+    if (closed == true)
     {
-        //currentstep = "C";
-        if (stepKind == 4)
+        if (homingPhase == HomeSeekFast)
         {
-            LightningStepper::writePinLow(1);
-            LightningStepper::writePinLow(2);
-            LightningStepper::writePinHigh(3);
-            LightningStepper::writePinHigh(4);
-            return;
+            //Overshot at speed. Back off and come back slowly.
+            homingPhase = HomeBackOff;
+            homingSteps = 0;
+            LightningStepper::setMoveDirection(away);
+            LightningStepper::stepMove();
+            return (unsigned int)maxDelayInt;
         }
-        if (stepKind == 8)
+        //The slow seek found the exact step the switch closes at
+        if (homingTowardMax == false)
         {
-            LightningStepper::writePinLow(1);
-            LightningStepper::writePinLow(2);
-            LightningStepper::writePinHigh(3);
-            LightningStepper::writePinHigh(4);
-            return;
+            currentPositionInt = 0;
+            if (maxSwitch.isAttached() == true)
+            {
+                //Now find the max position the same way
+                homingTowardMax = true;
+                homingPhase = HomeSeekFast;
+                homingTravel = 0;
+                return (unsigned int)maxDelayInt;
+            }
+        }
+        else
+        {
+            maxPositionInt = currentPositionInt;
         }
+        return LightningStepper::finishHoming(HomeSucceeded);
+    }
+
+    LightningStepper::setMoveDirection(toward);
+    LightningStepper::stepMove();
+    return (unsigned int)((homingPhase == HomeSeekFast) ? currentDelayInt : maxDelayInt);
+}
+
+//Homing is over. Returns 0 so the step timer stops stepping this axis.
+unsigned int LightningStepper::finishHoming(HomingResult result)
+{
+    homingPhase = HomeIdle;
+    homingResult = result;
+    LightningStepper::changeStepMode(queuedMode);
+    homingFinished = true;
+    done = true;
+    //Set the done pin high once the other axes are done too
+    if (scriptRunning == false && LightningStepper::allAxesDone() == true)
+    {
+        LightningStepper::writePin(pin_Done, HIGH);
+    }
+    return 0;
+}
+
+//Called by the lead after each of its steps
+void LightningStepper::stepFollowers()
+{
+    if (leading == false)
+    {
+        return;
     }
-    else if (isHigh_pin4 == true && isHigh_pin3 == true && isHigh_pin2 == false && isHigh_pin1 == false)
+    for (uint8_t i = 0; i < axisCount; i++)
     {
-        //currentstep = "CD";
-        if (stepKind == 4)
+        if (axes[i]->following == true)
         {
-            LightningStepper::writePinHigh(1);
-            LightningStepper::writePinLow(2);
-            LightningStepper::writePinLow(3);
-            LightningStepper::writePinHigh(4);
-            return;
+            axes[i]->followLead();
         }
-        if (stepKind == 8)
+    }
+}
+
+//One lead step. Step this axis when its error term passes the lead's step count.
+void LightningStepper::followLead()
+{
+    followError += followDelta;
+    if (followError >= coordinatedSteps)
+    {
+        followError -= coordinatedSteps;
+        //The delta was clamped to the limits when the move started. A closed limit switch still holds the axis.
+        if (travelSwitch->isClosed() == false)
         {
-            LightningStepper::writePinLow(1);
-            LightningStepper::writePinLow(2);
-            LightningStepper::writePinLow(3);
-            LightningStepper::writePinHigh(4);
-            return;
+            LightningStepper::stepMove();
         }
     }
-    else if (isHigh_pin4 == true && isHigh_pin3 == false && isHigh_pin2 == false && isHigh_pin1 == false)
+}
+
+//End a coordinated move led by this axis. The followers are done where they stand.
+void LightningStepper::releaseFollowers()
+{
+    if (leading == false)
+    {
+        return;
+    }
+    leading = false;
+    for (uint8_t i = 0; i < axisCount; i++)
     {
-        //currentstep = "D";
-        if (stepKind == 4)
+        if (axes[i]->following == true)
         {
-            LightningStepper::writePinHigh(1);
-            LightningStepper::writePinLow(2);
-            LightningStepper::writePinLow(3);
-            LightningStepper::writePinHigh(4);
-            return;
+            axes[i]->following = false;
+            axes[i]->changeStepMode(axes[i]->queuedMode);
+            axes[i]->done = true;
         }
-        if (stepKind == 8)
+    }
+}
+
+//Works out the interval before the next step from the motion profile. Integer math only since this runs in the step timer interrupt.
+unsigned int LightningStepper::nextStepDelay()
+{
+    unsigned long cruiseDelay = (unsigned long)currentDelayInt << 8;
+    //A queued move in the same direction and step mode carries on at speed so only slow down for the steps left in both
+    //The S-curve cannot ease down to a slower queued move, so it stops between them instead
+    long remaining = stepsInt;
+    if (queueCount > 0 && moveQueue[queueHead].direction == directionInt && moveQueue[queueHead].stepMode == stepMode
+        && (moveProfile == Trapezoid || moveQueue[queueHead].speed >= speedInt))
+    {
+        remaining += moveQueue[queueHead].steps;
+        //The queued move will be clamped when it loads so plan to stop at the limit
+        long room = (directionInt == 1) ? (long)maxPositionInt - currentPositionInt : currentPositionInt;
+        if (remaining > room)
         {
-            LightningStepper::writePinHigh(1);
-            LightningStepper::writePinLow(2);
-            LightningStepper::writePinLow(3);
-            LightningStepper::writePinHigh(4);
-            return;
+            remaining = room;
         }
     }
-    else if (isHigh_pin4 == true && isHigh_pin3 == false && isHigh_pin2 == false && isHigh_pin1 == true)
+    if (moveProfile == SCurve)
     {
-        //currentstep = "DA";
-        if (stepKind == 4)
+        return LightningStepper::nextSCurveDelay(remaining);
+    }
+    if (remaining <= (long)rampStep)
+    {
+        //Decelerate. Mirrors the acceleration so the motor is back at its starting speed on the last step.
+        if (rampStep > 0)
         {
-            LightningStepper::writePinHigh(1);
-            LightningStepper::writePinHigh(2);
-            LightningStepper::writePinLow(3);
-            LightningStepper::writePinLow(4);
-            return;
+            rampDelay += (2 * rampDelay) / (4UL * rampStep - 1);
+            rampStep--;
         }
-        if (stepKind == 8)
+    }
+    else if (rampDelay > cruiseDelay)
+    {
+        //Accelerate
+        rampStep++;
+        rampDelay -= (2 * rampDelay) / (4UL * rampStep + 1);
+        if (rampDelay < cruiseDelay)
         {
-            LightningStepper::writePinHigh(1);
-            LightningStepper::writePinLow(2);
-            LightningStepper::writePinLow(3);
-            LightningStepper::writePinLow(4);
-            return;
+            rampDelay = cruiseDelay;
         }
     }
-    else
+    else if (rampDelay < cruiseDelay)
     {
-        //just set currentstep = "DA"
-        if (stepKind == 4)
+        //A new move asked for a slower speed. Decelerate to it.
+        if (rampStep > 0)
         {
-            LightningStepper::writePinHigh(1);
-            LightningStepper::writePinHigh(2);
-            LightningStepper::writePinLow(3);
-            LightningStepper::writePinLow(4);
-            return;
+            rampDelay += (2 * rampDelay) / (4UL * rampStep - 1);
+            rampStep--;
         }
-        if (stepKind == 8)
+        if (rampDelay > cruiseDelay || rampStep == 0)
         {
-            LightningStepper::writePinHigh(1);
-            LightningStepper::writePinLow(2);
-            LightningStepper::writePinLow(3);
-            LightningStepper::writePinLow(4);
-            return;
+            rampDelay = cruiseDelay;
         }
     }
+    return (unsigned int)(rampDelay >> 8);
 }
 
-//Clockwise. Just adjust the device doing the commanding if this needs to flip direction.
-void LightningStepper::stepCW()
+#if defined(LIGHTNINGSTEPPER_SCURVE)
+
+//Plan the S-curve ramp for a move started outside the step timer. Works out its table if neither table has it already.
+void LightningStepper::planSCurve()
 {
-    if (isHigh_pin4 == false && isHigh_pin3 == false && isHigh_pin2 == false && isHigh_pin1 == true)
+    if (moveProfile != SCurve)
     {
-        //currentstep = "A";
-        if (stepKind == 4)
-        {
-            LightningStepper::writePinHigh(1);
-            LightningStepper::writePinLow(2);
-            LightningStepper::writePinLow(3);
-            LightningStepper::writePinHigh(4);
-            return;
-        }
-        if (stepKind == 8)
-        {
-            LightningStepper::writePinHigh(1);
-            LightningStepper::writePinLow(2);
-            LightningStepper::writePinLow(3);
-            LightningStepper::writePinHigh(4);
-            return;
-        }
+        return;
     }
-    else if (isHigh_pin4 == false && isHigh_pin3 == false && isHigh_pin2 == true && isHigh_pin1 == true)
+    if (LightningStepper::sCurvePlanned(sCurveActive, currentDelayInt) == false && LightningStepper::sCurvePlanned(sCurveActive ^ 1, currentDelayInt) == false)
     {
-        //currentstep = "AB";
-        if (stepKind == 4)
-        {
-            LightningStepper::writePinHigh(1);
-            LightningStepper::writePinLow(2);
-            LightningStepper::writePinLow(3);
-            LightningStepper::writePinHigh(4);
-            return;
-        }
-        if (stepKind == 8)
-        {
-            LightningStepper::writePinHigh(1);
-            LightningStepper::writePinLow(2);
-            LightningStepper::writePinLow(3);
-            LightningStepper::writePinLow(4);
-            return;
-        }
+        LightningStepper::buildSCurve(currentDelayInt);
+    }
+    LightningStepper::pickSCurve();
+}
+
+//Plan the table of the move at the head of the queue ahead of time into the table the running move is not using
+void LightningStepper::prepareSCurve()
+{
+    if (speedProfile != SCurve && moveProfile != SCurve)
+    {
+        return;
+    }
+    noInterrupts();
+    bool waiting = (queueCount > 0);
+    uint8_t speed = moveQueue[queueHead].speed;
+    interrupts();
+    if (waiting == false)
+    {
+        return;
+    }
+    int cruise = LightningStepper::delayForSpeed(speed);
+    if (LightningStepper::sCurvePlanned(0, cruise) == false && LightningStepper::sCurvePlanned(1, cruise) == false)
+    {
+        LightningStepper::buildSCurve(cruise);
     }
-    else if (isHigh_pin4 == false && isHigh_pin3 == false && isHigh_pin2 == true && isHigh_pin1 == false)
+}
+
+//Work out a whole table for the cruise delay into the table the running move is not using. One division per entry, so never called from the step timer.
+void LightningStepper::buildSCurve(int cruise)
+{
+    //Marked unplanned while it is worked out so the step timer cannot switch to it half done
+    noInterrupts();
+    SCurvePlan& plan = sCurvePlans[sCurveActive ^ 1];
+    plan.start = 0;
+    interrupts();
+    unsigned long start = (unsigned int)maxDelayInt;
+    unsigned long length = 0;
+    if (cruise > 0 && cruise < maxDelayInt)
     {
-        //currentstep = "B";
-        if (stepKind == 4)
+        //Ramp over enough steps that the peak acceleration is about the trapezoid's, which is (maxDelay / cruise)^2 steps. About twice as many as the trapezoid takes.
+        length = (start * start) / ((unsigned long)cruise * (unsigned int)cruise) - 1;
+        if (length < 1)
         {
-            LightningStepper::writePinHigh(1);
-            LightningStepper::writePinHigh(2);
-            LightningStepper::writePinLow(3);
-            LightningStepper::writePinLow(4);
-            return;
+            length = 1;
         }
-        if (stepKind == 8)
+        if (length > LIGHTNINGSTEPPER_SCURVE_STEPS)
         {
-            LightningStepper::writePinHigh(1);
-            LightningStepper::writePinHigh(2);
-            LightningStepper::writePinLow(3);
-            LightningStepper::writePinLow(4);
-            return;
+            length = LIGHTNINGSTEPPER_SCURVE_STEPS;
         }
     }
-    else if (isHigh_pin4 == false && isHigh_pin3 == true && isHigh_pin2 == true && isHigh_pin1 == false)
+    //How far along the ramp one entry is, in 4.12 fixed point shifted up 16 more bits
+    unsigned long increment = (4096UL << 16) / (length + 1);
+    for (uint8_t entry = 0; entry < length; entry++)
+    {
+        //Smoothstep 3x^2 - 2x^3 of how far along the ramp the entry is, in 4.12 fixed point. Its slope is 0 at both ends so the acceleration eases in and out.
+        unsigned long x = ((unsigned long)(entry + 1) * increment) >> 16;
+        unsigned long s = (x * ((x * (12288UL - 2 * x)) >> 12)) >> 12;
+        //Blend the start and cruise speeds, which are 1/delay, and turn the speed back into a delay
+        plan.table[entry] = (unsigned int)((start * (unsigned int)cruise) / ((unsigned int)cruise + (((start - (unsigned int)cruise) * s) >> 12)));
+    }
+    plan.length = (uint8_t)length;
+    plan.cruise = cruise;
+    noInterrupts();
+    plan.start = maxDelayInt;
+    interrupts();
+}
+
+//Switch to the table of the loaded move. Also runs in the step timer when it chains a queued move, so it only looks the table up.
+//A move that keeps the table it had keeps its place on it, so moves chained at the same speed carry on.
+void LightningStepper::pickSCurve()
+{
+    if (moveProfile != SCurve || LightningStepper::sCurvePlanned(sCurveActive, currentDelayInt) == true)
+    {
+        return;
+    }
+    if (LightningStepper::sCurvePlanned(sCurveActive ^ 1, currentDelayInt) == false)
+    {
+        //Chained before run() got to plan it. It runs the trapezoid ramp, which needs no table, and the next move from a stop is an S-curve again.
+        moveProfile = Trapezoid;
+        return;
+    }
+    sCurveActive ^= 1;
+    //Pick the ramp up where the current speed is on it. A move from a standing start is at maxDelay, before the first entry.
+    //A new move slower than the current speed goes straight to its cruise speed. The table only gets shorter intervals along it, so a binary search finds the place.
+    const SCurvePlan& plan = sCurvePlans[sCurveActive];
+    unsigned int current = (unsigned int)(rampDelay >> 8);
+    uint8_t low = 0;
+    uint8_t high = plan.length;
+    while (low < high)
     {
-        //currentstep = "BC";
-        if (stepKind == 4)
+        uint8_t middle = (low + high) / 2;
+        if (plan.table[middle] > current)
         {
-            LightningStepper::writePinHigh(1);
-            LightningStepper::writePinHigh(2);
-            LightningStepper::writePinLow(3);
-            LightningStepper::writePinLow(4);
-            return;
+            low = middle + 1;
         }
-        if (stepKind == 8)
+        else
         {
-            LightningStepper::writePinLow(1);
-            LightningStepper::writePinHigh(2);
-            LightningStepper::writePinLow(3);
-            LightningStepper::writePinLow(4);
-            return;
+            high = middle;
         }
     }
-    else if (isHigh_pin4 == false && isHigh_pin3 == true && isHigh_pin2 == false && isHigh_pin1 == false)
+    rampStep = low;
+}
+
+//True if the table was worked out for the current maxDelay and this cruise delay
+bool LightningStepper::sCurvePlanned(uint8_t plan, int cruise)
+{
+    return sCurvePlans[plan].start == maxDelayInt && sCurvePlans[plan].cruise == cruise;
+}
+
+//Works out the interval before the next step from the S-curve table. Accelerating reads it forward and decelerating reads it backward, whichever end is nearer.
+unsigned int LightningStepper::nextSCurveDelay(long remaining)
+{
+    const SCurvePlan& plan = sCurvePlans[sCurveActive];
+    //rampStep counts the steps into the ramp and stops one past the table, which is the cruise
+    if (rampStep <= plan.length)
+    {
+        rampStep++;
+    }
+    long entry = (remaining < (long)rampStep) ? remaining : (long)rampStep;
+    //Past the last step stay on the slowest entry, so a queued move that starts from here starts slow
+    if (entry < 1)
+    {
+        entry = 1;
+    }
+    unsigned int delay = (unsigned int)currentDelayInt;
+    if (entry <= plan.length)
+    {
+        delay = plan.table[entry - 1];
+    }
+    //Kept up to date so a queued move that carries on at speed picks up from here
+    rampDelay = (unsigned long)delay << 8;
+    return delay;
+}
+
+#else
+
+//The S-curve is not built in so moveProfile is always the trapezoid and there are no tables to plan
+void LightningStepper::planSCurve()
+{
+}
+
+void LightningStepper::prepareSCurve()
+{
+}
+
+void LightningStepper::pickSCurve()
+{
+}
+
+bool LightningStepper::sCurvePlanned(uint8_t, int)
+{
+    return false;
+}
+
+unsigned int LightningStepper::nextSCurveDelay(long)
+{
+    return (unsigned int)currentDelayInt;
+}
+
+#endif
+
+//Called from the step timer interrupt. Steps every axis that is due and returns the microseconds until the next axis is due, or 0 once they are all stopped.
+//A linear scan is as quick as a heap for the handful of axes one board can drive.
+unsigned int LightningStepper::stepTimerCallback()
+{
+    unsigned long now = scheduleClock;
+    unsigned long nextDelay = 0xFFFF;
+    bool anyStepping = false;
+    for (uint8_t i = 0; i < axisCount; i++)
     {
-        //currentstep = "C";
-        if (stepKind == 4)
+        LightningStepper* axis = axes[i];
+        if (axis->stepping == false)
         {
-            LightningStepper::writePinLow(1);
-            LightningStepper::writePinHigh(2);
-            LightningStepper::writePinHigh(3);
-            LightningStepper::writePinLow(4);
-            return;
+            continue;
         }
-        if (stepKind == 8)
+        if ((long)(axis->nextStepTime - now) <= 0)
         {
-            LightningStepper::writePinLow(1);
-            LightningStepper::writePinHigh(2);
-            LightningStepper::writePinHigh(3);
-            LightningStepper::writePinLow(4);
-            return;
+#if defined(LIGHTNINGSTEPPER_BENCHMARK)
+            axis->bench.recordStep(axis->benchScheduled);
+            unsigned int start = LightningStepperBench::now();
+            unsigned int stepDelay = axis->modulateStepper();
+            axis->bench.recordModulateCost(LightningStepperBench::now() - start);
+            axis->benchScheduled = stepDelay;
+#else
+            unsigned int stepDelay = axis->modulateStepper();
+#endif
+            axis->stepInterval = stepDelay;
+            if (stepDelay == 0)
+            {
+                axis->stepping = false;
+                continue;
+            }
+            axis->nextStepTime += stepDelay;
         }
-    }
-    else if (isHigh_pin4 == true && isHigh_pin3 == true && isHigh_pin2 == false && isHigh_pin1 == false)
-    {
-        //currentstep = "CD";
-        if (stepKind == 4)
+        anyStepping = true;
+        long wait = (long)(axis->nextStepTime - now);
+        //An axis that fell behind is stepped at the next call
+        if (wait < 1)
         {
-            LightningStepper::writePinLow(1);
-            LightningStepper::writePinHigh(2);
-            LightningStepper::writePinHigh(3);
-            LightningStepper::writePinLow(4);
-            return;
+            wait = 1;
         }
-        if (stepKind == 8)
+        if ((unsigned long)wait < nextDelay)
         {
-            LightningStepper::writePinLow(1);
-            LightningStepper::writePinLow(2);
-            LightningStepper::writePinHigh(3);
-            LightningStepper::writePinLow(4);
-            return;
+            nextDelay = wait;
         }
     }
-    else if (isHigh_pin4 == true && isHigh_pin3 == false && isHigh_pin2 == false && isHigh_pin1 == false)
+    if (anyStepping == false)
     {
-        //currentstep = "D";
-        if (stepKind == 4)
-        {
-            LightningStepper::writePinLow(1);
-            LightningStepper::writePinLow(2);
-            LightningStepper::writePinHigh(3);
-            LightningStepper::writePinHigh(4);
-            return;
-        }
-        if (stepKind == 8)
+        return 0;
+    }
+    scheduleClock = now + nextDelay;
+    return (unsigned int)nextDelay;
+}
+
+//Start emitting steps for the current move from the step timer
+void LightningStepper::startStepping()
+{
+#if defined(LIGHTNINGSTEPPER_BENCHMARK)
+    //The first step comes from a standing start so there is no interval to measure
+    benchScheduled = 0;
+#endif
+    noInterrupts();
+    bool othersStepping = false;
+    for (uint8_t i = 0; i < axisCount; i++)
+    {
+        if (axes[i] != this && axes[i]->stepping == true)
         {
-            LightningStepper::writePinLow(1);
-            LightningStepper::writePinLow(2);
-            LightningStepper::writePinHigh(3);
-            LightningStepper::writePinHigh(4);
-            return;
+            othersStepping = true;
         }
     }
-    else if (isHigh_pin4 == true && isHigh_pin3 == false && isHigh_pin2 == false && isHigh_pin1 == true)
+    //The first step is emitted right away just like the stepper did before it was timer driven.
+    //The first move after idling waits for the coils to settle instead. No other axis can be stepping then.
+    unsigned int firstDelay = firstStepDelay;
+    firstStepDelay = 1;
+    if (othersStepping == true)
     {
-        //currentstep = "DA";
-        if (stepKind == 4)
+        //Re-arming the timer would shift the steps of the axes already moving. The call already pending for them is brought forward to the first step instead,
+        //so a new move does not wait out a slow axis's interval. The axes already moving step when they were due.
+        unsigned int until = LightningStepperTimer::untilNext();
+        if (until > firstDelay)
         {
-            LightningStepper::writePinLow(1);
-            LightningStepper::writePinLow(2);
-            LightningStepper::writePinHigh(3);
-            LightningStepper::writePinHigh(4);
-            return;
+            scheduleClock -= LightningStepperTimer::pullIn(until - firstDelay);
         }
-        if (stepKind == 8)
+        nextStepTime = scheduleClock;
+        stepping = true;
+    }
+    else
+    {
+        unsigned long now = scheduleClock - LightningStepperTimer::untilNext();
+        nextStepTime = now + firstDelay;
+        stepping = true;
+        scheduleClock = now + firstDelay;
+        LightningStepperTimer::start(LightningStepper::stepTimerCallback, firstDelay);
+    }
+    interrupts();
+}
+
+//Stop stepping this axis. The coils keep their current phase.
+void LightningStepper::stopStepping()
+{
+    noInterrupts();
+    stepping = false;
+    bool anyStepping = false;
+    for (uint8_t i = 0; i < axisCount; i++)
+    {
+        if (axes[i]->stepping == true)
         {
-            LightningStepper::writePinLow(1);
-            LightningStepper::writePinLow(2);
-            LightningStepper::writePinLow(3);
-            LightningStepper::writePinHigh(4);
-            return;
+            anyStepping = true;
         }
     }
-    else
+    //While the coils idle the step timer is only chopping them
+    if (anyStepping == false && coilsIdle == false)
+    {
+        LightningStepperTimer::stop();
+    }
+    interrupts();
+}
+
+//Every axis has been done for the idle timeout. Release the coils or drop them to the reduced hold.
+void LightningStepper::enterIdle()
+{
+    coilsIdle = true;
+    holdOn = false;
+    for (uint8_t i = 0; i < axisCount; i++)
     {
-        if (stepKind == 4)
+#if defined(LIGHTNINGSTEPPER_BENCHMARK)
+        axes[i]->bench.markIdle(holdDuty);
+#endif
+        //Full hold leaves the coils as they are
+        if (holdDuty < 255)
         {
-            LightningStepper::writePinHigh(1);
-            LightningStepper::writePinHigh(2);
-            LightningStepper::writePinLow(3);
-            LightningStepper::writePinLow(4);
-            return;
+            axes[i]->coils.write(0);
         }
-        if (stepKind == 8)
+    }
+    if (holdDuty > 0 && holdDuty < 255)
+    {
+        //The coils start the chop switched off
+        LightningStepperTimer::start(LightningStepper::holdTimerCallback, LIGHTNINGSTEPPER_HOLD_PERIOD - ((unsigned long)LIGHTNINGSTEPPER_HOLD_PERIOD * holdDuty) / 255);
+    }
+}
+
+//Put every axis back on the phase it stopped on. Returns true if the coils were idle.
+bool LightningStepper::wakeCoils()
+{
+    if (coilsIdle == false)
+    {
+        return false;
+    }
+    LightningStepperTimer::stop();
+    coilsIdle = false;
+    for (uint8_t i = 0; i < axisCount; i++)
+    {
+        axes[i]->coils.write(coilSequence[axes[i]->coilPhase]);
+#if defined(LIGHTNINGSTEPPER_BENCHMARK)
+        axes[i]->bench.markAwake();
+#endif
+    }
+    return true;
+}
+
+//Called by the step timer during the reduced hold. Switches every axis's coils between its phase and off. Returns the microseconds until the next switch.
+unsigned int LightningStepper::holdTimerCallback()
+{
+    holdOn = !holdOn;
+    for (uint8_t i = 0; i < axisCount; i++)
+    {
+        axes[i]->coils.write(holdOn ? coilSequence[axes[i]->coilPhase] : 0);
+    }
+    unsigned int onTime = ((unsigned long)LIGHTNINGSTEPPER_HOLD_PERIOD * holdDuty) / 255;
+    return holdOn ? onTime : LIGHTNINGSTEPPER_HOLD_PERIOD - onTime;
+}
+
+//Load the newest clean record into the axes. Returns false if there is nothing to trust.
+bool LightningStepper::restoreSettings()
+{
+    LightningStepperAxisSettings settings[LIGHTNINGSTEPPER_STORAGE_AXES];
+    uint8_t count = 0;
+    bool clean = false;
+    if (LightningStepperStorage::load(settings, count, clean) == false || clean == false || count != axisCount)
+    {
+        return false;
+    }
+    for (uint8_t i = 0; i < count; i++)
+    {
+        axes[i]->minDelayInt = settings[i].minDelay;
+        axes[i]->maxDelayInt = settings[i].maxDelay;
+        axes[i]->currentPositionInt = settings[i].currentPosition;
+        axes[i]->maxPositionInt = settings[i].maxPosition;
+        axes[i]->updateDelayRange();
+        if (settings[i].stepMode <= WaveDrive)
         {
-            LightningStepper::writePinHigh(1);
-            LightningStepper::writePinLow(2);
-            LightningStepper::writePinLow(3);
-            LightningStepper::writePinLow(4);
-            return;
+            axes[i]->setStepMode((StepMode)settings[i].stepMode);
+            axes[i]->halfOffset = settings[i].halfOffset & 1;
+            //Hold the rotor on the phase it stopped on. The coils were off since power up so this does not move it.
+            axes[i]->coilPhase = settings[i].coilPhase & 7;
+            axes[i]->coils.write(coilSequence[axes[i]->coilPhase]);
         }
     }
+    storageClean = true;
+    return true;
 }
 
-//Write the digital pin high
-void LightningStepper::writePinHigh(int pin)
+//Start writing every axis to a new record marked clean. run() writes it out a byte at a time. Only call once they have all stopped.
+void LightningStepper::saveSettings()
 {
-    switch (pin)
+    LightningStepperAxisSettings settings[LIGHTNINGSTEPPER_STORAGE_AXES];
+    for (uint8_t i = 0; i < axisCount; i++)
     {
-    case 1:
-        digitalWrite(stepper_pin1, HIGH);
-        isHigh_pin1 = true;
-        break;
-    case 2:
-        digitalWrite(stepper_pin2, HIGH);
-        isHigh_pin2 = true;
-        break;
-    case 3:
-        digitalWrite(stepper_pin3, HIGH);
-        isHigh_pin3 = true;
-        break;
-    case 4:
-        digitalWrite(stepper_pin4, HIGH);
-        isHigh_pin4 = true;
-        break;
+        settings[i].minDelay = axes[i]->minDelayInt;
+        settings[i].maxDelay = axes[i]->maxDelayInt;
+        settings[i].currentPosition = axes[i]->currentPositionInt;
+        settings[i].maxPosition = axes[i]->maxPositionInt;
+        settings[i].stepMode = axes[i]->stepMode;
+        settings[i].halfOffset = axes[i]->halfOffset;
+        settings[i].coilPhase = axes[i]->coilPhase;
     }
+    LightningStepperStorage::save(settings, axisCount);
+    storageClean = true;
 }
 
-//Write the digital pin low
-void LightningStepper::writePinLow(int pin) {
-    switch (pin)
+//True when no axis has a move left
+bool LightningStepper::allAxesDone()
+{
+    for (uint8_t i = 0; i < axisCount; i++)
     {
-    case 1:
-        digitalWrite(stepper_pin1, LOW);
-        isHigh_pin1 = false;
-        break;
-    case 2:
-        digitalWrite(stepper_pin2, LOW);
-        isHigh_pin2 = false;
-        break;
-    case 3:
-        digitalWrite(stepper_pin3, LOW);
-        isHigh_pin3 = false;
-        break;
-    case 4:
-        digitalWrite(stepper_pin4, LOW);
-        isHigh_pin4 = false;
-        break;
+        if (axes[i]->done == false)
+        {
+            return false;
+        }
     }
+    return true;
+}
+
+//One step in the direction of the loaded move. Branch free since it runs in the step timer interrupt.
+void LightningStepper::stepMove()
+{
+#if defined(LIGHTNINGSTEPPER_BENCHMARK)
+    unsigned int start = LightningStepperBench::now();
+#endif
+    coilPhase = (coilPhase + movePhaseStep) & 7;
+    coils.write(coilSequence[coilPhase]);
+    currentPositionInt += positionStep;
+#if defined(LIGHTNINGSTEPPER_BENCHMARK)
+    bench.recordStepCost(LightningStepperBench::now() - start);
+#endif
+}
+
+//Counter Clockwise. Just adjust the device doing the commanding if this needs to flip direction.
+void LightningStepper::stepCCW()
+{
+#if defined(LIGHTNINGSTEPPER_BENCHMARK)
+    unsigned int start = LightningStepperBench::now();
+#endif
+    coilPhase = (coilPhase + phaseIncrement) & 7;
+    coils.write(coilSequence[coilPhase]);
+#if defined(LIGHTNINGSTEPPER_BENCHMARK)
+    bench.recordStepCost(LightningStepperBench::now() - start);
+#endif
+}
+
+//Clockwise. Just adjust the device doing the commanding if this needs to flip direction.
+void LightningStepper::stepCW()
+{
+#if defined(LIGHTNINGSTEPPER_BENCHMARK)
+    unsigned int start = LightningStepperBench::now();
+#endif
+    coilPhase = (coilPhase - phaseIncrement) & 7;
+    coils.write(coilSequence[coilPhase]);
+#if defined(LIGHTNINGSTEPPER_BENCHMARK)
+    bench.recordStepCost(LightningStepperBench::now() - start);
+#endif
 }
+
 #pragma endregion StepperControl
+
+#if defined(__AVR__) && defined(LIGHTNINGSTEPPER_PCINT_CMDREADY)
+#if defined(PCINT0_vect)
+ISR(PCINT0_vect)
+{
+    LightningStepper::cmdReadyPinChanged();
+}
+#endif
+#if defined(PCINT1_vect)
+ISR(PCINT1_vect)
+{
+    LightningStepper::cmdReadyPinChanged();
+}
+#endif
+#if defined(PCINT2_vect)
+ISR(PCINT2_vect)
+{
+    LightningStepper::cmdReadyPinChanged();
+}
+#endif
+#if defined(PCINT3_vect)
+ISR(PCINT3_vect)
+{
+    LightningStepper::cmdReadyPinChanged();
+}
+#endif
+#endif
@@ -2,32 +2,133 @@
   LightningStepper.h - Library for controlling a unipolar stepper motor using the ULN2003 Driver Board.
   Created by Calvin Bultz, September 1, 2022.
   Released into the public domain.
-  -Warning!!: Physical limit switches should be used when controlling motors. For simplicity of code and the fact that my motor is setup with a safe full range of motion, the physical limit switches are not included.
+  -Warning!!: Physical limit switches should be used when controlling motors. Attach them with setLimitSwitches() to end moves at the switches and to home the motor.
     Please read the disclamer on the README file in the repository.
 */
 #ifndef LightningStepper_h
 #define LightningStepper_h
 #include "Arduino.h"
+#include "LightningStepperTimer.h"
+#include "LightningStepperCoils.h"
+#include "LightningStepperProtocol.h"
+#include "LightningStepperBench.h"
+#include "LightningStepperStorage.h"
+#include "LightningStepperSwitch.h"
+#include "LightningStepperScript.h"
+
+//pin_CmdReady uses an external interrupt when the board has one on that pin (ex: 2 or 3 on an Uno) and is polled otherwise.
+//Uncomment to use a pin change interrupt on AVR pins without an external interrupt. This takes over the PCINT vectors so SoftwareSerial cannot be used with it.
+//#define LIGHTNINGSTEPPER_PCINT_CMDREADY
+
+//Number of moves that can wait in the queue behind the running move
+#define LIGHTNINGSTEPPER_QUEUE_DEPTH 8
+//Number of motors one stepper controller can drive, counting the one that runs the setup
+#define LIGHTNINGSTEPPER_MAX_AXES 4
+//Steps to back off a limit switch after the fast seek, counted from where it opens
+#define LIGHTNINGSTEPPER_HOMING_BACKOFF 64
+//Homing gives up if a switch is not found within this many steps
+#define LIGHTNINGSTEPPER_HOMING_MAX_STEPS 32000
+//Period in microseconds the coils are chopped at for a reduced hold. Keep it shorter than the coil's time constant so the current stays smooth.
+#define LIGHTNINGSTEPPER_HOLD_PERIOD 1000
+//Microseconds the coils are re-energized on their phase before the first step after idling, so the rotor is pulled back to it
+#define LIGHTNINGSTEPPER_WAKE_SETTLE 2000
+//Uncomment to build in the S-curve speed profile (Cmd 22 profile 1). Its ramp tables take 4 bytes of RAM per axis for each step of LIGHTNINGSTEPPER_SCURVE_STEPS, 256 bytes per axis by default.
+//#define LIGHTNINGSTEPPER_SCURVE
+//Longest S-curve ramp in steps. Each step takes 4 bytes of RAM per axis, 2 in each of its two tables. A cruise speed more than 8 times the maxDelay speed ramps harder than the trapezoid to fit.
+#define LIGHTNINGSTEPPER_SCURVE_STEPS 64
 class LightningStepper
 {
     public:
+        //Step modes. Full step energizes two coils at a time for the most torque. Half step alternates one and two coils for double the resolution. Wave drive energizes one coil at a time.
+        enum StepMode : uint8_t { FullStep, HalfStep, WaveDrive };
+        //Speed profiles. The trapezoid ramps at a constant acceleration. The S-curve eases the acceleration in and out so there is no jolt at the ends of the ramps.
+        //The S-curve is only built in with LIGHTNINGSTEPPER_SCURVE. Without it axes stay on the trapezoid.
+        enum SpeedProfile : uint8_t { Trapezoid, SCurve };
+
+        //pin_CmdReady, pin_Done, and pin_Processing can be -1 when the command controller sends sequenced commands. See processCmd
         LightningStepper(int pin_IN1, int pin_IN2, int pin_IN3, int pin_IN4, int pin_CmdReady, int pin_Done, int pin_Processing);
+        //Talk to the command controller on another hardware serial port and/or at another baud rate, ex: Serial1 at 1000000. runSetup starts the port.
+        LightningStepper(int pin_IN1, int pin_IN2, int pin_IN3, int pin_IN4, int pin_CmdReady, int pin_Done, int pin_Processing, HardwareSerial& port, unsigned long baud);
+        //Talk to the command controller on any Stream, ex: SoftwareSerial or a test harness. The sketch starts the port before runSetup and Cmd 15 cannot change its rate.
+        LightningStepper(int pin_IN1, int pin_IN2, int pin_IN3, int pin_IN4, int pin_CmdReady, int pin_Done, int pin_Processing, Stream& port);
+        //An extra motor on the same stepper controller. It shares the serial port and pins of the motor it is attached to.
+        LightningStepper(int pin_IN1, int pin_IN2, int pin_IN3, int pin_IN4);
         void runSetup();
         void run();
+        //Drive another motor from this stepper controller. Axes are numbered in the order they are attached starting at 1. This motor is axis 0.
+        //Call before runSetup. Returns false if LIGHTNINGSTEPPER_MAX_AXES are already attached.
+        bool attachAxis(LightningStepper& axis);
+        //Called by the pin change interrupt when LIGHTNINGSTEPPER_PCINT_CMDREADY is defined
+        static void cmdReadyPinChanged();
+        //Use a custom speed curve. The curve must be 101 entries stored in PROGMEM, one per speed [0-100]. 0 maps to maxDelay and 65535 maps to minDelay.
+        //Call before runSetup. The default curve is linear.
+        void setSpeedCurve(const uint16_t* curve);
+        //Half step is the default. Call before runSetup. Cmd 12 changes it while running. A restored record keeps the step mode it was saved with.
+        void setStepMode(StepMode mode);
+        //The trapezoid is the default. Cmd 22 changes it while running. A change waits for the motor to start from a stop.
+        void setSpeedProfile(SpeedProfile profile);
+        //Save the settings and position of every axis to EEPROM once the motors stop and skip the setup at power up when they were saved cleanly.
+        //Hold pin_CmdReady low at power up to go through the setup anyway. Off by default. Call before runSetup. See LightningStepperStorage.h
+        void setPersistence(bool enabled);
+        //Limit switch pins, -1 for none. Wired like pin_CmdReady so closed reads LOW. Moves end when the switch in the direction of travel closes.
+        //A min switch lets the motor home itself (setup option 3 or Cmd 11). A max switch also finds maxPosition while homing. Call before runSetup.
+        void setLimitSwitches(int pin_MinSwitch, int pin_MaxSwitch);
+        //Stop every axis the moment pin_CmdReady goes low, before the command is even sent. The command that follows can start a new move.
+        //Only works when pin_CmdReady has an interrupt. Off by default. Call before runSetup.
+        void setHaltOnCmdReady(bool enabled);
+        //Share one serial bus (ex: RS-485) with other stepper controllers. nodeId [0-14] is the high nibble of a binary address and the node/ prefix of a text command.
+        //Only the addressed node replies and node 15 is a broadcast no node replies to. pin_DriverEnable drives the transceiver's DE/RE pins while replying, -1 for none.
+        //Node 0 and no driver pin by default. Call before runSetup.
+        void setBusNode(uint8_t nodeId, int pin_DriverEnable);
+        //Release the coils once every axis has been done for idleMillis so the motor and ULN2003 cool down. 0 turns this off, the default.
+        //holdDuty [0-255] keeps a reduced hold by chopping the coils from the step timer. 0 releases them and 255 keeps the full hold.
+        //With sleep true the stepper controller sleeps between commands while idle (AVR only). The next move re-energizes the exact phase each coil stopped on. Call before runSetup.
+        void setIdlePolicy(unsigned long idleMillis, uint8_t holdDuty, bool sleep);
     private:
+        //The host tests in extras/test reach in through LightningStepperTest
+        friend class LightningStepperTest;
         //--Stepper
         int stepper_pin1 = 2;
         int stepper_pin2 = 3;
         int stepper_pin3 = 4;
         int stepper_pin4 = 5;
-        bool isHigh_pin1 = false;
-        bool isHigh_pin2 = false;
-        bool isHigh_pin3 = false;
-        bool isHigh_pin4 = false;
-        //Control the step angles.
-        int stepKind = 8;
+        //Coil output backend. See LightningStepperCoils.h
+        LightningStepperCoils coils;
+        //Coil phase. Index into the half step coil sequence. Full step only lands on the odd entries and wave drive on the even ones.
+        uint8_t coilPhase = 0;
+        //Control the step angles. How far coilPhase moves per step, 1 for half step and 2 for full step or wave drive.
+        StepMode stepMode = HalfStep;
+        uint8_t phaseIncrement = 1;
+        //Step mode the moves queued from now on run in. Differs from stepMode while a change waits for the running moves to finish.
+        StepMode queuedMode = HalfStep;
+        //Positions are in steps of the current mode. A half step position is 2 * position + halfOffset in full step or wave drive, so switching back is exact.
+        uint8_t halfOffset = 0;
+        //maxPosition in half steps and the full step or wave drive maxPosition worked out from it. Switching back to half step restores the half step one
+        //unless maxPosition was changed in between, since halving it loses the odd half step. derivedMaxPosition is -1 when there is none.
+        int halfMaxPosition = 0;
+        int derivedMaxPosition = -1;
+        void applyStepMode(StepMode mode);
+        void requestStepMode(uint8_t mode);
+        void changeStepMode(StepMode mode);
+
+        //--Limit Switches
+        int pin_MinSwitch = -1;
+        int pin_MaxSwitch = -1;
+        LightningStepperSwitch minSwitch;
+        LightningStepperSwitch maxSwitch;
+        //The switch the loaded move is heading for. Checked before every step.
+        LightningStepperSwitch* travelSwitch = &minSwitch;
 
         //--Serial Reading    
+        //Every axis shares the one port. Serial at 9600 unless a constructor picked another.
+        static Stream* port;
+        //Set when the library starts the port itself so Cmd 15 can change the rate
+        static HardwareSerial* hardwarePort;
+        //Set while the port is the Serial the library picks when the sketch does not pass one. The library starts it.
+        static bool defaultPort;
+        static unsigned long baudRate;
+        void beginPort();
+        void changeBaudRate(unsigned long baud, bool binary, uint8_t address);
         //This pin is used by the command controller or a button to indicate a message is ready. 
         //This is also used in various places to synchronize activity between controllers
         int pin_CmdReady = 12;
@@ -36,69 +137,307 @@ class LightningStepper
         //Low to High: ready for a message
         //High to Low: processed a message. Ready to be interupted again by the CmdReady pin
         int pin_Processing = 10;
-        //The message read from the serial port
-        String msg = "";
         //Used to block and loop
         bool keepWaiting = true;
-        //Used for cmd parsing
-        int msgLength = 0;
-        //Used for cmd parsing
-        int commaIndex = 0;
-        //Used for cmd parsing
-        int indexOfP = 0;
-        //Used for string comparison/parsing
-        String msgIDEchunk = "Message(";
+        //pin_CmdReady interrupt. The interrupt only raises the flag and run() picks it up. Without an interrupt run() polls the pin.
+        static bool cmdReadyInterrupt;
+        static volatile bool cmdReadyFlag;
+        static volatile bool cmdReadyWasLow;
+        static bool haltOnCmdReady;
+        //Resolved pin_CmdReady input so the pin change interrupt can read it quickly. Wired like a limit switch.
+        LightningStepperSwitch cmdReadyInput;
+        void attachCmdReadyInterrupt();
+        static void cmdReadyFell();
+        static void haltAllAxes();
+        void sleepUntilCmd();
+        static void writePin(int pin, uint8_t value);
+        bool stopSignaled();
+        //Next sequence number a sequenced command must carry. See LightningStepperProtocol.h
+        static uint8_t expectedSequence;
+        //--Script. See LightningStepperScript.h
+        //Read by the step timer before it raises pin_Done so it must be volatile
+        static volatile bool scriptRunning;
+        static uint8_t scriptPc;
+        //What the script is waiting on before its next instruction
+        enum ScriptWait : uint8_t { ScriptReady, ScriptWaitDone, ScriptDwell, ScriptWaitPin };
+        static ScriptWait scriptWait;
+        static unsigned long scriptWaitStart;
+        static unsigned int scriptDwell;
+        static uint8_t scriptPin;
+        static uint8_t scriptPinLevel;
+        //Where each open loop starts and how many times it has left to go. 0 is forever.
+        static uint8_t scriptLoopStart[LIGHTNINGSTEPPER_SCRIPT_LOOPS];
+        static uint8_t scriptLoopCount[LIGHTNINGSTEPPER_SCRIPT_LOOPS];
+        static uint8_t scriptLoopDepth;
+        void writeScript(uint8_t offset, const uint8_t* data, uint8_t count, bool binary);
+        //A wait pin instruction would make its pin an input, so it must not name one the library uses
+        static bool pinInUse(int pin);
+        static bool scriptPinsFree();
+        void startScript();
+        void runScript();
+        void endScript(const __FlashStringHelper* error);
+        //--Bus
+        static uint8_t nodeId;
+        static int pin_DriverEnable;
+        //Set while a broadcast runs so nothing is sent
+        static bool replyMuted;
+        //Queued moves wait for a sync start. See Cmd 17
+        static bool syncHold;
+        static void beginTransmit();
+        static void endTransmit();
+        void sendFrame(uint8_t address, uint8_t opcode, const uint8_t* payload, uint8_t length);
+        static void syncStart();
+        void startQueuedMove();
+        bool acceptSequence(uint8_t sequence, bool reset, uint8_t refusal, bool binary, uint8_t address);
+        void sendAcknowledgement(bool ack, uint8_t sequence, uint8_t reason, bool binary, uint8_t address);
+        //Serial input is parsed a byte at a time from run(). Text lines collect here until the newline arrives.
+        char lineBuffer[48];
+        uint8_t lineLength = 0;
+        bool lineOverflow = false;
+        //Decodes binary command frames. See LightningStepperProtocol.h
+        LightningStepperFrameDecoder frameDecoder;
+        bool receivingBinary = false;
+        //Set once pin_CmdReady is seen and pin_Processing is raised. Cleared when the command has been processed.
+        bool awaitingCmd = false;
+        enum SerialFrame : uint8_t { NoFrame, TextFrame, BinaryFrame, BadFrame, BadSequencedFrame };
 
         //--Settings/Trackers
         // 1 = startUpManually , 2 = startUpAuto   (settings known)
         int launchMode = 0;
         //Delays
-        String minDelayString = "";
-        String maxDelayString = "";
         int minDelayInt = 0;
         int maxDelayInt = 0;
-        String currentDelayString = "";
+        //Speed [0-100] to delay lookup. The curve lives in flash. The span is worked out once when minDelay and maxDelay are set so calculateDelay only does integer math.
+        const uint16_t* speedCurve;
+        unsigned int delaySpan = 0;
         int currentDelayInt = 0;
         //Direction 1 is cw, 2 is ccw
-        String directionString = "";
         int directionInt = 0;
+        //Worked out from the direction when a move is loaded so a step needs no branches. How far coilPhase moves per step (mod 8) and how currentPosition changes.
+        uint8_t movePhaseStep = 0;
+        int8_t positionStep = 0;
         //Steps
-        String stepsString = "";
         int stepsInt = 0;
         //Speed
-        String speedString = "";
         int speedInt = 0;
         //Cmd marks
         //1: get motors speed
         //2: move to postition
         //3: stop
-        String cmdMarkString = "";
+        //4: queue a move
+        //5: queue depth
+        //6: benchmark report
+        //7: clear the benchmark
+        //8: set the axis's settings
+        //9: coordinated move
+        //10: move to an absolute position
+        //11: home
+        //12: step mode
+        //13: status
+        //14: telemetry
+        //15: baud rate
+        //16: sequence reset
+        //17: hold
+        //18: sync start
+        //19: write the script
+        //20: run the script
+        //21: save the script
+        //22: speed profile
         int cmdMarkInt = 0;
 
         //--Postion/State
-        String currentPositionString = "";
         int currentPositionInt = 0;
-        String maxPositionString = "";
         int maxPositionInt = 0;
         //Once the motor reaches max or desired steps it will enter done loop where it just checks the CmdReay pin for message signals. It also does this on start
-        bool done = true;
+        //Set from the step timer interrupt so it must be volatile
+        volatile bool done = true;
         int pin_Done = 11;        
 
-        void waitForMessage(String p_msg);
-        void sendMessage(String p_msg);
-        String readSerial();
-        String cleanMsg(String p_msg);
+        //--Motion Profile
+        //Moves ramp from maxDelay (a speed the motor can always start at) to the commanded delay, cruise, and ramp back down to stop on the last step.
+        //The interval is kept in 24.8 fixed point and updated with the integer Austin recurrence so there is no float math between steps.
+        unsigned long rampDelay = 0;
+        //Number of ramp steps taken. Deceleration starts once the remaining steps reach this count.
+        unsigned int rampStep = 0;
+        //Profile the next move from a stop runs, and the profile of the running move
+        SpeedProfile speedProfile = Trapezoid;
+        SpeedProfile moveProfile = Trapezoid;
+        //Highest profile Cmd 22 and setSpeedProfile accept
+#if defined(LIGHTNINGSTEPPER_SCURVE)
+        static const SpeedProfile lastProfile = SCurve;
+#else
+        static const SpeedProfile lastProfile = Trapezoid;
+#endif
+        //The S-curve ramp is a table of step intervals from maxDelay to the cruise delay. Deceleration reads it backward so only the ramp up is stored.
+        //Tables are worked out whole when a move is started or queued, never in the step timer. A table is kept while its start and cruise delays stay the same.
+        struct SCurvePlan
+        {
+            unsigned int table[LIGHTNINGSTEPPER_SCURVE_STEPS];
+            uint8_t length;
+            //maxDelay and cruise delay the table was worked out for. start is 0 while it is being worked out.
+            int start;
+            int cruise;
+        };
+        //One table for the running move and one planned ahead for the next queued move, so the step timer only switches between them when it chains a move
+#if defined(LIGHTNINGSTEPPER_SCURVE)
+        SCurvePlan sCurvePlans[2] = {};
+        volatile uint8_t sCurveActive = 0;
+#endif
+        void planSCurve();
+        void prepareSCurve();
+        void buildSCurve(int cruise);
+        void pickSCurve();
+        bool sCurvePlanned(uint8_t plan, int cruise);
+        unsigned int nextSCurveDelay(long remaining);
+
+        //--Telemetry
+        //What an axis is doing, as reported by Cmd 13 and telemetry
+        enum MotionState : uint8_t { StateDone, StateMoving, StateHoming, StateFollowing, StateScript };
+        //Status frames are pushed from run() every telemetryMillis. 0 is off.
+        unsigned int telemetryMillis = 0;
+        bool telemetryBinary = false;
+        unsigned long telemetryLast = 0;
+        //Number of axes with telemetry on so run() can skip it when there are none
+        static uint8_t telemetryAxes;
+        //Microseconds until the step after the last one. Set from the step timer.
+        volatile unsigned int stepInterval = 0;
+        void setTelemetry(unsigned int intervalMillis, bool binary);
+        static void sendTelemetry();
+        void sendStatus(bool binary);
+        long stepRate();
+
+        //--Homing
+        //Homing runs from the step timer in place of a move: a fast seek to the switch, a back off until it has been open for LIGHTNINGSTEPPER_HOMING_BACKOFF steps,
+        //then a slow seek at maxDelay. The min switch sets currentPosition to 0 and then a max switch, if attached, sets maxPosition the same way.
+        enum HomingPhase : uint8_t { HomeIdle, HomeSeekFast, HomeBackOff, HomeSeekSlow };
+        enum HomingResult : uint8_t { HomeNone, HomeSucceeded, HomeFailed };
+        volatile HomingPhase homingPhase = HomeIdle;
+        bool homingTowardMax = false;
+        unsigned int homingSteps = 0;
+        unsigned int homingTravel = 0;
+        volatile HomingResult homingResult = HomeNone;
+        //Set from the step timer when any axis finishes homing so run() can report it
+        static volatile bool homingFinished;
+        //Position of this motor in axes[]
+        uint8_t axisId = 0;
+
+        //--Move Queue
+        //Moves waiting behind the running move. The step timer takes the next one off the front the moment the running move finishes.
+        struct MoveSegment
+        {
+            uint8_t speed;
+            int steps;
+            uint8_t direction;
+            //Step mode the move runs in. The mode changes between moves when it differs.
+            uint8_t stepMode;
+        };
+        MoveSegment moveQueue[LIGHTNINGSTEPPER_QUEUE_DEPTH];
+        volatile uint8_t queueHead = 0;
+        volatile uint8_t queueCount = 0;
+
+        //--Step Timer
+        //Steps are emitted from the step timer so run() is free to listen for commands while the motor moves.
+        //Every axis shares the one step timer. Each axis keeps the time its next step is due and the timer fires for whichever axis is due first.
+        static LightningStepper* axes[LIGHTNINGSTEPPER_MAX_AXES];
+        static uint8_t axisCount;
+        //Time of the step timer call that is pending, in microseconds. Only differences matter so it is free to wrap.
+        static unsigned long scheduleClock;
+        unsigned long nextStepTime = 0;
+        volatile bool stepping = false;
+        static unsigned int stepTimerCallback();
+        void startStepping();
+        void stopStepping();
+        static bool allAxesDone();
+        //Microseconds from starting to step until the first step. Longer when the coils have to settle after idling.
+        unsigned int firstStepDelay = 1;
+
+        //--Idle
+        //Once every axis has been done for idleMillis the coils are released or chopped down to holdDuty. coilPhase is left alone so nothing is lost.
+        static unsigned long idleMillis;
+        static uint8_t holdDuty;
+        static bool sleepWhenIdle;
+        //millis() when run() last saw an axis moving
+        static unsigned long idleSince;
+        //True while the coils are released or on the reduced hold. The step timer chops the coils during the hold since no axis is stepping.
+        static volatile bool coilsIdle;
+        static bool holdOn;
+        static void enterIdle();
+        static bool wakeCoils();
+        static unsigned int holdTimerCallback();
+
+        //--Persistence
+        static bool persistent;
+        //True while the newest EEPROM record matches the axes and is marked clean
+        static bool storageClean;
+        //millis() when run() last saw an axis moving or a script running while the record was out of date
+        static unsigned long storageSince;
+        static bool restoreSettings();
+        static void saveSettings();
+
+        //--Coordinated Moves
+        //Axes in a coordinated move arrive together along a straight line. The axis with the most steps leads and runs the motion profile.
+        //Every lead step the other axes add their step count to an error term and step each time it passes the lead's step count (Bresenham).
+        static unsigned int coordinatedSteps;
+        bool leading = false;
+        volatile bool following = false;
+        unsigned int followDelta = 0;
+        unsigned int followError = 0;
+        static void startCoordinatedMove(int speed, const int* deltas, uint8_t count);
+        void stepFollowers();
+        void followLead();
+        void releaseFollowers();
+
+#if defined(LIGHTNINGSTEPPER_BENCHMARK)
+        //--Benchmark
+        //Step timing capture. See LightningStepperBench.h
+        LightningStepperBench bench;
+        //Interval the motion profile asked for before the next step timer interrupt. 0 while the motor is stopped.
+        unsigned int benchScheduled = 0;
+        void sendBenchReport();
+#endif
+
+        void waitForMessage(const char* p_msg);
+        void sendMessage(const char* p_msg);
+        void sendMessage(const __FlashStringHelper* p_msg);
+        void beginReply();
+        void appendReply(char c);
+        void appendReply(const char* text);
+        void appendReply(const __FlashStringHelper* text);
+        void appendReply(long value);
+        void sendReply();
+        char* readMessage();
+        SerialFrame pollSerial();
+        char* cleanMsg(char* p_msg);
+        long nextField(const char*& cursor);
         void calculateDelay(int speedVal);
+        int delayForSpeed(int speedVal);
+        void updateDelayRange();
         void preSetupPrompt();
         void startUpAuto();
         void startUpManually();
-        void processSettings();
-        void processCmd();        
-        void modulateStepper();     
+        void startUpHoming();
+        void processSettings(const char* cursor);
+        void processCmd(SerialFrame frame);
+        void processTextCmd(const char* cursor);
+        void processBinaryCmd(const LightningStepperFrameDecoder& frame);
+        void startMove(int speed, int steps, int direction, unsigned int pathLength = 0);
+        void moveTo(int speed, int position);
+        void startHoming(int speed);
+        unsigned int homeStep();
+        unsigned int finishHoming(HomingResult result);
+        void reportHoming();
+        void markMoving();
+        bool queueMove(int speed, int steps, int direction);
+        void loadMove(int speed, int steps, int direction);
+        void setMoveDirection(int direction);
+        void stopMove();
+        unsigned int finishMove();
+        void sendQueueStatus(bool binary, uint8_t address);
+        unsigned int modulateStepper();     
+        unsigned int nextStepDelay();
+        void stepMove();
         void stepCCW();
         void stepCW();
-        void writePinHigh(int pin);
-        void writePinLow(int pin);     
 };
 
 #endif
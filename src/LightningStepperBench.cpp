@@ -0,0 +1,254 @@
+/*
+  LightningStepperBench.cpp - Step timing capture for the LightningStepper library.
+  Part of the LightningStepper library by Calvin Bultz.
+  Released into the public domain.
+*/
+
+#include "Arduino.h"
+#include "LightningStepperBench.h"
+
+void LightningStepperBench::reset()
+{
+    steps = 0;
+    intervalMin = 0xFFFFFFFFUL;
+    intervalMax = 0;
+    intervalTotal = 0;
+    intervalCount = 0;
+    jitterMax = 0;
+    for (uint8_t i = 0; i < LIGHTNINGSTEPPER_BENCH_BUCKETS; i++)
+    {
+        jitterHistogram[i] = 0;
+    }
+    stepCost = 0;
+    modulateCost = 0;
+    cmdCost = 0;
+    windowSteps = 0;
+    stepRateMax = 0;
+    cmdPending = false;
+    moveStarted = false;
+    latencyLast = 0;
+    latencyMax = 0;
+    //A reset while idle counts the idle time from now
+    idleStart = millis();
+    idleTotal = 0;
+    sleepTotal = 0;
+    wakePending = false;
+    wakeLatencyLast = 0;
+    wakeLatencyMax = 0;
+}
+
+void LightningStepperBench::recordStep(unsigned int scheduledMicros)
+{
+    unsigned int stepTime = LightningStepperBench::now();
+    unsigned long stepMicros = micros();
+    steps++;
+    if (scheduledMicros != 0)
+    {
+        //Only intervals between steps of continuous motion count. The first step after a stop has nothing to compare to.
+        unsigned long interval = (unsigned int)(stepTime - lastStep);
+        //The fine grained clock wraps. Past half of its range go by micros() instead.
+        unsigned long intervalMicros = stepMicros - lastStepMicros;
+        if (intervalMicros > countsToMicros(0x7FFFUL))
+        {
+            interval = (intervalMicros * LIGHTNINGSTEPPER_BENCH_CYCLES_PER_MICRO) / LIGHTNINGSTEPPER_BENCH_CYCLES_PER_COUNT;
+        }
+        unsigned long expected = ((unsigned long)scheduledMicros * LIGHTNINGSTEPPER_BENCH_CYCLES_PER_MICRO) / LIGHTNINGSTEPPER_BENCH_CYCLES_PER_COUNT;
+        unsigned long jitter = (interval > expected) ? (interval - expected) : (expected - interval);
+        if (interval < intervalMin)
+        {
+            intervalMin = interval;
+        }
+        if (interval > intervalMax)
+        {
+            intervalMax = interval;
+        }
+        intervalTotal += interval;
+        intervalCount++;
+        if (jitter > jitterMax)
+        {
+            jitterMax = jitter;
+        }
+        //Bucket n holds jitter of less than 2^n counts
+        uint8_t bucket = 0;
+        while (jitter > 0 && bucket < LIGHTNINGSTEPPER_BENCH_BUCKETS - 1)
+        {
+            jitter >>= 1;
+            bucket++;
+        }
+        jitterHistogram[bucket]++;
+
+        //Achieved step rate over the last window of steps
+        windowSteps++;
+        if (windowSteps == LIGHTNINGSTEPPER_BENCH_WINDOW)
+        {
+            unsigned long elapsed = stepMicros - windowStart;
+            unsigned long rate = (elapsed > 0) ? ((unsigned long)LIGHTNINGSTEPPER_BENCH_WINDOW * 1000000UL) / elapsed : 0;
+            if (rate > stepRateMax)
+            {
+                stepRateMax = rate;
+            }
+            windowSteps = 0;
+            windowStart = stepMicros;
+        }
+    }
+    else
+    {
+        windowSteps = 0;
+        windowStart = stepMicros;
+    }
+    lastStep = stepTime;
+    lastStepMicros = stepMicros;
+
+    if (moveStarted == true)
+    {
+        moveStarted = false;
+        latencyLast = micros() - cmdReadyMicros;
+        if (latencyLast > latencyMax)
+        {
+            latencyMax = latencyLast;
+        }
+    }
+
+    if (wakePending == true)
+    {
+        wakePending = false;
+        wakeLatencyLast = micros() - wakeMicros;
+        if (wakeLatencyLast > wakeLatencyMax)
+        {
+            wakeLatencyMax = wakeLatencyLast;
+        }
+    }
+}
+
+void LightningStepperBench::recordStepCost(unsigned int counts)
+{
+    if (counts > stepCost)
+    {
+        stepCost = counts;
+    }
+}
+
+void LightningStepperBench::recordModulateCost(unsigned int counts)
+{
+    if (counts > modulateCost)
+    {
+        modulateCost = counts;
+    }
+}
+
+void LightningStepperBench::recordCmdCost(unsigned long micros)
+{
+    if (micros > cmdCost)
+    {
+        cmdCost = micros;
+    }
+}
+
+void LightningStepperBench::markCmdReady()
+{
+    cmdReadyMicros = micros();
+    cmdPending = true;
+}
+
+void LightningStepperBench::markMoveStarted()
+{
+    //Moves that did not come from a pin_CmdReady handshake have no start time to measure from
+    if (cmdPending == true)
+    {
+        cmdPending = false;
+        moveStarted = true;
+    }
+}
+
+void LightningStepperBench::markIdle(uint8_t holdDuty)
+{
+    idle = true;
+    idleStart = millis();
+    idleDuty = holdDuty;
+}
+
+void LightningStepperBench::markAwake()
+{
+    if (idle == true)
+    {
+        idle = false;
+        idleTotal += millis() - idleStart;
+    }
+}
+
+void LightningStepperBench::markWakeMove()
+{
+    wakeMicros = micros();
+    wakePending = true;
+}
+
+void LightningStepperBench::recordSleep(unsigned long micros)
+{
+    sleepTotal += micros;
+}
+
+unsigned long LightningStepperBench::countsToMicros(unsigned long counts)
+{
+    return (counts * LIGHTNINGSTEPPER_BENCH_CYCLES_PER_COUNT) / LIGHTNINGSTEPPER_BENCH_CYCLES_PER_MICRO;
+}
+
+//Upper edge in microseconds of the histogram bucket that holds the given percentile
+unsigned long LightningStepperBench::jitterPercentile(unsigned long total, uint8_t percent)
+{
+    unsigned long target = (total * percent + 99) / 100;
+    unsigned long seen = 0;
+    for (uint8_t i = 0; i < LIGHTNINGSTEPPER_BENCH_BUCKETS; i++)
+    {
+        seen += jitterHistogram[i];
+        if (seen >= target)
+        {
+            //The bucket edge can be past the worst jitter actually seen
+            unsigned long edge = (1UL << i) - 1;
+            return countsToMicros(edge < jitterMax ? edge : jitterMax);
+        }
+    }
+    return countsToMicros(jitterMax);
+}
+
+void LightningStepperBench::report(Print& port, const char* modeName)
+{
+    unsigned long modulateCycles = (unsigned long)modulateCost * LIGHTNINGSTEPPER_BENCH_CYCLES_PER_COUNT;
+    port.print(F("Bench: steps="));
+    port.print(steps);
+    port.print(F(",interval_min_us="));
+    port.print(intervalCount > 0 ? countsToMicros(intervalMin) : 0UL);
+    port.print(F(",interval_max_us="));
+    port.print(countsToMicros(intervalMax));
+    port.print(F(",interval_mean_us="));
+    port.print(intervalCount > 0 ? countsToMicros(intervalTotal / intervalCount) : 0UL);
+    port.print(F(",jitter_p50_us="));
+    port.print(jitterPercentile(intervalCount, 50));
+    port.print(F(",jitter_p99_us="));
+    port.print(jitterPercentile(intervalCount, 99));
+    port.print(F(",jitter_max_us="));
+    port.print(countsToMicros(jitterMax));
+    port.print(F(",step_cycles="));
+    port.print((unsigned long)stepCost * LIGHTNINGSTEPPER_BENCH_CYCLES_PER_COUNT);
+    port.print(F(",modulate_cycles="));
+    port.print(modulateCycles);
+    port.print(F(",cmd_cycles="));
+    port.print(cmdCost * LIGHTNINGSTEPPER_BENCH_CYCLES_PER_MICRO);
+    port.print(F(",max_steps_per_s="));
+    port.print(stepRateMax);
+    port.print(F(",latency_last_us="));
+    port.print(latencyLast);
+    port.print(F(",latency_max_us="));
+    port.print(latencyMax);
+    port.print(F(",idle_ms="));
+    port.print(idleTotal + (idle ? millis() - idleStart : 0UL));
+    port.print(F(",sleep_ms="));
+    port.print(sleepTotal / 1000UL);
+    port.print(F(",idle_current_pct="));
+    port.print(((unsigned int)idleDuty * 100U + 127U) / 255U);
+    port.print(F(",wake_latency_last_us="));
+    port.print(wakeLatencyLast);
+    port.print(F(",wake_latency_max_us="));
+    port.print(wakeLatencyMax);
+    port.print(F(",mode="));
+    port.print(modeName);
+}
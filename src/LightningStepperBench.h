@@ -0,0 +1,111 @@
+/*
+  LightningStepperBench.h - Step timing capture for the LightningStepper library.
+  Part of the LightningStepper library by Calvin Bultz.
+  Released into the public domain.
+  -Uncomment LIGHTNINGSTEPPER_BENCHMARK below to capture timing on the stepper controller. It adds a little time to every step so leave it off in production.
+  -Send Message(6) for the report and Message(7) to clear it. The report is one line of key=value pairs so it is easy to log and compare between versions:
+    Strike(Bench: steps=..,interval_min_us=..,interval_max_us=..,interval_mean_us=..,jitter_p50_us=..,jitter_p99_us=..,jitter_max_us=..,
+                  step_cycles=..,modulate_cycles=..,cmd_cycles=..,max_steps_per_s=..,latency_last_us=..,latency_max_us=..,
+                  idle_ms=..,sleep_ms=..,idle_current_pct=..,wake_latency_last_us=..,wake_latency_max_us=..,mode=..)
+  -Jitter is how far each step interval landed from the interval the motion profile asked for. The percentiles are the upper edge of a power of two histogram bucket.
+  -The cycle counts are the worst case seen. max_steps_per_s is the fastest step rate actually reached over LIGHTNINGSTEPPER_BENCH_WINDOW steps in a row of continuous motion.
+    Lower minDelay until it stops following the commanded rate to find the fastest rate the stepper controller can keep up.
+  -Intervals are timed with the fine grained clock and fall back to micros() once they are too long for it, so slow steps (ex: homing or a long maxDelay) are measured right too.
+  -steps counts step timer interrupts, including the one that finds a move finished.
+  -Latency is from pin_CmdReady being seen low to the first step of the move that command started. Each axis reports the latency of the commands that moved it.
+  -idle_ms is the time the coils spent released or on the reduced hold and sleep_ms the part of it spent asleep. See setIdlePolicy.
+  -idle_current_pct is the coil current while idle as a percent of the full hold, worked out from the hold duty. The board cannot measure current so use a meter on the supply for absolute numbers.
+  -Wake latency is from the coils being re-energized for a move to its first step, which includes LIGHTNINGSTEPPER_WAKE_SETTLE.
+*/
+#ifndef LightningStepperBench_h
+#define LightningStepperBench_h
+#include "Arduino.h"
+
+//#define LIGHTNINGSTEPPER_BENCHMARK
+
+#if defined(F_CPU)
+#define LIGHTNINGSTEPPER_BENCH_CYCLES_PER_MICRO (F_CPU / 1000000UL)
+#else
+#define LIGHTNINGSTEPPER_BENCH_CYCLES_PER_MICRO 1UL
+#endif
+
+#if defined(__AVR__)
+//Timer1 runs free with a prescaler of 8 for the step timer so it doubles as a clock that counts every 8 cycles
+#define LIGHTNINGSTEPPER_BENCH_CYCLES_PER_COUNT 8UL
+#else
+#define LIGHTNINGSTEPPER_BENCH_CYCLES_PER_COUNT LIGHTNINGSTEPPER_BENCH_CYCLES_PER_MICRO
+#endif
+
+#define LIGHTNINGSTEPPER_BENCH_BUCKETS 10
+//Steps in a row the achieved step rate is measured over
+#define LIGHTNINGSTEPPER_BENCH_WINDOW 64
+
+class LightningStepperBench
+{
+    public:
+        //Fine grained clock for measuring short stretches of code. Wraps so only differences are meaningful.
+        static inline unsigned int now()
+        {
+#if defined(__AVR__)
+            return TCNT1;
+#else
+            return (unsigned int)micros();
+#endif
+        }
+
+        void reset();
+        //Called by the step timer right before a step. scheduledMicros is the interval the motion profile asked for, 0 if the motor was stopped.
+        void recordStep(unsigned int scheduledMicros);
+        void recordStepCost(unsigned int counts);
+        void recordModulateCost(unsigned int counts);
+        //Commands can take longer than the fine grained clock takes to wrap so they are timed in microseconds
+        void recordCmdCost(unsigned long micros);
+        //pin_CmdReady was seen low
+        void markCmdReady();
+        //A command started a move. Its first step closes the latency measurement.
+        void markMoveStarted();
+        //The coils were released or dropped to holdDuty [0-255]
+        void markIdle(uint8_t holdDuty);
+        //The coils were re-energized
+        void markAwake();
+        //This axis re-energized the coils to start a move. Its first step closes the wake latency measurement.
+        void markWakeMove();
+        void recordSleep(unsigned long micros);
+        //Print the key=value report without the Strike() block
+        void report(Print& port, const char* modeName);
+    private:
+        unsigned long steps = 0;
+        unsigned int lastStep = 0;
+        unsigned long lastStepMicros = 0;
+        unsigned long intervalMin = 0xFFFFFFFFUL;
+        unsigned long intervalMax = 0;
+        unsigned long intervalTotal = 0;
+        unsigned long intervalCount = 0;
+        unsigned long jitterMax = 0;
+        unsigned long jitterHistogram[LIGHTNINGSTEPPER_BENCH_BUCKETS];
+        unsigned int stepCost = 0;
+        unsigned int modulateCost = 0;
+        unsigned long cmdCost = 0;
+        unsigned long windowStart = 0;
+        unsigned int windowSteps = 0;
+        unsigned long stepRateMax = 0;
+        unsigned long cmdReadyMicros = 0;
+        bool cmdPending = false;
+        bool moveStarted = false;
+        unsigned long latencyLast = 0;
+        unsigned long latencyMax = 0;
+        bool idle = false;
+        unsigned long idleStart = 0;
+        unsigned long idleTotal = 0;
+        unsigned long sleepTotal = 0;
+        uint8_t idleDuty = 0;
+        unsigned long wakeMicros = 0;
+        bool wakePending = false;
+        unsigned long wakeLatencyLast = 0;
+        unsigned long wakeLatencyMax = 0;
+
+        static unsigned long countsToMicros(unsigned long counts);
+        unsigned long jitterPercentile(unsigned long total, uint8_t percent);
+};
+
+#endif
@@ -0,0 +1,149 @@
+/*
+  LightningStepperCoils.h - Coil output backends used by the LightningStepper library.
+  Part of the LightningStepper library by Calvin Bultz.
+  Released into the public domain.
+  -Both backends take a coil pattern where bit 0 is IN1 through bit 3 is IN4.
+  -The backend is picked at compile time so there is no runtime branching between backends in the step path.
+  -On AVR boards the port register backend is used. It needs the four coil pins of every motor on one port.
+    Uncomment LIGHTNINGSTEPPER_SPLIT_PORT_COILS below if a motor's pins span ports, or LIGHTNINGSTEPPER_DIGITALWRITE_COILS to force digitalWrite.
+*/
+#ifndef LightningStepperCoils_h
+#define LightningStepperCoils_h
+#include "Arduino.h"
+
+//#define LIGHTNINGSTEPPER_DIGITALWRITE_COILS
+//#define LIGHTNINGSTEPPER_SPLIT_PORT_COILS
+
+//Writes the coils with digitalWrite. Works on every board and pin.
+class LightningStepperDigitalWriteCoils
+{
+    public:
+        //Every pin works so it always returns true
+        bool begin(int pin1, int pin2, int pin3, int pin4)
+        {
+            pins[0] = pin1;
+            pins[1] = pin2;
+            pins[2] = pin3;
+            pins[3] = pin4;
+            for (uint8_t i = 0; i < 4; i++)
+            {
+                pinMode(pins[i], OUTPUT);
+                digitalWrite(pins[i], LOW);
+            }
+            return true;
+        }
+
+        inline void write(uint8_t pattern)
+        {
+            digitalWrite(pins[0], pattern & 0x01);
+            digitalWrite(pins[1], (pattern >> 1) & 0x01);
+            digitalWrite(pins[2], (pattern >> 2) & 0x01);
+            digitalWrite(pins[3], (pattern >> 3) & 0x01);
+        }
+    private:
+        uint8_t pins[4];
+};
+
+#if defined(__AVR__)
+//Writes the coils straight to a port output register. All four pins must be on one port (ex: pins 2-5 or A0-A3 on an Uno) so a step is a single masked register update
+//and every coil changes at the same instant. The port bits of every coil pattern are worked out once in begin().
+class LightningStepperPortCoils
+{
+    public:
+        //Returns false if the pins are not all on one port. Only the pins on the port of pin1 are driven then.
+        bool begin(int pin1, int pin2, int pin3, int pin4)
+        {
+            int pins[4] = { pin1, pin2, pin3, pin4 };
+            bool shared = true;
+            port = portOutputRegister(digitalPinToPort(pins[0]));
+            for (uint8_t pattern = 0; pattern < 16; pattern++)
+            {
+                portBits[pattern] = 0;
+            }
+            for (uint8_t i = 0; i < 4; i++)
+            {
+                //digitalWrite also turns off any PWM timer attached to the pin so the register writes are not overridden
+                pinMode(pins[i], OUTPUT);
+                digitalWrite(pins[i], LOW);
+                if (portOutputRegister(digitalPinToPort(pins[i])) != port)
+                {
+                    shared = false;
+                    continue;
+                }
+                for (uint8_t pattern = 0; pattern < 16; pattern++)
+                {
+                    if (pattern & (1 << i))
+                    {
+                        portBits[pattern] |= digitalPinToBitMask(pins[i]);
+                    }
+                }
+            }
+            mask = portBits[0x0F];
+            return shared;
+        }
+
+        inline void write(uint8_t pattern)
+        {
+            //Interrupts are held off so an interrupt writing the same port cannot be lost between the read and the write
+            uint8_t oldSREG = SREG;
+            cli();
+            *port = (*port & ~mask) | portBits[pattern];
+            SREG = oldSREG;
+        }
+    private:
+        volatile uint8_t* port = 0;
+        uint8_t mask = 0;
+        uint8_t portBits[16];
+};
+
+//Writes each coil pin in its own port register, for pins spread over more than one port (ex: pins 6-9 on an Uno).
+//The pins change one after another, so for about a microsecond the coils are part old pattern and part new. That is far shorter than a coil
+//can respond to, but it is not glitch free, so put the pins on one port and use LightningStepperPortCoils where the board allows.
+class LightningStepperSplitPortCoils
+{
+    public:
+        bool begin(int pin1, int pin2, int pin3, int pin4)
+        {
+            int pins[4] = { pin1, pin2, pin3, pin4 };
+            for (uint8_t i = 0; i < 4; i++)
+            {
+                pinMode(pins[i], OUTPUT);
+                digitalWrite(pins[i], LOW);
+                pinPort[i] = portOutputRegister(digitalPinToPort(pins[i]));
+                pinMask[i] = digitalPinToBitMask(pins[i]);
+            }
+            return true;
+        }
+
+        inline void write(uint8_t pattern)
+        {
+            uint8_t oldSREG = SREG;
+            cli();
+            for (uint8_t i = 0; i < 4; i++)
+            {
+                if (pattern & (1 << i))
+                {
+                    *pinPort[i] |= pinMask[i];
+                }
+                else
+                {
+                    *pinPort[i] &= ~pinMask[i];
+                }
+            }
+            SREG = oldSREG;
+        }
+    private:
+        volatile uint8_t* pinPort[4];
+        uint8_t pinMask[4];
+};
+#endif
+
+#if defined(__AVR__) && !defined(LIGHTNINGSTEPPER_DIGITALWRITE_COILS) && defined(LIGHTNINGSTEPPER_SPLIT_PORT_COILS)
+typedef LightningStepperSplitPortCoils LightningStepperCoils;
+#elif defined(__AVR__) && !defined(LIGHTNINGSTEPPER_DIGITALWRITE_COILS)
+typedef LightningStepperPortCoils LightningStepperCoils;
+#else
+typedef LightningStepperDigitalWriteCoils LightningStepperCoils;
+#endif
+
+#endif
@@ -0,0 +1,148 @@
+/*
+  LightningStepperProtocol.cpp - Compact binary command protocol used by the LightningStepper library.
+  Part of the LightningStepper library by Calvin Bultz.
+  Released into the public domain.
+*/
+
+#include "Arduino.h"
+#include "LightningStepperProtocol.h"
+
+uint8_t LightningStepperProtocol::crc8(uint8_t crc, uint8_t data)
+{
+    crc ^= data;
+    for (uint8_t i = 0; i < 8; i++)
+    {
+        if (crc & 0x80)
+        {
+            crc = (crc << 1) ^ 0x07;
+        }
+        else
+        {
+            crc <<= 1;
+        }
+    }
+    return crc;
+}
+
+void LightningStepperProtocol::writeFrame(Stream& port, uint8_t address, uint8_t opcode, const uint8_t* payload, uint8_t length)
+{
+    port.write(sync);
+    writeBody(port, 0, address, opcode, payload, length);
+}
+
+void LightningStepperProtocol::writeSequencedFrame(Stream& port, uint8_t sequence, uint8_t address, uint8_t opcode, const uint8_t* payload, uint8_t length)
+{
+    port.write(syncSequenced);
+    port.write(sequence);
+    writeBody(port, crc8(0, sequence), address, opcode, payload, length);
+}
+
+void LightningStepperProtocol::writeBody(Stream& port, uint8_t crc, uint8_t address, uint8_t opcode, const uint8_t* payload, uint8_t length)
+{
+    crc = crc8(crc, address);
+    crc = crc8(crc, opcode);
+    crc = crc8(crc, length);
+    port.write(address);
+    port.write(opcode);
+    port.write(length);
+    for (uint8_t i = 0; i < length; i++)
+    {
+        crc = crc8(crc, payload[i]);
+        port.write(payload[i]);
+    }
+    port.write(crc);
+}
+
+void LightningStepperProtocol::putUInt16(uint8_t* buffer, uint16_t value)
+{
+    buffer[0] = value & 0xFF;
+    buffer[1] = value >> 8;
+}
+
+uint16_t LightningStepperProtocol::getUInt16(const uint8_t* buffer)
+{
+    return (uint16_t)buffer[0] | ((uint16_t)buffer[1] << 8);
+}
+
+void LightningStepperProtocol::putUInt32(uint8_t* buffer, uint32_t value)
+{
+    putUInt16(&buffer[0], value & 0xFFFF);
+    putUInt16(&buffer[2], value >> 16);
+}
+
+uint32_t LightningStepperProtocol::getUInt32(const uint8_t* buffer)
+{
+    return (uint32_t)getUInt16(&buffer[0]) | ((uint32_t)getUInt16(&buffer[2]) << 16);
+}
+
+void LightningStepperFrameDecoder::reset()
+{
+    state = WaitSync;
+    index = 0;
+    crc = 0;
+}
+
+LightningStepperFrameDecoder::Status LightningStepperFrameDecoder::feed(uint8_t data)
+{
+    switch (state)
+    {
+    case WaitSync:
+        //Anything before the sync byte is noise
+        if (data == LightningStepperProtocol::sync)
+        {
+            crc = 0;
+            sequenced = false;
+            state = ReadAddress;
+        }
+        else if (data == LightningStepperProtocol::syncSequenced)
+        {
+            crc = 0;
+            sequenced = true;
+            state = ReadSequence;
+        }
+        return Incomplete;
+    case ReadSequence:
+        sequence = data;
+        crc = LightningStepperProtocol::crc8(crc, data);
+        state = ReadAddress;
+        return Incomplete;
+    case ReadAddress:
+        address = data;
+        crc = LightningStepperProtocol::crc8(crc, data);
+        state = ReadOpcode;
+        return Incomplete;
+    case ReadOpcode:
+        opcode = data;
+        crc = LightningStepperProtocol::crc8(crc, data);
+        state = ReadLength;
+        return Incomplete;
+    case ReadLength:
+        length = data;
+        crc = LightningStepperProtocol::crc8(crc, data);
+        if (length > LIGHTNINGSTEPPER_MAX_PAYLOAD)
+        {
+            LightningStepperFrameDecoder::reset();
+            return Error;
+        }
+        index = 0;
+        state = (length == 0) ? ReadCrc : ReadPayload;
+        return Incomplete;
+    case ReadPayload:
+        payload[index] = data;
+        index++;
+        crc = LightningStepperProtocol::crc8(crc, data);
+        if (index >= length)
+        {
+            state = ReadCrc;
+        }
+        return Incomplete;
+    case ReadCrc:
+        state = WaitSync;
+        if (data != crc)
+        {
+            return Error;
+        }
+        return Complete;
+    }
+    return Incomplete;
+}
@@ -0,0 +1,130 @@
+/*
+  LightningStepperProtocol.h - Compact binary command protocol used by the LightningStepper library.
+  Part of the LightningStepper library by Calvin Bultz.
+  Released into the public domain.
+
+  Frame layout:
+    Sync     1 byte   0xA5. "Message(" text can never start with it so both protocols can share the serial port.
+    Address  1 byte   The high nibble is the node, the stepper controller set with setBusNode (0 by default). The low nibble is the axis.
+                      Axis 0 is the motor that ran the setup and attached axes count up from 1. Node 15 is a broadcast every node runs and none replies to.
+    Opcode   1 byte   Commands use the same numbers as the text commands. Replies set the high bit.
+    Length   1 byte   Number of payload bytes. At most LIGHTNINGSTEPPER_MAX_PAYLOAD.
+    Payload  Length bytes. Fixed width little endian fields.
+    CRC8     1 byte   CRC-8 (poly 0x07, init 0) of Address through Payload.
+
+  Sequenced frames start with 0xA6 and put a sequence number in front of the address. The CRC covers Sequence through Payload.
+    Sync     1 byte   0xA6
+    Sequence 1 byte   Counts up by one per command and wraps at 255.
+    Address, Opcode, Length, Payload, CRC8 as above.
+  Every sequenced command is answered with an ACK or a NAK frame so commands can be sent at any time without the pin handshake.
+  Commands run in sequence order. A duplicate of one that already ran is ACKed again but not run twice.
+  On a NAK or no ACK in time the command controller sends the command the NAK names and everything after it again.
+    0xFE ACK.            sequence(u8)                                   The command ran, or already had.
+    0xFF NAK.            expected(u8),reason(u8)                        Nothing from expected on ran. Reason 1 out of order, 2 bad CRC, 3 queue full so try it again later,
+                                                                        4 no axis at the address so expected goes to the next command instead.
+
+  Commands:
+    0x01 Get settings.   No payload.                                    Replies 0x81: currentPosition(i16),maxPosition(i16),minDelay(u16),maxDelay(u16)
+    0x02 Move.           speed(u8),steps(u16),direction(u8)             No Reply
+    0x03 Stop.           No payload.                                    No Reply
+    0x04 Queue move.     speed(u8),steps(u16),direction(u8)             Replies 0x85 only if the queue is full
+    0x05 Queue status.   No payload.                                    Replies 0x85: depth(u8),capacity(u8)
+    0x08 Set settings.   minDelay(u16),maxDelay(u16),currentPosition(i16),maxPosition(i16)    No Reply
+    0x09 Coordinated.    speed(u8),delta0(i16),delta1(i16)...           No Reply. Any address. The deltas are for axis 0, 1, 2... in order.
+    0x0A Move to.        speed(u8),position(i16)                        No Reply. Clamped to [0, maxPosition].
+    0x0B Home.           speed(u8)                                      No Reply. pin_Done goes high when it finishes. Ignored without a min switch.
+    0x0C Step mode.      mode(u8)                                       No Reply. 0 full step, 1 half step, 2 wave drive. Waits for running and queued moves.
+    0x0D Status.         No payload.                                    Replies 0x8D: position(i16),velocity(i16),state(u8),queueDepth(u8). Does not stop the motor.
+    0x0E Telemetry.      interval(u16),format(u8)                       No Reply. Sends the status every interval milliseconds, 0 turns it off. Format 0 text, 1 binary 0x8D frames.
+    0x0F Baud rate.      baud(u32)                                      Replies 0x8F: baud(u32) at the old rate, then switches. Max 1000000.
+    0x10 Sequence reset. No payload.                                    No Reply besides the ACK. Sent sequenced. Always accepted and the count carries on from its sequence number.
+    0x11 Hold.           No payload.                                    No Reply. Queued moves (0x04) wait instead of starting when the axis is done. Covers every axis of the node.
+    0x12 Sync start.     No payload.                                    No Reply. Ends the hold and starts the queued moves of every axis of the node. Broadcast it to start the nodes together.
+    0x13 Script write.   offset(u8),byte,byte...                        No Reply. Copies the bytes into the script at offset. Offset 0 starts a new script. See LightningStepperScript.h
+    0x14 Script run.     No payload.                                    No Reply. pin_Done goes high when it finishes and the motors are done.
+    0x15 Script save.    No payload.                                    No Reply. Saved to EEPROM and loaded again at power up.
+    0x16 Speed profile.  profile(u8)                                    No Reply. 0 trapezoid, 1 S-curve. Applies from the next move that starts from a stop.
+
+  Broadcasts are never ACKed and do not use up a sequence number.
+*/
+#ifndef LightningStepperProtocol_h
+#define LightningStepperProtocol_h
+#include "Arduino.h"
+
+#define LIGHTNINGSTEPPER_MAX_PAYLOAD 16
+
+class LightningStepperProtocol
+{
+    public:
+        static const uint8_t sync = 0xA5;
+        static const uint8_t syncSequenced = 0xA6;
+        static const uint8_t replyFlag = 0x80;
+        //High nibble of the address
+        static const uint8_t broadcastNode = 0x0F;
+
+        static const uint8_t opGetSettings = 0x01;
+        static const uint8_t opMove = 0x02;
+        static const uint8_t opStop = 0x03;
+        static const uint8_t opQueueMove = 0x04;
+        static const uint8_t opQueueStatus = 0x05;
+        static const uint8_t opSetSettings = 0x08;
+        static const uint8_t opCoordinatedMove = 0x09;
+        static const uint8_t opMoveTo = 0x0A;
+        static const uint8_t opHome = 0x0B;
+        static const uint8_t opStepMode = 0x0C;
+        static const uint8_t opStatus = 0x0D;
+        static const uint8_t opTelemetry = 0x0E;
+        static const uint8_t opBaudRate = 0x0F;
+        static const uint8_t opSequenceReset = 0x10;
+        static const uint8_t opHold = 0x11;
+        static const uint8_t opSyncStart = 0x12;
+        static const uint8_t opScriptWrite = 0x13;
+        static const uint8_t opScriptRun = 0x14;
+        static const uint8_t opScriptSave = 0x15;
+        static const uint8_t opSpeedProfile = 0x16;
+        //Acknowledgements for sequenced commands. They are replies only.
+        static const uint8_t opAck = 0xFE;
+        static const uint8_t opNak = 0xFF;
+        static const uint8_t nakOutOfOrder = 1;
+        static const uint8_t nakBadCrc = 2;
+        static const uint8_t nakBusy = 3;
+        static const uint8_t nakNoAxis = 4;
+
+        static uint8_t crc8(uint8_t crc, uint8_t data);
+        //Write a whole frame to a serial port
+        static void writeFrame(Stream& port, uint8_t address, uint8_t opcode, const uint8_t* payload, uint8_t length);
+        static void writeSequencedFrame(Stream& port, uint8_t sequence, uint8_t address, uint8_t opcode, const uint8_t* payload, uint8_t length);
+        static void putUInt16(uint8_t* buffer, uint16_t value);
+        static uint16_t getUInt16(const uint8_t* buffer);
+        static void putUInt32(uint8_t* buffer, uint32_t value);
+        static uint32_t getUInt32(const uint8_t* buffer);
+    private:
+        //Address through Payload and the CRC
+        static void writeBody(Stream& port, uint8_t crc, uint8_t address, uint8_t opcode, const uint8_t* payload, uint8_t length);
+};
+
+//Zero allocation state machine that decodes frames one byte at a time
+class LightningStepperFrameDecoder
+{
+    public:
+        enum Status : uint8_t { Incomplete, Complete, Error };
+
+        //Feed the next byte from the serial port. Complete means address, opcode, length, and payload hold a frame with a good CRC.
+        Status feed(uint8_t data);
+        void reset();
+
+        uint8_t address = 0;
+        uint8_t opcode = 0;
+        uint8_t length = 0;
+        uint8_t payload[LIGHTNINGSTEPPER_MAX_PAYLOAD];
+        //Set from the sync byte so a sequenced frame with a bad CRC can still be NAKed
+        bool sequenced = false;
+        uint8_t sequence = 0;
+    private:
+        enum State : uint8_t { WaitSync, ReadSequence, ReadAddress, ReadOpcode, ReadLength, ReadPayload, ReadCrc };
+        State state = WaitSync;
+        uint8_t index = 0;
+        uint8_t crc = 0;
+};
+
+#endif
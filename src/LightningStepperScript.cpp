@@ -0,0 +1,168 @@
+/*
+  LightningStepperScript.cpp - Motion scripts stored on the stepper controller for the LightningStepper library.
+  Part of the LightningStepper library by Calvin Bultz.
+  Released into the public domain.
+*/
+
+#include "Arduino.h"
+#include "LightningStepperScript.h"
+#include "LightningStepperProtocol.h"
+#include "LightningStepperStorage.h"
+
+#if defined(LIGHTNINGSTEPPER_EEPROM)
+#include <avr/eeprom.h>
+#endif
+
+uint8_t LightningStepperScript::code[LIGHTNINGSTEPPER_SCRIPT_SIZE];
+uint8_t LightningStepperScript::length = 0;
+uint8_t LightningStepperScript::saveIndex = 0;
+bool LightningStepperScript::savePending = false;
+
+uint8_t LightningStepperScript::instructionSize(uint8_t opcode)
+{
+    switch (opcode)
+    {
+    case opEnd:
+    case opWaitDone:
+    case opEndLoop:
+        return 1;
+    case opLoop:
+        return 2;
+    case opDwell:
+    case opWaitPin:
+        return 3;
+    case opMoveTo:
+        return 5;
+    case opMove:
+    case opQueueMove:
+        return 6;
+    }
+    return 0;
+}
+
+bool LightningStepperScript::write(uint8_t offset, const uint8_t* data, uint8_t count)
+{
+    if ((unsigned int)offset + count > LIGHTNINGSTEPPER_SCRIPT_SIZE)
+    {
+        return false;
+    }
+    if (offset == 0)
+    {
+        length = 0;
+    }
+    for (uint8_t i = 0; i < count; i++)
+    {
+        code[offset + i] = data[i];
+    }
+    if (offset + count > length)
+    {
+        length = offset + count;
+    }
+    return true;
+}
+
+//Same CRC-8 as the binary protocol over the length and the code
+uint8_t LightningStepperScript::scriptCrc()
+{
+    uint8_t crc = LightningStepperProtocol::crc8(0, length);
+    for (uint8_t i = 0; i < length; i++)
+    {
+        crc = LightningStepperProtocol::crc8(crc, code[i]);
+    }
+    return crc;
+}
+
+bool LightningStepperScript::saving()
+{
+    return savePending;
+}
+
+#if defined(LIGHTNINGSTEPPER_EEPROM)
+
+void LightningStepperScript::save()
+{
+    //A script that is already saved is left alone so the length byte is not worn by saving it again
+    if (eeprom_is_ready() != 0 && eeprom_read_byte((const uint8_t*)LIGHTNINGSTEPPER_SCRIPT_ADDRESS) == length
+        && eeprom_read_byte((const uint8_t*)(LIGHTNINGSTEPPER_SCRIPT_ADDRESS + 1)) == LightningStepperScript::scriptCrc())
+    {
+        bool same = true;
+        for (uint8_t i = 0; i < length && same == true; i++)
+        {
+            same = (eeprom_read_byte((const uint8_t*)((size_t)LIGHTNINGSTEPPER_SCRIPT_ADDRESS + 2 + i)) == code[i]);
+        }
+        if (same == true)
+        {
+            return;
+        }
+    }
+    saveIndex = 0;
+    savePending = true;
+}
+
+bool LightningStepperScript::service()
+{
+    //A byte takes about 3.3ms. Never wait for one.
+    if (savePending == false || eeprom_is_ready() == 0)
+    {
+        return savePending;
+    }
+    if (saveIndex == 0)
+    {
+        //A length of 0 means no script, so power lost part way leaves nothing to load instead of a half written script
+        eeprom_update_byte((uint8_t*)LIGHTNINGSTEPPER_SCRIPT_ADDRESS, 0);
+    }
+    else if (saveIndex <= length)
+    {
+        //Only the bytes that changed are written
+        eeprom_update_byte((uint8_t*)((size_t)LIGHTNINGSTEPPER_SCRIPT_ADDRESS + 1 + saveIndex), code[saveIndex - 1]);
+    }
+    else if (saveIndex == length + 1)
+    {
+        eeprom_update_byte((uint8_t*)(LIGHTNINGSTEPPER_SCRIPT_ADDRESS + 1), LightningStepperScript::scriptCrc());
+    }
+    else
+    {
+        eeprom_update_byte((uint8_t*)LIGHTNINGSTEPPER_SCRIPT_ADDRESS, length);
+        savePending = false;
+        return false;
+    }
+    saveIndex++;
+    return true;
+}
+
+bool LightningStepperScript::load()
+{
+    length = eeprom_read_byte((const uint8_t*)LIGHTNINGSTEPPER_SCRIPT_ADDRESS);
+    //Blank EEPROM reads 0xFF
+    if (length == 0 || length > LIGHTNINGSTEPPER_SCRIPT_SIZE)
+    {
+        length = 0;
+        return false;
+    }
+    eeprom_read_block(code, (const void*)(LIGHTNINGSTEPPER_SCRIPT_ADDRESS + 2), length);
+    if (eeprom_read_byte((const uint8_t*)(LIGHTNINGSTEPPER_SCRIPT_ADDRESS + 1)) != LightningStepperScript::scriptCrc())
+    {
+        length = 0;
+        return false;
+    }
+    return true;
+}
+
+#else
+
+void LightningStepperScript::save()
+{
+    //No EEPROM support on this board
+}
+
+bool LightningStepperScript::service()
+{
+    return false;
+}
+
+bool LightningStepperScript::load()
+{
+    return false;
+}
+
+#endif
@@ -0,0 +1,77 @@
+/*
+  LightningStepperScript.h - Motion scripts stored on the stepper controller for the LightningStepper library.
+  Part of the LightningStepper library by Calvin Bultz.
+  Released into the public domain.
+  -A script is a short bytecode program held in RAM. Cmd 19 writes it, Cmd 20 runs it, and Cmd 21 saves it to EEPROM so it is loaded again at power up.
+  -run() steps through it a few instructions at a time so the motor and the serial port keep running. pin_Done stays low until the script ends.
+  -Anything that stops the motor (Cmd 1, Cmd 3, halt) also stops the script.
+  -Cmd 21 saves a byte per run() call as the EEPROM is ready for it, about a quarter second for a full script. Cmd 19 is refused until it is done.
+
+  Instructions. Multi byte fields are little endian like the binary protocol.
+    0x00 End.            No arguments.                                  Ends the script. Running off the end does the same.
+    0x01 Move.           axis(u8),speed(u8),steps(u16),direction(u8)    Starts a move like Cmd 2 and goes on to the next instruction right away.
+    0x02 Move to.        axis(u8),speed(u8),position(i16)               Starts a move like Cmd 10 and goes on right away.
+    0x03 Wait done.      No arguments.                                  Waits until every axis is done.
+    0x04 Dwell.          millis(u16)                                    Waits this many milliseconds.
+    0x05 Loop.           count(u8)                                      Runs everything up to the matching End loop count times. 0 loops until stopped.
+    0x06 End loop.       No arguments.
+    0x07 Wait pin.       pin(u8),level(u8)                              Waits until the pin reads level. The pin is an INPUT_PULLUP so a button to ground reads 0. Pins the library uses are refused.
+    0x08 Queue move.     axis(u8),speed(u8),steps(u16),direction(u8)    Queues a move like Cmd 4 so it runs right after the one before it.
+
+  Ex: move to 2012, then go back and forth 4 times pausing a second between each
+    02 00 5A DC 07   03   05 04   01 00 64 E8 03 01   04 E8 03   01 00 64 E8 03 02   04 E8 03   06   03   00
+*/
+#ifndef LightningStepperScript_h
+#define LightningStepperScript_h
+#include "Arduino.h"
+
+//Bytes a script can hold
+#ifndef LIGHTNINGSTEPPER_SCRIPT_SIZE
+#define LIGHTNINGSTEPPER_SCRIPT_SIZE 64
+#endif
+//First EEPROM address of the saved script. The settings records before it take 384 bytes with the default 8 slots.
+#ifndef LIGHTNINGSTEPPER_SCRIPT_ADDRESS
+#define LIGHTNINGSTEPPER_SCRIPT_ADDRESS 512
+#endif
+//How deep loops can nest
+#define LIGHTNINGSTEPPER_SCRIPT_LOOPS 4
+//Instructions run per call to run() at most
+#define LIGHTNINGSTEPPER_SCRIPT_STEPS 4
+
+class LightningStepperScript
+{
+    public:
+        static const uint8_t opEnd = 0x00;
+        static const uint8_t opMove = 0x01;
+        static const uint8_t opMoveTo = 0x02;
+        static const uint8_t opWaitDone = 0x03;
+        static const uint8_t opDwell = 0x04;
+        static const uint8_t opLoop = 0x05;
+        static const uint8_t opEndLoop = 0x06;
+        static const uint8_t opWaitPin = 0x07;
+        static const uint8_t opQueueMove = 0x08;
+
+        //Bytes an instruction takes counting the opcode. 0 for an unknown opcode.
+        static uint8_t instructionSize(uint8_t opcode);
+        //Copy bytes in at offset. Writing at offset 0 starts a new script. Returns false if they do not fit.
+        static bool write(uint8_t offset, const uint8_t* data, uint8_t count);
+        //Start saving the script to EEPROM, or load it back. load() returns false if there is no good saved script. AVR only like LightningStepperStorage.
+        static void save();
+        static bool load();
+        //Write the next byte of a save if the EEPROM is ready for it, so a save never holds up run(). Returns true while there are bytes left.
+        //The script must not change until it returns false.
+        static bool service();
+        //True while a save is still being written
+        static bool saving();
+
+        static uint8_t code[LIGHTNINGSTEPPER_SCRIPT_SIZE];
+        static uint8_t length;
+    private:
+        //length(u8),crc(u8) then the code
+        static uint8_t scriptCrc();
+        //Next byte service() writes: the length cleared, the code, the crc, then the length
+        static uint8_t saveIndex;
+        static bool savePending;
+};
+
+#endif
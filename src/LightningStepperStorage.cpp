@@ -0,0 +1,166 @@
+/*
+  LightningStepperStorage.cpp - Saves the settings and position of every axis to EEPROM for the LightningStepper library.
+  Part of the LightningStepper library by Calvin Bultz.
+  Released into the public domain.
+*/
+
+#include <stddef.h>
+#include "Arduino.h"
+#include "LightningStepperStorage.h"
+#include "LightningStepperProtocol.h"
+#include "LightningStepperScript.h"
+
+#if defined(LIGHTNINGSTEPPER_EEPROM)
+#include <avr/eeprom.h>
+#endif
+
+int8_t LightningStepperStorage::newestSlot = -1;
+uint8_t LightningStepperStorage::newestSequence = 0;
+LightningStepperStorage::Record LightningStepperStorage::pending;
+uint8_t LightningStepperStorage::pendingSlot = 0;
+uint8_t LightningStepperStorage::pendingIndex = 0;
+bool LightningStepperStorage::writing = false;
+
+//Same CRC-8 as the binary protocol. Covers everything but the crc and the clean marker.
+uint8_t LightningStepperStorage::recordCrc(const Record& record)
+{
+    const uint8_t* data = (const uint8_t*)&record;
+    uint8_t crc = 0;
+    for (uint8_t i = 0; i < offsetof(Record, crc); i++)
+    {
+        crc = LightningStepperProtocol::crc8(crc, data[i]);
+    }
+    return crc;
+}
+
+size_t LightningStepperStorage::slotAddress(uint8_t slot)
+{
+    //The records must end before the saved script starts
+    static_assert(LIGHTNINGSTEPPER_STORAGE_ADDRESS + LIGHTNINGSTEPPER_STORAGE_SLOTS * sizeof(Record) <= LIGHTNINGSTEPPER_SCRIPT_ADDRESS,
+        "The storage slots run into LIGHTNINGSTEPPER_SCRIPT_ADDRESS. Use fewer slots or move one of the addresses.");
+    return LIGHTNINGSTEPPER_STORAGE_ADDRESS + (slot * sizeof(Record));
+}
+
+#if defined(LIGHTNINGSTEPPER_EEPROM)
+
+bool LightningStepperStorage::load(LightningStepperAxisSettings* settings, uint8_t& count, bool& clean)
+{
+    Record record;
+    newestSlot = -1;
+    for (uint8_t slot = 0; slot < LIGHTNINGSTEPPER_STORAGE_SLOTS; slot++)
+    {
+        eeprom_read_block(&record, (const void*)slotAddress(slot), sizeof(Record));
+        if (record.crc != LightningStepperStorage::recordCrc(record) || record.count > LIGHTNINGSTEPPER_STORAGE_AXES)
+        {
+            continue;
+        }
+        //Sequence numbers wrap so newer means ahead by less than half the range
+        if (newestSlot < 0 || (int8_t)(record.sequence - newestSequence) > 0)
+        {
+            newestSlot = slot;
+            newestSequence = record.sequence;
+        }
+    }
+    if (newestSlot < 0)
+    {
+        return false;
+    }
+    eeprom_read_block(&record, (const void*)slotAddress(newestSlot), sizeof(Record));
+    count = record.count;
+    for (uint8_t i = 0; i < count; i++)
+    {
+        settings[i] = record.axes[i];
+    }
+    clean = (record.marker == cleanMarker);
+    return true;
+}
+
+void LightningStepperStorage::save(const LightningStepperAxisSettings* settings, uint8_t count)
+{
+    memset(&pending, 0, sizeof(Record));
+    if (count > LIGHTNINGSTEPPER_STORAGE_AXES)
+    {
+        count = LIGHTNINGSTEPPER_STORAGE_AXES;
+    }
+    pending.sequence = newestSequence + 1;
+    pending.count = count;
+    for (uint8_t i = 0; i < count; i++)
+    {
+        pending.axes[i] = settings[i];
+    }
+    pending.crc = LightningStepperStorage::recordCrc(pending);
+    pending.marker = cleanMarker;
+    pendingSlot = (newestSlot < 0) ? 0 : (newestSlot + 1) % LIGHTNINGSTEPPER_STORAGE_SLOTS;
+    pendingIndex = 0;
+    writing = true;
+}
+
+bool LightningStepperStorage::service()
+{
+    //A byte takes about 3.3ms. Never wait for one.
+    if (writing == false || eeprom_is_ready() == 0)
+    {
+        return writing;
+    }
+    uint8_t* marker = (uint8_t*)(slotAddress(pendingSlot) + offsetof(Record, marker));
+    if (pendingIndex == 0)
+    {
+        //Not clean until the whole record is in. If power is lost part way either the CRC fails or the marker is clear.
+        eeprom_update_byte(marker, 0);
+    }
+    else if (pendingIndex <= offsetof(Record, marker))
+    {
+        //Only the bytes that changed are written
+        uint8_t i = pendingIndex - 1;
+        eeprom_update_byte((uint8_t*)(slotAddress(pendingSlot) + i), ((const uint8_t*)&pending)[i]);
+    }
+    else
+    {
+        eeprom_update_byte(marker, cleanMarker);
+        newestSlot = pendingSlot;
+        newestSequence = pending.sequence;
+        writing = false;
+        return false;
+    }
+    pendingIndex++;
+    return true;
+}
+
+void LightningStepperStorage::markDirty()
+{
+    //The record being written is already marked dirty
+    writing = false;
+    if (newestSlot < 0)
+    {
+        return;
+    }
+    eeprom_update_byte((uint8_t*)(slotAddress(newestSlot) + offsetof(Record, marker)), 0);
+}
+
+#else
+
+bool LightningStepperStorage::load(LightningStepperAxisSettings* settings, uint8_t& count, bool& clean)
+{
+    //No EEPROM support on this board
+    (void)settings;
+    count = 0;
+    clean = false;
+    return false;
+}
+
+void LightningStepperStorage::save(const LightningStepperAxisSettings* settings, uint8_t count)
+{
+    (void)settings;
+    (void)count;
+}
+
+bool LightningStepperStorage::service()
+{
+    return false;
+}
+
+void LightningStepperStorage::markDirty()
+{
+}
+
+#endif
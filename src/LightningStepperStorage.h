@@ -0,0 +1,85 @@
+/*
+  LightningStepperStorage.h - Saves the settings and position of every axis to EEPROM for the LightningStepper library.
+  Part of the LightningStepper library by Calvin Bultz.
+  Released into the public domain.
+  -Records are written round robin across LIGHTNINGSTEPPER_STORAGE_SLOTS slots so no one cell wears out. The newest record with a good CRC wins.
+  -Each record ends with a clean marker that is outside the CRC. It is cleared with a single byte write when a move starts and set again when the
+    record is rewritten after the motors have sat stopped for LIGHTNINGSTEPPER_STORAGE_DELAY, so a power loss mid move is detected and the saved position is not trusted.
+  -A record goes out one byte per service() call, and only once the EEPROM has finished the byte before, so a save never holds up run(). The clean marker is cleared first
+    and set last so a record that was cut short is never trusted.
+  -Only AVR boards are supported. On other boards load() finds nothing and save() does nothing.
+*/
+#ifndef LightningStepperStorage_h
+#define LightningStepperStorage_h
+#include "Arduino.h"
+
+//The EEPROM is written with the avr-libc functions. The simulated core of the host tests has them too.
+#if defined(__AVR__) || defined(ARDUINO_HOST)
+#define LIGHTNINGSTEPPER_EEPROM
+#endif
+
+//First EEPROM address used. Move it if the sketch keeps its own data in EEPROM.
+#ifndef LIGHTNINGSTEPPER_STORAGE_ADDRESS
+#define LIGHTNINGSTEPPER_STORAGE_ADDRESS 0
+#endif
+//Number of records to spread the writes over
+#ifndef LIGHTNINGSTEPPER_STORAGE_SLOTS
+#define LIGHTNINGSTEPPER_STORAGE_SLOTS 8
+#endif
+//Milliseconds every axis must sit stopped before a record is saved. With the default of one minute and 8 slots the most written cell,
+//the clean marker, is written about once every 4 minutes of back to back moves, so it lasts past its 100000 writes for over 9 months of that.
+//A power loss before the delay is up just means the setup runs again.
+#ifndef LIGHTNINGSTEPPER_STORAGE_DELAY
+#define LIGHTNINGSTEPPER_STORAGE_DELAY 60000
+#endif
+//Number of axes a record holds. Matches LIGHTNINGSTEPPER_MAX_AXES.
+#define LIGHTNINGSTEPPER_STORAGE_AXES 4
+
+//What is saved for one axis
+struct LightningStepperAxisSettings
+{
+    int16_t minDelay;
+    int16_t maxDelay;
+    int16_t currentPosition;
+    int16_t maxPosition;
+    //The positions are in steps of this mode. See LightningStepper::StepMode
+    uint8_t stepMode;
+    uint8_t halfOffset;
+    //Where the rotor sits in the coil sequence so the first step after a restore moves it one step from there
+    uint8_t coilPhase;
+};
+
+class LightningStepperStorage
+{
+    public:
+        //Find the newest good record. Returns false if there is none. clean is false if a move was running when it was last saved.
+        static bool load(LightningStepperAxisSettings* settings, uint8_t& count, bool& clean);
+        //Start writing a new record marked clean. Call load() once first so the newest slot is known. A save that is still going is started over.
+        static void save(const LightningStepperAxisSettings* settings, uint8_t count);
+        //Write the next byte of the record if the EEPROM is ready for it. Returns true while there are bytes left.
+        static bool service();
+        //Clear the clean marker of the newest record and drop a save that is still going. A single byte write.
+        static void markDirty();
+    private:
+        struct Record
+        {
+            uint8_t sequence;
+            uint8_t count;
+            LightningStepperAxisSettings axes[LIGHTNINGSTEPPER_STORAGE_AXES];
+            uint8_t crc;
+            uint8_t marker;
+        };
+        static const uint8_t cleanMarker = 0x5A;
+        //-1 until a record has been found or written
+        static int8_t newestSlot;
+        static uint8_t newestSequence;
+        //The record being written by service()
+        static Record pending;
+        static uint8_t pendingSlot;
+        static uint8_t pendingIndex;
+        static bool writing;
+        static uint8_t recordCrc(const Record& record);
+        static size_t slotAddress(uint8_t slot);
+};
+
+#endif
@@ -0,0 +1,61 @@
+/*
+  LightningStepperSwitch.h - Limit switch input used by the LightningStepper library.
+  Part of the LightningStepper library by Calvin Bultz.
+  Released into the public domain.
+  -Switches are wired like pin_CmdReady: INPUT_PULLUP with the switch pulling the pin to ground, so closed reads LOW.
+  -A switch that is not attached always reads open so the step path can check it without a branch.
+*/
+#ifndef LightningStepperSwitch_h
+#define LightningStepperSwitch_h
+#include "Arduino.h"
+
+class LightningStepperSwitch
+{
+    public:
+        //pin -1 leaves the switch unattached
+        void begin(int pin)
+        {
+            this->pin = pin;
+#if defined(__AVR__)
+            if (pin < 0)
+            {
+                inputRegister = &unattached;
+                mask = 0;
+                return;
+            }
+            pinMode(pin, INPUT_PULLUP);
+            //Resolved once so the step timer interrupt only reads a register
+            inputRegister = portInputRegister(digitalPinToPort(pin));
+            mask = digitalPinToBitMask(pin);
+#else
+            if (pin >= 0)
+            {
+                pinMode(pin, INPUT_PULLUP);
+            }
+#endif
+        }
+
+        inline bool isAttached()
+        {
+            return pin >= 0;
+        }
+
+        inline bool isClosed()
+        {
+#if defined(__AVR__)
+            return (~(*inputRegister) & mask) != 0;
+#else
+            return pin >= 0 && digitalRead(pin) == LOW;
+#endif
+        }
+    private:
+        int pin = -1;
+#if defined(__AVR__)
+        //Somewhere harmless to read while no pin is attached. The zero mask ignores it.
+        volatile uint8_t unattached = 0;
+        volatile uint8_t* inputRegister = &unattached;
+        uint8_t mask = 0;
+#endif
+};
+
+#endif
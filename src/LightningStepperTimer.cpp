@@ -0,0 +1,247 @@
+/*
+  LightningStepperTimer.cpp - Step timer used by the LightningStepper library.
+  Part of the LightningStepper library by Calvin Bultz.
+  Released into the public domain.
+*/
+
+#include "Arduino.h"
+#include "LightningStepperTimer.h"
+
+#if defined(__AVR__)
+#include <avr/interrupt.h>
+#endif
+
+LightningStepperTimerCallback LightningStepperTimer::callback = 0;
+volatile bool LightningStepperTimer::running = false;
+unsigned long LightningStepperTimer::dueMicros = 0;
+unsigned long LightningStepperTimer::pendingTicks = 0;
+
+#if defined(__AVR__)
+
+//Timer1 runs free with a prescaler of 8. At 16MHz one tick is 0.5 microseconds so the 16 bit counter wraps every 32.8ms.
+//A 65535 microsecond interval is 131070 ticks so the math is done in unsigned long.
+static inline unsigned long microsToTicks(unsigned int micro)
+{
+    return ((unsigned long)micro * (F_CPU / 1000000UL)) >> 3;
+}
+
+//If the compare value is closer than this to the counter the interrupt could be missed and the motor would stall for a full timer wrap.
+static const unsigned int minimumTicks = 32;
+//Longest wait one compare is set for. Half the counter so a compare ahead of the counter can always be told from one that has passed.
+//Longer intervals are chained across several compares and only the last one runs the callback.
+static const unsigned int maximumTicks = 0x8000;
+
+//Move the compare ticks past the last one. Anything over maximumTicks waits for the compares after it.
+void LightningStepperTimer::scheduleTicks(unsigned long ticks)
+{
+    if (ticks > maximumTicks)
+    {
+        pendingTicks = ticks - maximumTicks;
+        ticks = maximumTicks;
+    }
+    else
+    {
+        pendingTicks = 0;
+    }
+    OCR1A += (unsigned int)ticks;
+}
+
+void LightningStepperTimer::begin()
+{
+    uint8_t oldSREG = SREG;
+    cli();
+    //Normal mode. The counter is never reset so every interval is measured from the previous compare and does not drift.
+    TCCR1A = 0;
+    TCCR1B = (1 << CS11);
+    TIMSK1 &= ~(1 << OCIE1A);
+    SREG = oldSREG;
+}
+
+void LightningStepperTimer::start(LightningStepperTimerCallback p_callback, unsigned int firstDelay)
+{
+    uint8_t oldSREG = SREG;
+    cli();
+    callback = p_callback;
+    unsigned long ticks = microsToTicks(firstDelay);
+    if (ticks < minimumTicks)
+    {
+        ticks = minimumTicks;
+    }
+    OCR1A = TCNT1;
+    LightningStepperTimer::scheduleTicks(ticks);
+    //Clear a stale compare flag so the first step is not emitted early
+    TIFR1 = (1 << OCF1A);
+    TIMSK1 |= (1 << OCIE1A);
+    running = true;
+    SREG = oldSREG;
+}
+
+void LightningStepperTimer::stop()
+{
+    uint8_t oldSREG = SREG;
+    cli();
+    TIMSK1 &= ~(1 << OCIE1A);
+    running = false;
+    SREG = oldSREG;
+}
+
+unsigned int LightningStepperTimer::untilNext()
+{
+    uint8_t oldSREG = SREG;
+    cli();
+    //Unsigned so a wait of more than half the counter does not read as negative. The compare is never set further ahead than maximumTicks
+    //so anything past that means it has already matched and the interrupt is waiting to run.
+    unsigned int ticks = OCR1A - TCNT1;
+    unsigned long pending = pendingTicks;
+    bool isDue = (running == false || ticks == 0 || ticks > maximumTicks);
+    SREG = oldSREG;
+    if (isDue)
+    {
+        return 0;
+    }
+    unsigned long micro = ((ticks + pending) << 3) / (F_CPU / 1000000UL);
+    return (micro > 0xFFFFUL) ? 0xFFFF : (unsigned int)micro;
+}
+
+unsigned int LightningStepperTimer::pullIn(unsigned int micro)
+{
+    uint8_t oldSREG = SREG;
+    cli();
+    unsigned int ticks = OCR1A - TCNT1;
+    if (running == false || ticks == 0 || ticks > maximumTicks)
+    {
+        SREG = oldSREG;
+        return 0;
+    }
+    //Whole microseconds only so the caller's clock stays exact
+    unsigned long room = (unsigned long)ticks + pendingTicks;
+    unsigned long most = (room > minimumTicks) ? (((room - minimumTicks) << 3) / (F_CPU / 1000000UL)) : 0;
+    if (micro > most)
+    {
+        micro = (unsigned int)most;
+    }
+    unsigned long earlier = microsToTicks(micro);
+    //A long interval gives up the compares still to come first
+    if (earlier <= pendingTicks)
+    {
+        pendingTicks -= earlier;
+    }
+    else
+    {
+        OCR1A -= (unsigned int)(earlier - pendingTicks);
+        pendingTicks = 0;
+    }
+    SREG = oldSREG;
+    return micro;
+}
+
+void LightningStepperTimer::poll()
+{
+    //Nothing to do. The compare interrupt services the timer.
+}
+
+void LightningStepperTimer::service()
+{
+    //Part way through a long interval
+    if (pendingTicks > 0)
+    {
+        LightningStepperTimer::scheduleTicks(pendingTicks);
+        return;
+    }
+    unsigned int nextDelay = callback();
+    if (nextDelay == 0)
+    {
+        TIMSK1 &= ~(1 << OCIE1A);
+        running = false;
+        return;
+    }
+    unsigned long ticks = microsToTicks(nextDelay);
+    //Ticks since the compare that got us here. Unsigned so it is right however long the interval was.
+    unsigned int elapsed = TCNT1 - OCR1A;
+    //Fall back to the closest safe compare if the callback took longer than the interval
+    if (ticks < (unsigned long)elapsed + minimumTicks)
+    {
+        OCR1A = TCNT1 + minimumTicks;
+        pendingTicks = 0;
+        return;
+    }
+    LightningStepperTimer::scheduleTicks(ticks);
+}
+
+ISR(TIMER1_COMPA_vect)
+{
+    LightningStepperTimer::service();
+}
+
+#else
+
+void LightningStepperTimer::begin()
+{
+    running = false;
+}
+
+void LightningStepperTimer::start(LightningStepperTimerCallback p_callback, unsigned int firstDelay)
+{
+    noInterrupts();
+    callback = p_callback;
+    dueMicros = micros() + firstDelay;
+    running = true;
+    interrupts();
+}
+
+void LightningStepperTimer::stop()
+{
+    running = false;
+}
+
+unsigned int LightningStepperTimer::untilNext()
+{
+    long remaining = (long)(dueMicros - micros());
+    if (running == false || remaining <= 0)
+    {
+        return 0;
+    }
+    return (unsigned int)remaining;
+}
+
+unsigned int LightningStepperTimer::pullIn(unsigned int micro)
+{
+    long remaining = (long)(dueMicros - micros());
+    if (running == false || remaining <= 0)
+    {
+        return 0;
+    }
+    if ((long)micro > remaining)
+    {
+        micro = (unsigned int)remaining;
+    }
+    dueMicros -= micro;
+    return micro;
+}
+
+void LightningStepperTimer::poll()
+{
+    if (running == true && (long)(micros() - dueMicros) >= 0)
+    {
+        LightningStepperTimer::service();
+    }
+}
+
+void LightningStepperTimer::service()
+{
+    unsigned int nextDelay = callback();
+    if (nextDelay == 0)
+    {
+        running = false;
+        return;
+    }
+    //Measured from when the step was due, not when it ran, so the step rate does not drift
+    dueMicros += nextDelay;
+}
+
+#endif
+
+bool LightningStepperTimer::isRunning()
+{
+    return running;
+}
@@ -0,0 +1,45 @@
+/*
+  LightningStepperTimer.h - Step timer used by the LightningStepper library.
+  Part of the LightningStepper library by Calvin Bultz.
+  Released into the public domain.
+  -On AVR boards (Uno, Nano, Mega) the step timer uses Timer1 and its compare A interrupt. Libraries that also use Timer1 (ex: Servo) cannot be used at the same time.
+    Any unsigned int interval works. Intervals longer than half the 16 bit counter (16.4ms at 16MHz) are chained across several compares.
+  -On every other board, or when compiled off target, the timer is emulated with micros() and must be serviced by calling poll() as often as possible.
+*/
+#ifndef LightningStepperTimer_h
+#define LightningStepperTimer_h
+#include "Arduino.h"
+
+//Called every time the timer expires. Returns the microseconds until the next call or 0 to stop the timer.
+typedef unsigned int (*LightningStepperTimerCallback)();
+
+class LightningStepperTimer
+{
+    public:
+        //Configure the timer hardware. Call once before start().
+        static void begin();
+        //Call the callback after firstDelay microseconds and then keep calling it at the interval it returns.
+        static void start(LightningStepperTimerCallback callback, unsigned int firstDelay);
+        //Stop calling the callback. Safe to call when the timer is not running.
+        static void stop();
+        static bool isRunning();
+        //Microseconds until the callback is due. 0 if it is due now or the timer is not running.
+        static unsigned int untilNext();
+        //Bring the pending call forward by up to this many microseconds, no closer than the timer can still catch. Returns the microseconds it was moved.
+        //The call after it is still measured from the moved one, so nothing drifts.
+        static unsigned int pullIn(unsigned int micro);
+        //Services the emulated timer. Does nothing when a hardware timer is used.
+        static void poll();
+        //Runs the callback and schedules the next call. Called by the timer interrupt or poll().
+        static void service();
+    private:
+        static LightningStepperTimerCallback callback;
+        static volatile bool running;
+        //Time the next call is due. Used by the emulated timer.
+        static unsigned long dueMicros;
+        //Ticks left to wait after the pending compare when an interval is longer than one compare can hold. Used by Timer1.
+        static unsigned long pendingTicks;
+        static void scheduleTicks(unsigned long ticks);
+};
+
+#endif